@@ -93,6 +93,11 @@ class CoreExport ChanAccess : public Serializable
 	time_t last_seen;
 	time_t created;
 
+	/* Incremented whenever an access list, or anything access entries
+	 * are matched against, changes. See ChannelInfo::AccessFor.
+	 */
+	static unsigned Generation;
+
 	ChanAccess(AccessProvider *p);
 	virtual ~ChanAccess();
 
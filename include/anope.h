@@ -75,9 +75,9 @@ namespace Anope
 		inline bool equals_cs(const std::string &_str) const { return this->_string == _str; }
 		inline bool equals_cs(const string &_str) const { return this->_string == _str._string; }
 
-		inline bool equals_ci(const char *_str) const { return ci::string(this->_string.c_str()) == _str; }
-		inline bool equals_ci(const std::string &_str) const { return ci::string(this->_string.c_str()) == _str.c_str(); }
-		inline bool equals_ci(const string &_str) const { return ci::string(this->_string.c_str()) == _str._string.c_str(); }
+		inline bool equals_ci(const char *_str) const { size_t len = strlen(_str); return this->_string.length() == len && ci::equals(this->_string.data(), _str, len); }
+		inline bool equals_ci(const std::string &_str) const { return this->_string.length() == _str.length() && ci::equals(this->_string.data(), _str.data(), _str.length()); }
+		inline bool equals_ci(const string &_str) const { return this->_string.length() == _str._string.length() && ci::equals(this->_string.data(), _str._string.data(), _str._string.length()); }
 
 		/**
 		 * Inequality operators, exact opposites of the above.
@@ -190,13 +190,13 @@ namespace Anope
 		 */
 		inline size_type find(const string &_str, size_type pos = 0) const { return this->_string.find(_str._string, pos); }
 		inline size_type find(char chr, size_type pos = 0) const { return this->_string.find(chr, pos); }
-		inline size_type find_ci(const string &_str, size_type pos = 0) const { return ci::string(this->_string.c_str()).find(ci::string(_str._string.c_str()), pos); }
-		inline size_type find_ci(char chr, size_type pos = 0) const { return ci::string(this->_string.c_str()).find(chr, pos); }
+		inline size_type find_ci(const string &_str, size_type pos = 0) const { return ci::find(this->_string.data(), this->_string.length(), _str._string.data(), _str._string.length(), pos); }
+		inline size_type find_ci(char chr, size_type pos = 0) const { return ci::find(this->_string.data(), this->_string.length(), &chr, 1, pos); }
 
 		inline size_type rfind(const string &_str, size_type pos = npos) const { return this->_string.rfind(_str._string, pos); }
 		inline size_type rfind(char chr, size_type pos = npos) const { return this->_string.rfind(chr, pos); }
-		inline size_type rfind_ci(const string &_str, size_type pos = npos) const { return ci::string(this->_string.c_str()).rfind(ci::string(_str._string.c_str()), pos); }
-		inline size_type rfind_ci(char chr, size_type pos = npos) const { return ci::string(this->_string.c_str()).rfind(chr, pos); }
+		inline size_type rfind_ci(const string &_str, size_type pos = npos) const { return ci::rfind(this->_string.data(), this->_string.length(), _str._string.data(), _str._string.length(), pos); }
+		inline size_type rfind_ci(char chr, size_type pos = npos) const { return ci::rfind(this->_string.data(), this->_string.length(), &chr, 1, pos); }
 
 		inline size_type find_first_of(const string &_str, size_type pos = 0) const { return this->_string.find_first_of(_str._string, pos); }
 		inline size_type find_first_of_ci(const string &_str, size_type pos = 0) const { return ci::string(this->_string.c_str()).find_first_of(ci::string(_str._string.c_str()), pos); }
@@ -312,7 +312,7 @@ namespace Anope
 	{
 		inline size_t operator()(const string &s) const
 		{
-			return TR1NS::hash<std::string>()(s.lower().str());
+			return ci::hash(s.c_str(), s.length());
 		}
 	};
 
@@ -428,6 +428,11 @@ namespace Anope
 	 */
 	extern CoreExport bool Match(const string &str, const string &mask, bool case_sensitive = false, bool use_regex = false);
 
+	/** Set the regex engine Match uses, and forget the regular expressions it compiled with the previous one.
+	 * @param engine The name of the regex engine
+	 */
+	extern CoreExport void SetRegexEngine(const string &engine);
+
 	/** Converts a string to hex
 	 * @param the data to be converted
 	 * @return a anope::string containing the hex value
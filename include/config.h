@@ -100,8 +100,6 @@ namespace Configuration
 		bool DefPrivmsg;
 		/* Default language */
 		Anope::string DefLanguage;
-		/* options:timeoutcheck */
-		time_t TimeoutCheck;
 		/* options:usestrictprivmsg */
 		bool UseStrictPrivmsg;
 
@@ -0,0 +1,103 @@
+/*
+ *
+ * (C) 2003-2013 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ *
+ */
+
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include "serialize.h"
+#include "service.h"
+
+/** Schedules objects to be checked for expiry, so expiring objects does not require
+ * looking at every object. Objects are scheduled for the time they may next expire,
+ * and are passed to Check once that time has passed. If Check does not expire the
+ * object it should schedule it again for the next time it may expire.
+ *
+ * Using an object usually only makes it expire later, so it does not need to be
+ * scheduled again when used, it is checked at the time it was scheduled for and then
+ * scheduled again for its new expiry time. Only changes which make an object expire
+ * sooner need to schedule it again.
+ */
+class CoreExport ExpiryQueue : public Service
+{
+ public:
+	struct Stats
+	{
+		/* Objects checked and expired the last time the queue was processed */
+		unsigned long checked, expired;
+		/* How long processing the queue last took, in milliseconds */
+		unsigned long time;
+		/* Objects checked and expired in total */
+		unsigned long total_checked, total_expired;
+		/* The number of times the queue has been processed */
+		unsigned long runs;
+
+		Stats() : checked(0), expired(0), time(0), total_checked(0), total_expired(0), runs(0) { }
+	};
+
+ private:
+	struct Scheduled
+	{
+		time_t when;
+		Reference<Serializable> obj;
+	};
+
+	/* When each object is scheduled for */
+	TR1NS::unordered_map<Serializable *, Scheduled> scheduled;
+	/* Min-heap of scheduled objects. Entries which do not match scheduled are left over from
+	 * objects which have since been scheduled sooner or been deleted, and are skipped.
+	 */
+	std::vector<std::pair<time_t, Serializable *> > queue;
+	/* The time the queue is being processed for, if it is being processed */
+	time_t processing;
+	Stats stats;
+
+ public:
+	/** Constructor
+	 * @param creator The module which owns the queue
+	 * @param name The name of the queue
+	 */
+	ExpiryQueue(Module *creator, const Anope::string &name);
+
+	virtual ~ExpiryQueue();
+
+	/** Schedule an object to be checked once a time has passed. Does nothing if
+	 * it is already scheduled to be checked sooner.
+	 * @param obj The object
+	 * @param when The time
+	 */
+	void Schedule(Serializable *obj, time_t when);
+
+	/** Remove every object from the queue
+	 */
+	void Clear();
+
+	/** Get the number of objects in the queue
+	 * @return The number of objects
+	 */
+	size_t GetCount() const;
+
+	/** Check the objects which are due to be checked. Objects scheduled while
+	 * checking are not checked again until the next time the queue is processed.
+	 * @param now The current time
+	 */
+	void Process(time_t now = Anope::CurTime);
+
+	/** Get statistics about processing the queue
+	 * @return The statistics
+	 */
+	const Stats &GetStats() const;
+
+	/** Called when an object is due to be checked for expiry
+	 * @param obj The object
+	 * @return true if the object expired
+	 */
+	virtual bool Check(Serializable *obj) = 0;
+};
+
+#endif // EXPIRY_H
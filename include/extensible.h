@@ -20,24 +20,56 @@ class Extensible;
 class CoreExport ExtensibleBase : public Service
 {
  protected:
-	std::map<Extensible *, void *> items;
+	/* objects this item is set on */
+	std::set<Extensible *> items;
+	/* index of this item's value in the slot array of every Extensible */
+	unsigned slot;
+
+	/* stored in place of a NULL value, so items such as bools can be set without having one */
+	static char present;
 
 	ExtensibleBase(Module *m, const Anope::string &n);
 	~ExtensibleBase();
 
+	inline void *GetValue(const Extensible *obj) const;
+	void SetValue(Extensible *obj, void *value);
+	void *ClearValue(Extensible *obj);
+
+	/** Called after this item is set on or unset from an object
+	 * @param obj The object
+	 */
+	virtual void Changed(Extensible *obj) { }
+
  public:
 	virtual void Unset(Extensible *obj) = 0;
 
+	bool HasExt(const Extensible *obj) const
+	{
+		return GetValue(obj) != NULL;
+	}
+
 	/* called when an object we are keep track of is serializing */
 	virtual void ExtensibleSerialize(const Extensible *, const Serializable *, Serialize::Data &) const { }
 	virtual void ExtensibleUnserialize(Extensible *, Serializable *, Serialize::Data &) { }
+
+	/** Find an extensible item by name. Lookups are cached until a service is
+	 * registered or unregistered.
+	 * @param name The name of the item
+	 * @return The item, or NULL if it does not exist
+	 */
+	static ExtensibleBase *Find(const Anope::string &name);
 };
 
 class CoreExport Extensible
 {
  public:
-	std::set<ExtensibleBase *> extension_items;
+	/* values of the items set on this object, indexed by ExtensibleBase::slot */
+	std::vector<void *> extension_slots;
 
+	Extensible() { }
+	/* The values of items are owned by the object they are set on, so copies start without any */
+	Extensible(const Extensible &) { }
+	Extensible &operator=(const Extensible &) { return *this; }
 	virtual ~Extensible();
 
 	template<typename T> T* GetExt(const Anope::string &name) const;
@@ -52,6 +84,11 @@ class CoreExport Extensible
 	static void ExtensibleUnserialize(Extensible *, Serializable *, Serialize::Data &data);
 };
 
+inline void *ExtensibleBase::GetValue(const Extensible *obj) const
+{
+	return slot < obj->extension_slots.size() ? obj->extension_slots[slot] : NULL;
+}
+
 template<typename T>
 class BaseExtensibleItem : public ExtensibleBase
 {
@@ -63,16 +100,8 @@ class BaseExtensibleItem : public ExtensibleBase
 
 	~BaseExtensibleItem()
 	{
-		while (!items.empty())
-		{
-			std::map<Extensible *, void *>::iterator it = items.begin();
-			Extensible *obj = it->first;
-			T *value = static_cast<T *>(it->second);
-
-			obj->extension_items.erase(this);
-			items.erase(it);
-			delete value;
-		}
+		while (!this->items.empty())
+			Unset(*this->items.begin());
 	}
 
 	T* Set(Extensible *obj, const T &value)
@@ -87,30 +116,26 @@ class BaseExtensibleItem : public ExtensibleBase
 	{
 		T* t = Create(obj);
 		Unset(obj);
-		items[obj] = t;
-		obj->extension_items.insert(this);
+		this->SetValue(obj, t ? static_cast<void *>(t) : &present);
+		this->Changed(obj);
 		return t;
 	}
 
 	void Unset(Extensible *obj) anope_override
 	{
-		T *value = Get(obj);
-		items.erase(obj);
-		obj->extension_items.erase(this);
-		delete value;
+		void *value = this->ClearValue(obj);
+		if (value != &present)
+			delete static_cast<T *>(value);
+		if (value != NULL)
+			this->Changed(obj);
 	}
 
 	T* Get(const Extensible *obj) const
 	{
-		std::map<Extensible *, void *>::const_iterator it = items.find(const_cast<Extensible *>(obj));
-		if (it != items.end())
-			return static_cast<T *>(it->second);
-		return NULL;
-	}
-
-	bool HasExt(const Extensible *obj) const
-	{
-		return items.find(const_cast<Extensible *>(obj)) != items.end();
+		void *value = this->GetValue(obj);
+		if (value == &present)
+			return NULL;
+		return static_cast<T *>(value);
 	}
 
 	T* Require(Extensible *obj)
@@ -159,9 +184,18 @@ class PrimitiveExtensibleItem<bool> : public BaseExtensibleItem<bool>
 	PrimitiveExtensibleItem(Module *m, const Anope::string &n) : BaseExtensibleItem<bool>(m, n) { }
 };
 
+/* Serializable items are saved with the object they are set on, so setting or unsetting them changes the object */
 template<typename T>
 class SerializableExtensibleItem : public PrimitiveExtensibleItem<T>
 {
+ protected:
+	void Changed(Extensible *obj) anope_override
+	{
+		Serializable *s = dynamic_cast<Serializable *>(obj);
+		if (s)
+			s->QueueUpdate();
+	}
+
  public:
  	SerializableExtensibleItem(Module *m, const Anope::string &n) : PrimitiveExtensibleItem<T>(m, n) { }
 
@@ -182,6 +216,14 @@ class SerializableExtensibleItem : public PrimitiveExtensibleItem<T>
 template<>
 class SerializableExtensibleItem<bool> : public PrimitiveExtensibleItem<bool>
 {
+ protected:
+	void Changed(Extensible *obj) anope_override
+	{
+		Serializable *s = dynamic_cast<Serializable *>(obj);
+		if (s)
+			s->QueueUpdate();
+	}
+
  public:
  	SerializableExtensibleItem(Module *m, const Anope::string &n) : PrimitiveExtensibleItem<bool>(m, n) { }
 
@@ -208,9 +250,9 @@ struct ExtensibleRef : ServiceReference<BaseExtensibleItem<T> >
 template<typename T>
 T* Extensible::GetExt(const Anope::string &name) const
 {
-	ExtensibleRef<T> ref(name);
-	if (ref)
-		return ref->Get(this);
+	BaseExtensibleItem<T> *item = static_cast<BaseExtensibleItem<T> *>(ExtensibleBase::Find(name));
+	if (item)
+		return item->Get(this);
 
 	Log(LOG_DEBUG) << "GetExt for nonexistent type " << name << " on " << static_cast<const void *>(this);
 	return NULL;
@@ -228,9 +270,9 @@ T* Extensible::Extend(const Anope::string &name, const T &what)
 template<typename T>
 T* Extensible::Extend(const Anope::string &name)
 {
-	ExtensibleRef<T> ref(name);
-	if (ref)
-		return ref->Set(this);
+	BaseExtensibleItem<T> *item = static_cast<BaseExtensibleItem<T> *>(ExtensibleBase::Find(name));
+	if (item)
+		return item->Set(this);
 
 	Log(LOG_DEBUG) << "Extend for nonexistent type " << name << " on " << static_cast<void *>(this);
 	return NULL;
@@ -248,9 +290,9 @@ T* Extensible::Require(const Anope::string &name)
 template<typename T>
 void Extensible::Shrink(const Anope::string &name)
 {
-	ExtensibleRef<T> ref(name);
-	if (ref)
-		ref->Unset(this);
+	ExtensibleBase *item = ExtensibleBase::Find(name);
+	if (item)
+		item->Unset(this);
 	else
 		Log(LOG_DEBUG) << "Shrink for nonexistent type " << name << " on " << static_cast<void *>(this);
 }
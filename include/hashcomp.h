@@ -141,6 +141,42 @@ namespace ci
 		 */
 		bool operator()(const Anope::string &s1, const Anope::string &s2) const;
 	};
+
+	/** Hash a buffer case insensitively using the case map in use, so that
+	 * buffers which are equal according to ci::equals hash the same.
+	 * @param s The buffer
+	 * @param n The length of the buffer
+	 * @return The hash
+	 */
+	extern CoreExport size_t hash(const char *s, size_t n);
+
+	/** Check if two buffers of the same length are equal, case insensitively.
+	 * @param s1 The first buffer
+	 * @param s2 The second buffer
+	 * @param n The length of both buffers
+	 * @return true if they are equal
+	 */
+	extern CoreExport bool equals(const char *s1, const char *s2, size_t n);
+
+	/** Find the first occurrence of a buffer within another, case insensitively.
+	 * @param s The buffer to search
+	 * @param n The length of s
+	 * @param what The buffer to find
+	 * @param len The length of what
+	 * @param pos The position in s to start searching at
+	 * @return The position of what in s, or std::string::npos
+	 */
+	extern CoreExport size_t find(const char *s, size_t n, const char *what, size_t len, size_t pos);
+
+	/** Find the last occurrence of a buffer within another, case insensitively.
+	 * @param s The buffer to search
+	 * @param n The length of s
+	 * @param what The buffer to find
+	 * @param len The length of what
+	 * @param pos The last position in s a match may start at
+	 * @return The position of what in s, or std::string::npos
+	 */
+	extern CoreExport size_t rfind(const char *s, size_t n, const char *what, size_t len, size_t pos);
 }
 
 /* Define operators for + and == with ci::string to std::string for easy assignment
@@ -99,6 +99,7 @@ namespace Message
 		Notice(Module *creator, const Anope::string &mname = "NOTICE") : IRCDMessage(creator, mname, 2) { SetFlag(IRCDMESSAGE_REQUIRE_USER); }
 
 		void Run(MessageSource &source, const std::vector<Anope::string> &params) anope_override;
+		void Dispatch(MessageSource &source, const ParsedMessage &msg) anope_override;
 	};
 
 	struct CoreExport Part : IRCDMessage
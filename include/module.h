@@ -20,6 +20,7 @@
 #include "channels.h"
 #include "commands.h"
 #include "config.h"
+#include "expiry.h"
 #include "extensible.h"
 #include "hashcomp.h"
 #include "language.h"
@@ -69,5 +69,12 @@ struct BadWords
 	virtual void ClearBadWords() = 0;
 
 	virtual void Check() = 0;
+
+	/** Get the revision of this badword list. This changes whenever a badword
+	 * is added, removed or modified, and is never reused by another list until
+	 * bs_badwords is reloaded.
+	 * @return The revision
+	 */
+	virtual uint64_t GetRevision() const = 0;
 };
 
@@ -42,5 +42,10 @@ struct KickerData
 
  public:
 	virtual ~KickerData() { }
+
+	/** Must be called after the kickers are changed, saves them with
+	 * the channel and removes them if none are enabled.
+	 * @param ci The channel the kickers are on
+	 */
 	virtual void Check(ChannelInfo *ci) = 0;
 };
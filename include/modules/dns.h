@@ -118,6 +118,22 @@ namespace DNS
 	class Manager : public Service
 	{
 	 public:
+		struct Stats
+		{
+			/* Entries in the cache, and queries sent to a nameserver which have not been answered */
+			unsigned long entries, pending;
+			/* Requests answered from the cache, how many of those were negative answers, and requests not found in the cache */
+			unsigned long hits, negative_hits, misses;
+			/* Entries removed from the cache to make room for new ones */
+			unsigned long evictions;
+			/* Queries sent to the nameserver, and requests which waited on a query already sent for the same question */
+			unsigned long queries, coalesced;
+			/* Queries the nameserver did not answer in time, and queries asked again over TCP because the answer was truncated */
+			unsigned long timeouts, truncated;
+
+			Stats() : entries(0), pending(0), hits(0), negative_hits(0), misses(0), evictions(0), queries(0), coalesced(0), timeouts(0), truncated(0) { }
+		};
+
 		Manager(Module *creator) : Service(creator, "DNS::Manager", "dns/manager") { }
 		virtual ~Manager() { }
 
@@ -129,6 +145,12 @@ namespace DNS
 		virtual void UpdateSerial() = 0;
 		virtual void Notify(const Anope::string &zone) = 0;
 		virtual uint32_t GetSerial() const = 0;
+
+		/** Get statistics about the resolver cache and queries
+		 * @param stats Filled in with the statistics
+		 * @return true if statistics are available
+		 */
+		virtual bool GetStats(Stats &stats) { return false; }
 	};
 	
 	/** A DNS query.
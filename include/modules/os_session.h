@@ -38,6 +38,11 @@ class SessionService : public Service
 
 	virtual void DelException(Exception *e) = 0;
 
+	/** Must be called after exceptions are changed other than with AddException and DelException,
+	 * such as after they are reordered or their masks are changed.
+	 */
+	virtual void UpdateExceptions() = 0;
+
 	virtual Exception *FindException(User *u) = 0;
 
 	virtual Exception *FindException(const Anope::string &host) = 0; 
@@ -80,6 +85,8 @@ Serializable* Exception::Unserialize(Serializable *obj, Serialize::Data &data)
 
 	if (!obj)
 		session_service->AddException(ex);
+	else
+		session_service->UpdateExceptions();
 	return ex;
 }
 
@@ -97,14 +97,21 @@ namespace SQL
 	{
 		Anope::string query;
 		std::map<Anope::string, QueryData> parameters;
+		/* Whether the provider should prepare this query once and reuse the statement each time it is run,
+		 * binding the escaped parameters instead of escaping them into the query. Queries are the same
+		 * statement if their text and unescaped parameters are the same, so this is for queries which are
+		 * run many times.
+		 */
+		bool prepare;
 
-		Query() { }
-		Query(const Anope::string &q) : query(q) { }
+		Query() : prepare(false) { }
+		Query(const Anope::string &q, bool p = false) : query(q), prepare(p) { }
 
 		Query& operator=(const Anope::string &q)
 		{
 			this->query = q;
 			this->parameters.clear();
+			this->prepare = false;
 			return *this;
 		}
 
@@ -197,19 +204,63 @@ namespace SQL
 	class Provider : public Service
 	{
 	 public:
+		/** Statistics about the queries a provider has run
+		 */
+		struct Stats
+		{
+			/* Number of connections to the database */
+			unsigned connections;
+			/* Queries waiting to be executed, and queries executing now */
+			unsigned queued, running;
+			/* Queries executed, and how many of them failed */
+			unsigned long queries, errors;
+			/* Total milliseconds executed queries spent waiting and executing, and the longest time one took overall */
+			unsigned long wait_time, exec_time, max_latency;
+
+			Stats() : connections(0), queued(0), running(0), queries(0), errors(0), wait_time(0), exec_time(0), max_latency(0) { }
+		};
+
 		Provider(Module *c, const Anope::string &n) : Service(c, "SQL::Provider", n) { }
 
 		virtual void Run(Interface *i, const Query &query) = 0;
 
 		virtual Result RunQuery(const Query &query) = 0;
 
+		/** Run queries in the background as one transaction. They are executed in order with no other
+		 * query in between, and committed only if all of them succeed, otherwise they are rolled back.
+		 * @param i The interface, which is given the result of each query in order once the transaction
+		 * is over. If it was rolled back every query has an error.
+		 * @param queries The queries
+		 */
+		virtual void RunTransaction(Interface *i, const std::vector<Query> &queries) = 0;
+
+		/** Run queries as one transaction as RunTransaction does, blocking until it is over
+		 * @param queries The queries
+		 * @return The result of each query
+		 */
+		virtual std::vector<Result> RunTransactionQuery(const std::vector<Query> &queries) = 0;
+
 		virtual std::vector<Query> CreateTable(const Anope::string &table, const Data &data) = 0;
 
 		virtual Query BuildInsert(const Anope::string &table, unsigned int id, Data &data) = 0;
 
+		/** Build one query which inserts or updates many rows of a table. Every row
+		 * must already have an id, and have been passed to CreateTable.
+		 * @param table The table
+		 * @param rows The id and data of each row
+		 * @return The query
+		 */
+		virtual Query BuildBatchInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows) = 0;
+
 		virtual Query GetTables(const Anope::string &prefix) = 0;
 
 		virtual Anope::string FromUnixtime(time_t) = 0;
+
+		/** Get statistics about the queries this provider has run
+		 * @param stats Filled in with the statistics
+		 * @return false if this provider does not keep any
+		 */
+		virtual bool GetStats(Stats &stats) { return false; }
 	};
 
 }
@@ -246,25 +246,132 @@ class CoreExport MessageSource
 	Server *GetServer() const;
 };
 
+/** A read only view of part of a line received from the uplink. This
+ * does not own its data, so it is only valid for as long as the line it
+ * was parsed from is.
+ */
+class MessageToken
+{
+	const char *ptr;
+	size_t len;
+
+ public:
+	MessageToken() : ptr(""), len(0) { }
+	MessageToken(const char *p, size_t l) : ptr(p), len(l) { }
+
+	inline const char *data() const { return this->ptr; }
+	inline size_t length() const { return this->len; }
+	inline bool empty() const { return this->len == 0; }
+	inline char operator[](size_t n) const { return this->ptr[n]; }
+
+	inline bool equals_cs(const char *s) const { return !strncmp(this->ptr, s, this->len) && !s[this->len]; }
+	inline bool equals_ci(const char *s) const { return !ci::ci_char_traits::compare(this->ptr, s, this->len) && !s[this->len]; }
+
+	/** Copy this token into a string */
+	inline Anope::string str() const { return Anope::string(this->ptr, this->len); }
+
+	/** Get the next space separated word of this token
+	 * @param pos Where to start looking, moved past the word
+	 * @param word Set to the word
+	 * @return false if there are no more words
+	 */
+	bool GetWord(size_t &pos, MessageToken &word) const
+	{
+		while (pos < this->len && this->ptr[pos] == ' ')
+			++pos;
+		if (pos >= this->len)
+			return false;
+
+		size_t start = pos;
+		while (pos < this->len && this->ptr[pos] != ' ')
+			++pos;
+		word = MessageToken(this->ptr + start, pos - start);
+		return true;
+	}
+};
+
+/** A tokenized line received from the uplink. The source, command, and
+ * parameters are all views into the original line, so parsing does not allocate.
+ */
+class CoreExport ParsedMessage
+{
+ public:
+	/* How many parameters are kept without allocating, the rest of a longer line's go in extra_params */
+	static const unsigned MAX_PARAMS = 64;
+
+ private:
+	MessageToken source, command;
+	MessageToken params[MAX_PARAMS];
+	std::vector<MessageToken> extra_params;
+	unsigned count;
+
+	void AddParam(const MessageToken &param)
+	{
+		if (this->count < MAX_PARAMS)
+			this->params[this->count] = param;
+		else
+			this->extra_params.push_back(param);
+		++this->count;
+	}
+
+ public:
+	ParsedMessage() : count(0) { }
+
+	/** View parameters which have already been split, so handlers can implement Run() with Dispatch()
+	 * @param p The parameters, which must outlive this object
+	 */
+	explicit ParsedMessage(const std::vector<Anope::string> &p) : count(0)
+	{
+		for (unsigned i = 0; i < p.size(); ++i)
+			this->AddParam(MessageToken(p[i].c_str(), p[i].length()));
+	}
+
+	/** Tokenize a line
+	 * @param buffer The line, which must outlive this object
+	 * @return false if the line has no command
+	 */
+	bool Parse(const Anope::string &buffer);
+
+	inline const MessageToken &GetSource() const { return this->source; }
+	inline const MessageToken &GetCommand() const { return this->command; }
+	inline unsigned size() const { return this->count; }
+	inline bool empty() const { return this->count == 0; }
+	inline const MessageToken &operator[](unsigned n) const { return n < MAX_PARAMS ? this->params[n] : this->extra_params[n - MAX_PARAMS]; }
+
+	/** Copy the parameters into a vector, for handlers that need owned strings
+	 * @param out The vector to fill
+	 */
+	void GetParams(std::vector<Anope::string> &out) const;
+};
+
 enum IRCDMessageFlag
 {
 	IRCDMESSAGE_SOFT_LIMIT,
 	IRCDMESSAGE_REQUIRE_SERVER,
-	IRCDMESSAGE_REQUIRE_USER
+	IRCDMESSAGE_REQUIRE_USER,
+	IRCDMESSAGE_SIZE
 };
 
 class CoreExport IRCDMessage : public Service
 {
 	Anope::string name;
 	unsigned param_count;
-	std::set<IRCDMessageFlag> flags;
+	std::bitset<IRCDMESSAGE_SIZE> flags;
  public:
 	IRCDMessage(Module *owner, const Anope::string &n, unsigned p = 0);
 	unsigned GetParamCount() const;
 	virtual void Run(MessageSource &, const std::vector<Anope::string> &params) = 0;
 
-	void SetFlag(IRCDMessageFlag f) { flags.insert(f); }
-	bool HasFlag(IRCDMessageFlag f) const { return flags.count(f); }
+	/** Called with a tokenized line from the uplink. The default implementation copies
+	 * the parameters and calls Run(), handlers may override this to read the line without
+	 * copying it. Run() is still used when modules hook OnMessage, so both must behave the same.
+	 * @param source The source of the message
+	 * @param msg The tokenized line
+	 */
+	virtual void Dispatch(MessageSource &source, const ParsedMessage &msg);
+
+	void SetFlag(IRCDMessageFlag f) { flags.set(f); }
+	bool HasFlag(IRCDMessageFlag f) const { return flags.test(f); }
 };
 
 extern CoreExport IRCDProto *IRCD;
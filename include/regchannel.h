@@ -17,6 +17,7 @@
 #include "modules.h"
 #include "serialize.h"
 #include "bots.h"
+#include "access.h"
 
 typedef Anope::hash_map<ChannelInfo *> registered_channel_map;
 
@@ -56,6 +57,27 @@ class CoreExport ChannelInfo : public Serializable, public Extensible
 	Serialize::Checker<std::vector<AutoKick *> > akick;			/* List of users to kickban */
 	Anope::map<int16_t> levels;
 
+	/* Positions in the access list of entries for an account, entries for a
+	 * single unregistered nick, and everything else (masks and channels).
+	 * Rebuilt when access_generation falls behind ChanAccess::Generation.
+	 */
+	TR1NS::unordered_map<const NickCore *, std::vector<unsigned> > access_by_account;
+	Anope::hash_map<std::vector<unsigned> > access_by_nick;
+	std::vector<unsigned> access_by_mask;
+	unsigned access_generation;
+
+	/* Access entries matching recently checked users, by displayed mask */
+	struct CachedAccess
+	{
+		const NickCore *nc;
+		std::vector<ChanAccess *> entries;
+		ChanAccess::Path path;
+	};
+	Anope::hash_map<CachedAccess> access_cache;
+
+	void UpdateAccessIndex();
+	void MatchAccess(const User *u, const NickCore *nc, std::vector<ChanAccess *> &entries, ChanAccess::Path &path);
+
  public:
  	friend class ChanAccess;
 	friend class AutoKick;
@@ -136,6 +158,10 @@ class CoreExport ChannelInfo : public Serializable, public Extensible
 	AccessGroup AccessFor(const User *u);
 	AccessGroup AccessFor(const NickCore *nc);
 
+	/** Set the time this channel was last used to now
+	 */
+	void UpdateLastUsed();
+
 	/** Get the size of the accss vector for this channel
 	 * @return The access vector size
 	 */
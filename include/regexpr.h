@@ -40,6 +40,8 @@ class CoreExport RegexProvider : public Service
 {
  public:
 	RegexProvider(Module *o, const Anope::string &n) : Service(o, "Regex", n) { }
+	/* Forgets the regular expressions Match has cached, which may have been compiled by this provider */
+	~RegexProvider();
 	virtual Regex *Compile(const Anope::string &) = 0;
 };
 
@@ -60,15 +60,19 @@ class CoreExport Serializable : public virtual Base
 	 * constructed before other objects are if it isn't.
 	 */
 	static std::list<Serializable *> *SerializableItems;
+	/* Objects which have been marked as updated since updates were last processed */
+	static std::list<Serializable *> *UpdatedItems;
 	/* The type of item this object is */
 	Serialize::Type *s_type;
  private:
  	/* Iterator into serializable_items */
 	std::list<Serializable *>::iterator s_iter;
+	/* Iterator into UpdatedItems, valid only if updated is set */
+	std::list<Serializable *>::iterator u_iter;
+	/* Whether or not this object is waiting in UpdatedItems */
+	bool updated;
 	/* The hash of the last serialized form of this object commited to the database */
 	size_t last_commit;
-	/* The last time this object was commited to the database */
-	time_t last_commit_time;
 
  protected:
  	Serializable(const Anope::string &serialize_type);
@@ -85,16 +89,21 @@ class CoreExport Serializable : public virtual Base
 	/* Only used by redis, to ignore updates */
 	unsigned short redis_ignore;
 
-	/** Marks the object as potentially being updated "soon".
+	/** Marks the object as changed. This must be called by whatever changes something
+	 * the object serializes. It only sets a flag, modules are told about the update by
+	 * ProcessUpdates, at most once per object no matter how many times this is called
+	 * in the meantime.
 	 */
 	void QueueUpdate();
 
+	/** Check whether this object has been updated since updates were last processed
+	 * @return true if an update is pending
+	 */
+	bool IsUpdateQueued() const { return this->updated; }
+
 	bool IsCached(Serialize::Data &);
 	void UpdateCache(Serialize::Data &);
 
-	bool IsTSCached();
-	void UpdateTS();
-
 	/** Get the type of serializable object this is
 	 * @return The serializable object type
 	 */
@@ -103,6 +112,12 @@ class CoreExport Serializable : public virtual Base
 	virtual void Serialize(Serialize::Data &data) const = 0;
 
 	static const std::list<Serializable *> &GetItems();
+
+	/** Calls OnSerializeCheck once for each type with updated objects, and then
+	 * OnSerializableUpdate once for each object updated since the last call.
+	 * This is called once per iteration of the main loop and before databases are saved.
+	 */
+	static void ProcessUpdates();
 };
 
 /* A serializable type. There should be one of these classes for each type
@@ -296,39 +311,21 @@ class Serialize::Reference : public ReferenceBase
 	inline operator T*() const
 	{
 		if (!this->invalid)
-		{
-			if (this->ref)
-				// This can invalidate me
-				this->ref->QueueUpdate();
-			if (!this->invalid)
-				return this->ref;
-		}
+			return this->ref;
 		return NULL;
 	}
 
 	inline T* operator*() const
 	{
 		if (!this->invalid)
-		{
-			if (this->ref)
-				// This can invalidate me
-				this->ref->QueueUpdate();
-			if (!this->invalid)
-				return this->ref;
-		}
+			return this->ref;
 		return NULL;
 	}
 
 	inline T* operator->() const
 	{
 		if (!this->invalid)
-		{
-			if (this->ref)
-				// This can invalidate me
-				this->ref->QueueUpdate();
-			if (!this->invalid)
-				return this->ref;
-		}
+			return this->ref;
 		return NULL;
 	}
 };
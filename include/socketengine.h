@@ -20,8 +20,50 @@ class CoreExport SocketEngine
 {
 	static const int DefaultSize = 2; // Uplink, mode stacker
  public:
-	/* Map of sockets */
-	static std::map<int, Socket *> Sockets;
+	/* Sockets, indexed by their fd. Slots with no socket are NULL */
+	static std::vector<Socket *> Sockets;
+	/* The generation each slot in Sockets was filled at */
+	static std::vector<unsigned> Generations;
+	/* Incremented every time a socket is added. Engines take this before processing
+	 * events, so that if a socket is deleted while processing and its fd is reused
+	 * by a new socket, events meant for the old socket are not given to the new one.
+	 */
+	static unsigned Generation;
+	/* How many sockets there are */
+	static unsigned SocketCount;
+
+	/** Add a socket to the socket table
+	 * @param s The socket
+	 * @throws SocketException if the socket has no fd
+	 */
+	static void AddSocket(Socket *s);
+
+	/** Remove a socket from the socket table
+	 * @param s The socket
+	 */
+	static void DelSocket(Socket *s);
+
+	/** Find a socket by fd
+	 * @param fd The fd
+	 * @return The socket, or NULL
+	 */
+	static inline Socket *FindSocket(int fd)
+	{
+		return fd >= 0 && static_cast<unsigned>(fd) < Sockets.size() ? Sockets[fd] : NULL;
+	}
+
+	/** Find a socket by fd, ignoring sockets added after the given generation
+	 * @param fd The fd
+	 * @param gen The generation at which events started being processed
+	 * @return The socket, or NULL
+	 */
+	static inline Socket *FindSocket(int fd, unsigned gen)
+	{
+		Socket *s = FindSocket(fd);
+		if (s != NULL && static_cast<int>(Generations[fd] - gen) > 0)
+			return NULL;
+		return s;
+	}
 
 	/** Called to initialize the socket engine
 	 */
@@ -17,6 +17,7 @@
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #include "anope.h"
@@ -108,6 +109,154 @@ class CoreExport cidr
 	};
 };
 
+/** The parts of CIDRTree which do not depend on what is kept in it
+ */
+class CoreExport CIDRTreeBase
+{
+ protected:
+	/** A node of the tree, a prefix of an address
+	 */
+	struct NodeBase
+	{
+		unsigned char addr[16];
+		unsigned char len;
+
+		NodeBase(const unsigned char *a, unsigned char l);
+	};
+
+	static inline int Bit(const unsigned char *addr, unsigned i)
+	{
+		return (addr[i / 8] >> (7 - i % 8)) & 1;
+	}
+
+	/** Get the number of leading bits two addresses have in common, up to max
+	 */
+	static unsigned CommonPrefix(const unsigned char *a, const unsigned char *b, unsigned max);
+
+ public:
+	/** Get the bytes of an address
+	 * @param ip The address
+	 * @param addr Filled in with the address
+	 * @return The address family, 0 for IPv4 and 1 for IPv6, or -1 if ip is not an address
+	 */
+	static int ParseAddr(const Anope::string &ip, unsigned char *addr);
+
+	/** Parse a range the same way cidr does, an address without a length is a range of only itself
+	 * @param mask The range
+	 * @param addr Filled in with the address
+	 * @param len Filled in with the length of the range
+	 * @return The address family, or -1 if mask is not a range
+	 */
+	static int ParseRange(const Anope::string &mask, unsigned char *addr, unsigned char &len);
+};
+
+/** A binary radix tree of CIDR ranges, with one tree per address family. It finds
+ * the ranges an address is in by walking down the bits of the address once, instead
+ * of matching it against every range.
+ */
+template<typename T> class CIDRTree : public CIDRTreeBase
+{
+	struct Node : NodeBase
+	{
+		Node *children[2];
+		std::vector<T> entries;
+
+		Node(const unsigned char *a, unsigned char l) : NodeBase(a, l)
+		{
+			children[0] = children[1] = NULL;
+		}
+
+		~Node()
+		{
+			delete children[0];
+			delete children[1];
+		}
+	};
+
+	Node *roots[2];
+
+ public:
+	CIDRTree()
+	{
+		roots[0] = roots[1] = NULL;
+	}
+
+	~CIDRTree()
+	{
+		this->Clear();
+	}
+
+	void Clear()
+	{
+		delete roots[0];
+		delete roots[1];
+		roots[0] = roots[1] = NULL;
+	}
+
+	/** Get the entries of a range
+	 * @param mask The range, parsed by ParseRange
+	 * @param create Whether to add the range if it is not in the tree
+	 * @return The entries of the range, or NULL if mask is not a range or is not in the tree
+	 */
+	std::vector<T> *Get(const Anope::string &mask, bool create)
+	{
+		unsigned char addr[16], len;
+		int family = ParseRange(mask, addr, len);
+		if (family < 0)
+			return NULL;
+
+		Node **slot = &this->roots[family];
+
+		for (;;)
+		{
+			Node *n = *slot;
+			if (!n)
+				return create ? &(*slot = new Node(addr, len))->entries : NULL;
+
+			unsigned common = CommonPrefix(n->addr, addr, std::min(n->len, len));
+			if (common < n->len)
+			{
+				if (!create)
+					return NULL;
+
+				/* The prefixes diverge before the end of this node, so it is split there */
+				Node *parent = new Node(addr, common);
+				parent->children[Bit(n->addr, common)] = n;
+				*slot = parent;
+
+				if (common == len)
+					return &parent->entries;
+				return &(parent->children[Bit(addr, common)] = new Node(addr, len))->entries;
+			}
+
+			/* Nodes left empty are kept, and are reused if the range is added again */
+			if (n->len == len)
+				return &n->entries;
+
+			slot = &n->children[Bit(addr, n->len)];
+		}
+	}
+
+	/** Find the entries of every range an address is in
+	 * @param ip The address
+	 * @param entries The entries are appended to this, those of the widest range first
+	 */
+	void Find(const Anope::string &ip, std::vector<T> &entries) const
+	{
+		unsigned char addr[16];
+		int family = ParseAddr(ip, addr);
+		if (family < 0)
+			return;
+
+		unsigned max = family ? 128 : 32;
+		for (const Node *n = this->roots[family]; n && CommonPrefix(n->addr, addr, n->len) == n->len;)
+		{
+			entries.insert(entries.end(), n->entries.begin(), n->entries.end());
+			n = n->len < max ? n->children[Bit(addr, n->len)] : NULL;
+		}
+	}
+};
+
 class SocketException : public CoreException
 {
  public:
@@ -155,6 +304,14 @@ class CoreExport SocketIO
 	virtual int Send(Socket *s, const char *buf, size_t sz);
 	int Send(Socket *s, const Anope::string &buf);
 
+	/** Write multiple buffers to the socket at once
+	 * @param s The socket
+	 * @param iov The buffers to write
+	 * @param count The number of buffers
+	 * @return Number of bytes sent
+	 */
+	virtual int Send(Socket *s, const struct iovec *iov, int count);
+
 	/** Accept a connection from a socket
 	 * @param s The socket
 	 * @return The new socket
@@ -270,10 +427,19 @@ class CoreExport Socket
 class CoreExport BufferedSocket : public virtual Socket
 {
  protected:
- 	/* Things read from the socket */
- 	Anope::string read_buffer;
-	/* Things to be written to the socket */
-	Anope::string write_buffer;
+	/* Things read from the socket. Data which has not yet been consumed
+	 * is between read_start and read_end, the rest is free space.
+	 */
+	std::vector<char> read_buffer;
+	size_t read_start, read_end;
+	/* Lines to be written to the socket, each ending in \r\n */
+	std::deque<Anope::string> write_buffer;
+	/* How much of the first line has already been written */
+	size_t write_start;
+	/* How many bytes are in write_buffer, including those already written */
+	size_t write_len;
+	/* How many bytes were written on the last write event */
+	size_t last_flushed;
 	/* How much data was received from this socket on this recv() */
 	int recv_len;
 
@@ -295,6 +461,12 @@ class CoreExport BufferedSocket : public virtual Socket
 	 */
 	const Anope::string GetLine();
 
+	/** Gets the new line from the input buffer, if any
+	 * @param line Set to the line, with surrounding whitespace removed
+	 * @return true if a line was read
+	 */
+	bool GetLine(Anope::string &line);
+
 	/** Write to the socket
 	* @param message The message
 	*/
@@ -313,6 +485,16 @@ class CoreExport BufferedSocket : public virtual Socket
 	 * @return The length of the write buffer
 	 */
 	int WriteBufferLen() const;
+
+	/** Get the number of lines waiting to be written
+	 * @return The number of lines
+	 */
+	unsigned WriteQueueDepth() const;
+
+	/** Get how much was written the last time the socket was writable
+	 * @return The number of bytes
+	 */
+	size_t LastFlushed() const;
 };
 
 class CoreExport BinarySocket : public virtual Socket
@@ -38,6 +38,16 @@ class CoreExport Timer
 	 */
 	bool repeat;
 
+	/** Neighbours in the timer wheel slot this timer is linked into
+	 */
+	Timer *prev, *next;
+
+	/** Head of the timer wheel slot this timer is linked into, or NULL
+	 */
+	Timer **slot;
+
+	friend class TimerManager;
+
  public:
 	/** Constructor, initializes the triggering time
 	 * @param time_from_now The number of seconds from now to trigger the timer
@@ -102,12 +112,24 @@ class CoreExport Timer
 /** This class manages sets of Timers, and triggers them at their defined times.
  * This will ensure timers are not missed, as well as removing timers that have
  * expired and allowing the addition of new ones.
+ *
+ * Timers are kept in a hierarchical timing wheel with one second resolution, so
+ * adding and deleting a timer is O(1) regardless of how many timers exist.
  */
 class CoreExport TimerManager
 {
-	/** A list of timers
+	/** Links a timer into the wheel slot covering its trigger time
 	 */
-	static std::multimap<time_t, Timer *> Timers;
+	static void Link(Timer *t);
+
+	/** Unlinks a timer from whichever wheel slot it is in
+	 */
+	static void Unlink(Timer *t);
+
+	/** Moves the timers in the current slot of the given level down to the lower levels
+	 * @return true if the slot of the level above should be cascaded too
+	 */
+	static bool Cascade(unsigned level);
  public:
 	/** Add a timer to the list
 	 * @param t A Timer derived class to add
@@ -127,6 +149,12 @@ class CoreExport TimerManager
 	/** Deletes all timers owned by the given module
 	 */
 	static void DeleteTimersFor(Module *m);
+
+	/** Get how long the socket engine may wait before a timer is due
+	 * @param max The maximum number of seconds to wait
+	 * @return The number of milliseconds until the next timer is due, or max seconds if that is sooner
+	 */
+	static long GetTimeout(time_t max);
 };
 
 #endif // TIMERS_H
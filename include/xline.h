@@ -13,6 +13,9 @@
 #include "serialize.h"
 #include "service.h"
 
+class XLineIndex;
+class XLineExpiry;
+
 /* An Xline, eg, anything added with operserv/akill, or any of the operserv/sxline commands */
 class CoreExport XLine : public Serializable
 {
@@ -52,6 +55,10 @@ class CoreExport XLineManager : public Service
 	char type;
 	/* List of XLines in this XLineManager */
 	Serialize::Checker<std::vector<XLine *> > xlines;
+	/* Index of the XLines in this XLineManager, used to find the XLines a user may match */
+	XLineIndex *xline_index;
+	/* Queue of the XLines in this XLineManager which expire */
+	XLineExpiry *expiry;
 	/* Akills can have the same IDs, sometimes */
 	static Serialize::Checker<std::multimap<Anope::string, XLine *, ci::less> > XLinesByUID;
  public:
@@ -116,6 +123,15 @@ class CoreExport XLineManager : public Service
 	 */
 	bool DelXLine(XLine *x);
 
+	/** Update an entry in this XLineManager after its mask or expiry have been changed
+	 * @param x The entry
+	 */
+	void UpdateXLine(XLine *x);
+
+	/** Expire the entries in this XLineManager which are due to expire
+	 */
+	void Expire();
+
 	/** Gets an entry by index
 	 * @param index The index
 	 * @return The XLine, or NULL if the index is out of bounds
@@ -154,6 +170,20 @@ class CoreExport XLineManager : public Service
 	 */
 	virtual bool Check(User *u, const XLine *x) = 0;
 
+	/** Get the mask used to index an xline. Check must only match a user if one of the
+	 * user's index keys matches this mask, or is an IP within it if it is a CIDR range.
+	 * XLines without an index mask are checked against every user.
+	 * @param x The xline
+	 * @return The mask, or an empty string to not index the xline
+	 */
+	virtual Anope::string GetIndexMask(const XLine *x);
+
+	/** Get the index keys of a user, which are matched against the index masks of xlines
+	 * @param u The user
+	 * @param keys Filled in with the keys
+	 */
+	virtual void GetIndexKeys(User *u, std::vector<Anope::string> &keys);
+
 	/** Called when a user matches a xline in this XLineManager
 	 * @param u The user
 	 * @param x The XLine they match
@@ -12,6 +12,17 @@
 #include "module.h"
 #include "modules/bs_badwords.h"
 
+/* The last badword list revision given out. These are shared by all channels so a recreated
+ * list never reuses one. This starts again when the module is reloaded, so users of the
+ * revisions must forget them when the module is unloaded.
+ */
+static uint64_t last_revision = 0;
+
+static uint64_t NextRevision()
+{
+	return ++last_revision;
+}
+
 struct BadWordImpl : BadWord, Serializable
 {
 	BadWordImpl() : Serializable("BadWord") { }
@@ -32,8 +43,9 @@ struct BadWordsImpl : BadWords
 	Serialize::Reference<ChannelInfo> ci;
 	typedef std::vector<BadWordImpl *> list;
 	Serialize::Checker<list> badwords;
+	uint64_t revision;
 
-	BadWordsImpl(Extensible *obj) : ci(anope_dynamic_static_cast<ChannelInfo *>(obj)), badwords("BadWord") { }
+	BadWordsImpl(Extensible *obj) : ci(anope_dynamic_static_cast<ChannelInfo *>(obj)), badwords("BadWord"), revision(NextRevision()) { }
 
 	~BadWordsImpl();
 
@@ -45,6 +57,7 @@ struct BadWordsImpl : BadWords
 		bw->type = type;
 
 		this->badwords->push_back(bw);
+		this->revision = NextRevision();
 
 		FOREACH_MOD(OnBadWordAdd, (ci, bw));
 
@@ -56,9 +69,7 @@ struct BadWordsImpl : BadWords
 		if (this->badwords->empty() || index >= this->badwords->size())
 			return NULL;
 
-		BadWordImpl *bw = (*this->badwords)[index];
-		bw->QueueUpdate();
-		return bw;
+		return (*this->badwords)[index];
 	}
 
 	unsigned GetBadWordCount() const anope_override
@@ -87,6 +98,11 @@ struct BadWordsImpl : BadWords
 		if (this->badwords->empty())
 			ci->Shrink<BadWords>("badwords");
 	}
+
+	uint64_t GetRevision() const anope_override
+	{
+		return this->revision;
+	}
 };
 
 BadWordsImpl::~BadWordsImpl()
@@ -109,7 +125,10 @@ BadWordImpl::~BadWordImpl()
 		{
 			BadWordsImpl::list::iterator it = std::find(badwords->badwords->begin(), badwords->badwords->end(), this);
 			if (it != badwords->badwords->end())
+			{
 				badwords->badwords->erase(it);
+				badwords->revision = NextRevision();
+			}
 		}
 	}
 }
@@ -138,7 +157,9 @@ Serializable* BadWordImpl::Unserialize(Serializable *obj, Serialize::Data &data)
 	bw->type = static_cast<BadWordType>(n);
 
 	BadWordsImpl *bws = ci->Require<BadWordsImpl>("badwords");
-	bws->badwords->push_back(bw);
+	if (!obj)
+		bws->badwords->push_back(bw);
+	bws->revision = NextRevision();
 	
 	return bw;
 }
@@ -202,6 +202,7 @@ class CommandBSBot : public Command
 			bi->host = host;
 		if (!real.empty() && !real.equals_cs(bi->realname))
 			bi->realname = real;
+		bi->QueueUpdate();
 
 		if (!user.empty())
 		{
@@ -33,6 +33,8 @@ struct KickerDataImpl : KickerData
 
 	void Check(ChannelInfo *ci) anope_override
 	{
+		ci->QueueUpdate();
+
 		if (amsgs || badwords || bolds || caps || colors || flood || italics || repeat || reverses || underlines)
 			return;
 		
@@ -973,6 +975,195 @@ struct UserData
 	Anope::string lastline;
 };
 
+/* All of a channel's badwords compiled into one Aho-Corasick automaton,
+ * so a message can be checked against every badword in a single pass.
+ */
+struct BadWordMatcher
+{
+ private:
+	struct Pattern
+	{
+		Anope::string word;
+		BadWordType type;
+		size_t len;
+	};
+
+	struct Node
+	{
+		/* transitions out of this node, sorted by character */
+		std::vector<std::pair<unsigned char, unsigned> > edges;
+		/* longest proper suffix of this node that is also in the trie */
+		unsigned fail;
+		/* nearest node along the fail chain that ends a pattern, or 0 */
+		unsigned output;
+		/* patterns ending at this node, by index */
+		std::vector<unsigned> patterns;
+
+		Node() : fail(0), output(0) { }
+
+		unsigned Find(unsigned char c) const
+		{
+			size_t lo = 0, hi = edges.size();
+			while (lo < hi)
+			{
+				size_t mid = (lo + hi) / 2;
+				if (edges[mid].first < c)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			return lo < edges.size() && edges[lo].first == c ? edges[lo].second : 0;
+		}
+	};
+
+	std::vector<Pattern> patterns;
+	std::vector<Node> nodes;
+	bool casesensitive;
+
+	/* revision of the badword list this automaton was built from */
+	uint64_t revision;
+
+	unsigned char Fold(char c) const
+	{
+		return casesensitive ? static_cast<unsigned char>(c) : Anope::toupper(c);
+	}
+
+	unsigned Next(unsigned state, unsigned char c) const
+	{
+		for (;;)
+		{
+			unsigned n = nodes[state].Find(c);
+			if (n || !state)
+				return n;
+			state = nodes[state].fail;
+		}
+	}
+
+	void Build(const BadWords *bw)
+	{
+		patterns.clear();
+		nodes.clear();
+		nodes.push_back(Node());
+
+		for (unsigned i = 0, count = bw->GetBadWordCount(); i < count; ++i)
+		{
+			const BadWord *b = bw->GetBadWord(i);
+
+			Pattern p;
+			p.word = b->word;
+			p.type = b->type;
+			p.len = b->word.length();
+			patterns.push_back(p);
+
+			if (!p.len)
+				continue;
+
+			unsigned state = 0;
+			for (size_t j = 0; j < p.len; ++j)
+			{
+				unsigned char c = Fold(p.word[j]);
+				unsigned n = nodes[state].Find(c);
+				if (!n)
+				{
+					n = nodes.size();
+					nodes.push_back(Node());
+
+					std::vector<std::pair<unsigned char, unsigned> > &edges = nodes[state].edges;
+					std::vector<std::pair<unsigned char, unsigned> >::iterator it = edges.begin();
+					while (it != edges.end() && it->first < c)
+						++it;
+					edges.insert(it, std::make_pair(c, n));
+				}
+				state = n;
+			}
+			nodes[state].patterns.push_back(i);
+		}
+
+		/* Breadth first, so every node's fail target is complete before its children need it */
+		std::deque<unsigned> queue;
+		for (unsigned i = 0; i < nodes[0].edges.size(); ++i)
+			queue.push_back(nodes[0].edges[i].second);
+
+		while (!queue.empty())
+		{
+			unsigned state = queue.front();
+			queue.pop_front();
+
+			for (unsigned i = 0; i < nodes[state].edges.size(); ++i)
+			{
+				unsigned char c = nodes[state].edges[i].first;
+				unsigned child = nodes[state].edges[i].second;
+
+				unsigned fail = Next(nodes[state].fail, c);
+				nodes[child].fail = fail;
+				nodes[child].output = !nodes[fail].patterns.empty() ? fail : nodes[fail].output;
+
+				queue.push_back(child);
+			}
+		}
+	}
+
+	bool Matches(const Pattern &p, const Anope::string &buf, size_t end) const
+	{
+		size_t start = end - p.len;
+
+		switch (p.type)
+		{
+			case BW_ANY:
+				return true;
+			case BW_SINGLE:
+				return (!start || buf[start - 1] == ' ') && (end == buf.length() || buf[end] == ' ');
+			case BW_START:
+				return !start || buf[start - 1] == ' ';
+			case BW_END:
+				return end == buf.length() || buf[end] == ' ';
+		}
+
+		return false;
+	}
+
+ public:
+	BadWordMatcher(Extensible *) : casesensitive(false), revision(0) { }
+
+	/** Rebuild the automaton if the badwords or case sensitivity changed since it was last built
+	 * @param bw The channel's badwords
+	 * @param cs Whether badwords are case sensitive
+	 */
+	void Update(const BadWords *bw, bool cs)
+	{
+		if (this->revision == bw->GetRevision() && this->casesensitive == cs)
+			return;
+
+		this->revision = bw->GetRevision();
+		this->casesensitive = cs;
+		this->Build(bw);
+	}
+
+	/** Find the first badword, in list order, contained in a normalized message
+	 * @param buf The message
+	 * @return The badword, or NULL if none match
+	 */
+	const Anope::string *Match(const Anope::string &buf) const
+	{
+		unsigned best = patterns.size();
+
+		for (size_t i = 0, state = 0; i < buf.length() && best; ++i)
+		{
+			state = Next(state, Fold(buf[i]));
+
+			for (unsigned n = nodes[state].patterns.empty() ? nodes[state].output : state; n; n = nodes[n].output)
+				for (unsigned j = 0; j < nodes[n].patterns.size(); ++j)
+				{
+					unsigned p = nodes[n].patterns[j];
+					if (p < best && Matches(patterns[p], buf, i + 1))
+						best = p;
+				}
+		}
+
+		return best < patterns.size() ? &patterns[best].word : NULL;
+	}
+};
+
 class BanDataPurger : public Timer
 {
  public:
@@ -1002,6 +1193,7 @@ class BSKick : public Module
 	ExtensibleItem<BanData> bandata;
 	ExtensibleItem<UserData> userdata;
 	KickerDataImpl::ExtensibleItem kickerdata;
+	ExtensibleItem<BadWordMatcher> badwordmatcher;
 
 	CommandBSKick commandbskick;
 	CommandBSKickAMSG commandbskickamsg;
@@ -1081,6 +1273,7 @@ class BSKick : public Module
 		bandata(this, "bandata"),
 		userdata(this, "userdata"),
 		kickerdata(this, "kickerdata"),
+		badwordmatcher(this, "badwordmatcher"),
 
 		commandbskick(this),
 		commandbskickamsg(this), commandbskickbadwords(this), commandbskickbolds(this), commandbskickcaps(this),
@@ -1095,6 +1288,16 @@ class BSKick : public Module
 
 	}
 
+	void OnModuleUnload(User *, Module *m) anope_override
+	{
+		/* Badword revisions start again when bs_badwords is loaded again, so they can not be compared with ours */
+		if (m->name != "bs_badwords")
+			return;
+
+		for (registered_channel_map::const_iterator it = RegisteredChannelList->begin(), it_end = RegisteredChannelList->end(); it != it_end; ++it)
+			badwordmatcher.Unset(it->second);
+	}
+
 	void OnBotInfo(CommandSource &source, BotInfo *bi, ChannelInfo *ci, InfoFormatter &info) anope_override
 	{
 		if (!ci)
@@ -1317,80 +1520,26 @@ class BSKick : public Module
 		/* Bad words kicker */
 		if (kd->badwords)
 		{
-			bool mustkick = false;
 			BadWords *badwords = ci->GetExt<BadWords>("badwords");
 
-			/* Normalize the buffer */
-			Anope::string nbuf = Anope::NormalizeBuffer(realbuf);
-			bool casesensitive = Config->GetModule("botserv")->Get<bool>("casesensitive");
-
-			for (unsigned i = 0; badwords && i < badwords->GetBadWordCount(); ++i)
+			if (badwords && badwords->GetBadWordCount())
 			{
-				const BadWord *bw = badwords->GetBadWord(i);
+				BadWordMatcher *matcher = badwordmatcher.Require(ci);
+				matcher->Update(badwords, Config->GetModule("botserv")->Get<bool>("casesensitive"));
 
-				if (bw->type == BW_ANY && ((casesensitive && nbuf.find(bw->word) != Anope::string::npos) || (!casesensitive && nbuf.find_ci(bw->word) != Anope::string::npos)))
-					mustkick = true;
-				else if (bw->type == BW_SINGLE)
-				{
-					size_t len = bw->word.length();
-
-					if ((casesensitive && bw->word.equals_cs(nbuf)) || (!casesensitive && bw->word.equals_ci(nbuf)))
-						mustkick = true;
-					else if (nbuf.find(' ') == len && ((casesensitive && bw->word.equals_cs(nbuf)) || (!casesensitive && bw->word.equals_ci(nbuf))))
-						mustkick = true;
-					else
-					{
-						if (nbuf.rfind(' ') == nbuf.length() - len - 1 && ((casesensitive && nbuf.find(bw->word) == nbuf.length() - len) || (!casesensitive && nbuf.find_ci(bw->word) == nbuf.length() - len)))
-							mustkick = true;
-						else
-						{
-							Anope::string wordbuf = " " + bw->word + " ";
-
-							if ((casesensitive && nbuf.find(wordbuf) != Anope::string::npos) || (!casesensitive && nbuf.find_ci(wordbuf) != Anope::string::npos))
-								mustkick = true;
-						}
-					}
-				}
-				else if (bw->type == BW_START)
-				{
-					size_t len = bw->word.length();
-
-					if ((casesensitive && nbuf.substr(0, len).equals_cs(bw->word)) || (!casesensitive && nbuf.substr(0, len).equals_ci(bw->word)))
-						mustkick = true;
-					else
-					{
-						Anope::string wordbuf = " " + bw->word;
-
-						if ((casesensitive && nbuf.find(wordbuf) != Anope::string::npos) || (!casesensitive && nbuf.find_ci(wordbuf) != Anope::string::npos))
-							mustkick = true;
-					}
-				}
-				else if (bw->type == BW_END)
-				{
-					size_t len = bw->word.length();
-
-					if ((casesensitive && nbuf.substr(nbuf.length() - len).equals_cs(bw->word)) || (!casesensitive && nbuf.substr(nbuf.length() - len).equals_ci(bw->word)))
-						mustkick = true;
-					else
-					{
-						Anope::string wordbuf = bw->word + " ";
-
-						if ((casesensitive && nbuf.find(wordbuf) != Anope::string::npos) || (!casesensitive && nbuf.find_ci(wordbuf) != Anope::string::npos))
-							mustkick = true;
-					}
-				}
-
-				if (mustkick)
+				/* Normalize the buffer */
+				const Anope::string *word = matcher->Match(Anope::NormalizeBuffer(realbuf));
+				if (word)
 				{
 					check_ban(ci, u, kd, TTB_BADWORDS);
 					if (Config->GetModule(me)->Get<bool>("gentlebadwordreason"))
 						bot_kick(ci, u, _("Watch your language!"));
 					else
-						bot_kick(ci, u, _("Don't use the word \"%s\" on this channel!"), bw->word.c_str());
+						bot_kick(ci, u, _("Don't use the word \"%s\" on this channel!"), word->c_str());
 
 					return;
 				}
-			} /* for */
+			}
 		} /* if badwords */
 
 		UserData *ud = GetUserData(u, c);
@@ -542,6 +542,7 @@ class CSAKick : public Module
 			{
 				Log(LOG_DEBUG_2) << u->nick << " matched akick " << (autokick->nc ? autokick->nc->display : autokick->mask);
 				autokick->last_used = Anope::CurTime;
+				autokick->QueueUpdate();
 				if (!autokick->nc && autokick->mask.find('#') == Anope::string::npos)
 					mask = autokick->mask;
 				reason = autokick->reason;
@@ -22,6 +22,15 @@ struct SeenInfo;
 static SeenInfo *FindInfo(const Anope::string &nick);
 typedef Anope::hash_map<SeenInfo *> database_map;
 database_map database;
+static ServiceReference<ExpiryQueue> seenexpiry("ExpiryQueue", "cs_seen/expire");
+
+static time_t GetPurgeTime()
+{
+	time_t purgetime = Config->GetModule("cs_seen")->Get<time_t>("purgetime");
+	if (!purgetime)
+		purgetime = Anope::DoTime("30d");
+	return purgetime;
+}
 
 struct SeenInfo : Serializable
 {
@@ -84,6 +93,8 @@ struct SeenInfo : Serializable
 
 		if (!obj)
 			database[s->nick] = s;
+		if (seenexpiry)
+			seenexpiry->Schedule(s, s->last + GetPurgeTime());
 		return s;
 	}
 };
@@ -110,6 +121,30 @@ static bool ShouldHide(const Anope::string &channel, User *u)
 	return false;
 }
 
+/** Purges seen entries when they are old enough
+ */
+class SeenExpiry : public ExpiryQueue
+{
+ public:
+	SeenExpiry(Module *creator) : ExpiryQueue(creator, "cs_seen/expire") { }
+
+	bool Check(Serializable *obj) anope_override
+	{
+		SeenInfo *info = anope_dynamic_static_cast<SeenInfo *>(obj);
+		time_t purgetime = GetPurgeTime();
+
+		if ((Anope::CurTime - info->last) > purgetime)
+		{
+			Log(LOG_DEBUG) << info->nick << " was last seen " << Anope::strftime(info->last) << ", purging entries";
+			delete info;
+			return true;
+		}
+
+		this->Schedule(info, info->last + purgetime);
+		return false;
+	}
+};
+
 class CommandOSSeen : public Command
 {
  public:
@@ -371,34 +406,35 @@ class CSSeen : public Module
 	Serialize::Type seeninfo_type;
 	CommandSeen commandseen;
 	CommandOSSeen commandosseen;
+	SeenExpiry expiry;
+	time_t purgetime;
  public:
-	CSSeen(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR), seeninfo_type("SeenInfo", SeenInfo::Unserialize), commandseen(this), commandosseen(this)
+	CSSeen(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR), seeninfo_type("SeenInfo", SeenInfo::Unserialize), commandseen(this), commandosseen(this), expiry(this), purgetime(0)
 	{
 	}
 
 	void OnReload(Configuration::Conf *conf) anope_override
 	{
 		simple = conf->GetModule(this)->Get<bool>("simple");
+
+		/* Entries may need purging sooner than they are scheduled for now, so check all of them */
+		time_t newpurgetime = conf->GetModule(this)->Get<time_t>("purgetime");
+		if (!newpurgetime)
+			newpurgetime = Anope::DoTime("30d");
+		if (newpurgetime != this->purgetime)
+		{
+			for (database_map::iterator it = database.begin(), it_end = database.end(); it != it_end; ++it)
+				this->expiry.Schedule(it->second, Anope::CurTime);
+			this->purgetime = newpurgetime;
+		}
 	}
 
 	void OnExpireTick() anope_override
 	{
-		size_t previous_size = database.size();
-		time_t purgetime = Config->GetModule(this)->Get<time_t>("purgetime");
-		if (!purgetime)
-			purgetime = Anope::DoTime("30d");
-		for (database_map::iterator it = database.begin(), it_end = database.end(); it != it_end;)
-		{
-			database_map::iterator cur = it;
-			++it;
+		this->expiry.Process();
 
-			if ((Anope::CurTime - cur->second->last) > purgetime)
-			{
-				Log(LOG_DEBUG) << cur->first << " was last seen " << Anope::strftime(cur->second->last) << ", purging entries";
-				delete cur->second;
-			}
-		}
-		Log(LOG_DEBUG) << "cs_seen: Purged database, checked " << previous_size << " nicks and removed " << (previous_size - database.size()) << " old entries.";
+		const ExpiryQueue::Stats &stats = this->expiry.GetStats();
+		Log(LOG_DEBUG) << "cs_seen: Purged database, checked " << stats.checked << " nicks and removed " << stats.expired << " old entries.";
 	}
 
 	void OnUserConnect(User *u, bool &exempt) anope_override
@@ -441,7 +477,10 @@ class CSSeen : public Module
 
 		SeenInfo* &info = database[nick];
 		if (!info)
+		{
 			info = new SeenInfo();
+			this->expiry.Schedule(info, Anope::CurTime + GetPurgeTime());
+		}
 		info->nick = nick;
 		info->vhost = u->GetVIdent() + "@" + u->GetDisplayedHost();
 		info->type = Type;
@@ -449,6 +488,7 @@ class CSSeen : public Module
 		info->nick2 = nick2;
 		info->channel = channel;
 		info->message = message;
+		info->QueueUpdate();
 	}
 };
 
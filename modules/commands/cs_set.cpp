@@ -12,6 +12,8 @@
 #include "module.h"
 #include "modules/cs_mode.h"
 
+static ServiceReference<ExpiryQueue> chanexpiry("ExpiryQueue", "chanserv/expire");
+
 class CommandCSSet : public Command
 {
  public:
@@ -168,6 +170,7 @@ class CommandCSSetBanType : public Command
 				throw ConvertException("Invalid range");
 			Log(source.AccessFor(ci).HasPriv("SET") ? LOG_COMMAND : LOG_OVERRIDE, source, this, ci) << "to change the ban type to " << new_type;
 			ci->bantype = new_type;
+			ci->QueueUpdate();
 			source.Reply(_("Ban type for channel %s is now #%d."), ci->name.c_str(), ci->bantype);
 		}
 		catch (const ConvertException &)
@@ -232,12 +235,14 @@ class CommandCSSetDescription : public Command
 		if (!param.empty())
 		{
 			ci->desc = param;
+			ci->QueueUpdate();
 			Log(source.AccessFor(ci).HasPriv("SET") ? LOG_COMMAND : LOG_OVERRIDE, source, this, ci) << "to change the description to " << ci->desc;
 			source.Reply(_("Description of %s changed to \002%s\002."), ci->name.c_str(), ci->desc.c_str());
 		}
 		else
 		{
 			ci->desc.clear();
+			ci->QueueUpdate();
 			Log(source.AccessFor(ci).HasPriv("SET") ? LOG_COMMAND : LOG_OVERRIDE, source, this, ci) << "to unset the description";
 			source.Reply(_("Description of %s unset."), ci->name.c_str());
 		}
@@ -366,6 +371,7 @@ class CommandCSSetKeepModes : public Command
 			source.Reply(_("Keep modes for %s is now \002on\002."), ci->name.c_str());
 			if (ci->c)
 				ci->last_modes = ci->c->GetModes();
+			ci->QueueUpdate();
 		}
 		else if (params[1].equals_ci("OFF"))
 		{
@@ -373,6 +379,7 @@ class CommandCSSetKeepModes : public Command
 			ci->Shrink<bool>("CS_KEEP_MODES");
 			source.Reply(_("Keep modes for %s is now \002off\002."), ci->name.c_str());
 			ci->last_modes.clear();
+			ci->QueueUpdate();
 		}
 		else
 			this->OnSyntaxError(source, "KEEPMODES");
@@ -1079,6 +1086,8 @@ class CommandCSSetNoexpire : public Command
 		{
 			Log(LOG_ADMIN, source, this, ci) << "to disable noexpire";
 			ci->Shrink<bool>("CS_NO_EXPIRE");
+			if (chanexpiry)
+				chanexpiry->Schedule(ci, Anope::CurTime);
 			source.Reply(_("Channel %s \002will\002 expire."), ci->name.c_str());
 		}
 		else
@@ -1198,6 +1207,14 @@ class CSSet : public Module
 	CommandCSSetSuccessor commandcssetsuccessor;
 	CommandCSSetNoexpire commandcssetnoexpire;
 
+	void UpdateLastModes(Channel *c)
+	{
+		c->ci->last_modes = c->GetModes();
+		/* They are only saved with keep modes on */
+		if (keep_modes.HasExt(c->ci))
+			c->ci->QueueUpdate();
+	}
+
  public:
 	CSSet(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR),
 		noautoop(this, "NOAUTOOP"), peace(this, "PEACE"),
@@ -1261,7 +1278,7 @@ class CSSet : public Module
 				persist.Set(c->ci, true);
 
 			if (mode->type != MODE_STATUS && !c->syncing && Me->IsSynced())
-				c->ci->last_modes = c->GetModes();
+				this->UpdateLastModes(c);
 		}
 
 		return EVENT_CONTINUE;
@@ -1282,7 +1299,7 @@ class CSSet : public Module
 		}
 
 		if (c->ci && mode->type != MODE_STATUS && !c->syncing && Me->IsSynced())
-			c->ci->last_modes = c->GetModes();
+			this->UpdateLastModes(c);
 
 		return EVENT_CONTINUE;
 	}
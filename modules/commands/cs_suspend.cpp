@@ -12,6 +12,8 @@
 #include "module.h"
 #include "modules/cs_suspend.h"
 
+static ServiceReference<ExpiryQueue> chanexpiry("ExpiryQueue", "chanserv/expire");
+
 struct CSSuspendInfoImpl : CSSuspendInfo, Serializable
 {
 	CSSuspendInfoImpl(Extensible *) : Serializable("CSSuspendInfo") { }
@@ -238,11 +240,21 @@ class CSSuspend : public Module
 
 		if (si->expires < Anope::CurTime)
 		{
-			ci->last_used = Anope::CurTime;
+			ci->UpdateLastUsed();
 			suspend.Unset(ci);
 
 			Log(this) << "Expiring suspend for " << ci->name;
 		}
+		else if (chanexpiry)
+			chanexpiry->Schedule(ci, si->expires);
+	}
+
+	void OnChanSuspend(ChannelInfo *ci) anope_override
+	{
+		/* Check the channel when the suspension expires */
+		CSSuspendInfo *si = suspend.Get(ci);
+		if (si && si->expires && chanexpiry)
+			chanexpiry->Schedule(ci, si->expires);
 	}
 
 	EventReturn OnCheckKick(User *u, Channel *c, Anope::string &mask, Anope::string &reason) anope_override
@@ -242,6 +242,7 @@ class CSTopic : public Module
 			c->ci->last_topic = c->topic;
 			c->ci->last_topic_setter = c->topic_setter;
 			c->ci->last_topic_time = c->topic_ts;
+			c->ci->QueueUpdate();
 		}
 	}
 
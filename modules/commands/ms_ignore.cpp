@@ -13,6 +13,23 @@
 
 class CommandMSIgnore : public Command
 {
+	/* The ignore list is saved with the channel or account owning it */
+	void Changed(const Anope::string &target, bool ischan)
+	{
+		if (ischan)
+		{
+			ChannelInfo *ci = ChannelInfo::Find(target);
+			if (ci)
+				ci->QueueUpdate();
+		}
+		else
+		{
+			NickAlias *na = NickAlias::Find(target);
+			if (na)
+				na->nc->QueueUpdate();
+		}
+	}
+
  public:
 	CommandMSIgnore(Module *creator) : Command(creator, "memoserv/ignore", 1, 3)
 	{
@@ -53,6 +70,7 @@ class CommandMSIgnore : public Command
 			if (std::find(mi->ignores.begin(), mi->ignores.end(), param.ci_str()) == mi->ignores.end())
 			{
 				mi->ignores.push_back(param.ci_str());
+				this->Changed(channel, ischan);
 				source.Reply(_("\002%s\002 added to ignore list."), param.c_str());
 			}
 			else
@@ -65,6 +83,7 @@ class CommandMSIgnore : public Command
 			if (it != mi->ignores.end())
 			{
 				mi->ignores.erase(it);
+				this->Changed(channel, ischan);
 				source.Reply(_("\002%s\002 removed from the ignore list."), param.c_str());
 			}
 			else
@@ -45,6 +45,7 @@ static void rsend_notify(CommandSource &source, MemoInfo *mi, Memo *m, const Ano
 
 	/* Remove receipt flag from the original memo */
 	m->receipt = false;
+	m->QueueUpdate();
 }
 
 class MemoListCallback : public NumberList
@@ -88,6 +89,7 @@ class MemoListCallback : public NumberList
 
 		source.Reply("%s", m->text.c_str());
 		m->unread = false;
+		m->QueueUpdate();
 
 		/* Check if a receipt notification was requested */
 		if (m->receipt)
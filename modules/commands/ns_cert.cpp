@@ -29,6 +29,7 @@ struct NSCertListImpl : NSCertList
 	void AddCert(const Anope::string &entry) anope_override
 	{
 		this->certs.push_back(entry);
+		this->nc->QueueUpdate();
 		FOREACH_MOD(OnNickAddCert, (this->nc, entry));
 	}
 
@@ -76,6 +77,7 @@ struct NSCertListImpl : NSCertList
 		{
 			FOREACH_MOD(OnNickEraseCert, (this->nc, entry));
 			this->certs.erase(it);
+			this->nc->QueueUpdate();
 		}
 	}
 
@@ -87,6 +89,7 @@ struct NSCertListImpl : NSCertList
 	{
 		FOREACH_MOD(OnNickClearCert, (this->nc));
 		this->certs.clear();
+		this->nc->QueueUpdate();
 	}
 
 	void Check() anope_override
@@ -343,11 +343,12 @@ class NSRegister : public Module
 
 	SerializableExtensibleItem<bool> unconfirmed;
 	SerializableExtensibleItem<Anope::string> passcode;
+	ServiceReference<ExpiryQueue> nickexpiry;
 
  public:
 	NSRegister(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR),
 		commandnsregister(this), commandnsconfirm(this), commandnsrsend(this), unconfirmed(this, "UNCONFIRMED"),
-		passcode(this, "passcode")
+		passcode(this, "passcode"), nickexpiry("ExpiryQueue", "nickserv/expire")
 	{
 		if (Config->GetModule(this)->Get<const Anope::string>("registration").equals_ci("disable"))
 			throw ModuleException("Module " + this->name + " will not load with registration disabled.");
@@ -378,6 +379,8 @@ class NSRegister : public Module
 			time_t unconfirmed_expire = Config->GetModule(this)->Get<time_t>("unconfirmedexpire", "1d");
 			if (unconfirmed_expire && Anope::CurTime - na->time_registered >= unconfirmed_expire)
 				expire = true;
+			else if (unconfirmed_expire && nickexpiry)
+				nickexpiry->Schedule(na, na->time_registered + unconfirmed_expire);
 		}
 	}
 };
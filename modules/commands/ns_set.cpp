@@ -11,6 +11,8 @@
 
 #include "module.h"
 
+static ServiceReference<ExpiryQueue> nickexpiry("ExpiryQueue", "nickserv/expire");
+
 class CommandNSSet : public Command
 {
  public:
@@ -142,6 +144,7 @@ class CommandNSSetPassword : public Command
 		Log(LOG_COMMAND, source, this) << "to change their password";
 
 		Anope::Encrypt(param, source.nc->pass);
+		source.nc->QueueUpdate();
 		Anope::string tmp_pass;
 		if (Anope::Decrypt(source.nc->pass, tmp_pass) == 1)
 			source.Reply(_("Password for \002%s\002 changed to \002%s\002."), source.nc->display.c_str(), tmp_pass.c_str());
@@ -205,6 +208,7 @@ class CommandNSSASetPassword : public Command
 		Log(LOG_ADMIN, source, this) << "to change the password of " << nc->display;
 
 		Anope::Encrypt(params[1], nc->pass);
+		nc->QueueUpdate();
 		Anope::string tmp_pass;
 		if (Anope::Decrypt(nc->pass, tmp_pass) == 1)
 			source.Reply(_("Password for \002%s\002 changed to \002%s\002."), nc->display.c_str(), tmp_pass.c_str());
@@ -481,12 +485,14 @@ class CommandNSSetEmail : public Command
 			{
 				Log(nc == source.GetAccount() ? LOG_COMMAND : LOG_ADMIN, source, this) << "to change the email of " << nc->display << " to " << param;
 				nc->email = param;
+				nc->QueueUpdate();
 				source.Reply(_("E-mail address for \002%s\002 changed to \002%s\002."), nc->display.c_str(), param.c_str());
 			}
 			else
 			{
 				Log(nc == source.GetAccount() ? LOG_COMMAND : LOG_ADMIN, source, this) << "to unset the email of " << nc->display;
 				nc->email.clear();
+				nc->QueueUpdate();
 				source.Reply(_("E-mail address for \002%s\002 unset."), nc->display.c_str());
 			}
 		}
@@ -801,6 +807,7 @@ class CommandNSSetLanguage : public Command
 		Log(nc == source.GetAccount() ? LOG_COMMAND : LOG_ADMIN, source, this) << "to change the language of " << nc->display << " to " << param;
 
 		nc->language = param;
+		nc->QueueUpdate();
 		source.Reply(_("Language changed to \002English\002."));
 	}
 
@@ -1100,6 +1107,8 @@ class CommandNSSASetNoexpire : public Command
 		{
 			Log(LOG_ADMIN, source, this) << "to disable noexpire for " << na->nc->display;
 			na->Shrink<bool>("NS_NO_EXPIRE");
+			if (nickexpiry)
+				nickexpiry->Schedule(na, Anope::CurTime);
 			source.Reply(_("Nick %s \002will\002 expire."), na->nick.c_str());
 		}
 		else
@@ -1201,6 +1210,15 @@ class NSSet : public Module
 	/* email, passcode */
 	PrimitiveExtensibleItem<std::pair<Anope::string, Anope::string > > ns_set_email;
 
+	void UpdateLastModes(User *u)
+	{
+		NickCore *nc = u->Account();
+		nc->last_modes = u->GetModeList();
+		/* They are only saved with keep modes on */
+		if (keep_modes.HasExt(nc))
+			nc->QueueUpdate();
+	}
+
  public:
 	NSSet(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR),
 		commandnsset(this), commandnssaset(this),
@@ -1237,6 +1255,7 @@ class NSSet : public Module
 				if (params[0] == n->second)
 				{
 					uac->email = n->first;
+					uac->QueueUpdate();
 					Log(LOG_COMMAND, source, command) << "to confirm their email address change to " << uac->email;
 					source.Reply(_("Your email address has been changed to \002%s\002."), uac->email.c_str());
 					ns_set_email.Unset(uac);
@@ -1289,13 +1308,13 @@ class NSSet : public Module
 	void OnUserModeSet(const MessageSource &setter, User *u, const Anope::string &mname) anope_override
 	{
 		if (u->Account() && setter.GetUser() == u)
-			u->Account()->last_modes = u->GetModeList();
+			this->UpdateLastModes(u);
 	}
 
 	void OnUserModeUnset(const MessageSource &setter, User *u, const Anope::string &mname) anope_override
 	{
 		if (u->Account() && setter.GetUser() == u)
-			u->Account()->last_modes = u->GetModeList();
+			this->UpdateLastModes(u);
 	}
 
 	void OnUserLogin(User *u) anope_override
@@ -13,6 +13,7 @@
 #include "modules/ns_suspend.h"
 
 static ServiceReference<NickServService> nickserv("NickServService", "NickServ");
+static ServiceReference<ExpiryQueue> nickexpiry("ExpiryQueue", "nickserv/expire");
 
 struct NSSuspendInfoImpl : NSSuspendInfo, Serializable
 {
@@ -123,6 +124,7 @@ class CommandNSSuspend : public Command
 			if (na2 && *na2->nc == *na->nc)
 			{
 				na2->last_quit = reason;
+				na2->QueueUpdate();
 
 				User *u2 = User::Find(na2->nick, true);
 				if (u2)
@@ -243,10 +245,24 @@ class NSSuspend : public Module
 		if (s->expires < Anope::CurTime)
 		{
 			na->last_seen = Anope::CurTime;
+			na->QueueUpdate();
 			suspend.Unset(na->nc);
 
 			Log(LOG_NORMAL, "nickserv/expire", Config->GetClient("NickServ")) << "Expiring suspend for " << na->nick;
 		}
+		else if (nickexpiry)
+			nickexpiry->Schedule(na, s->expires);
+	}
+
+	void OnNickSuspend(NickAlias *na) anope_override
+	{
+		/* Check the nicks when the suspension expires */
+		NSSuspendInfo *s = suspend.Get(na->nc);
+		if (!s || !s->expires || !nickexpiry)
+			return;
+
+		for (unsigned i = 0; i < na->nc->aliases->size(); ++i)
+			nickexpiry->Schedule(na->nc->aliases->at(i), s->expires);
 	}
 
 	EventReturn OnNickValidate(User *u, NickAlias *na) anope_override
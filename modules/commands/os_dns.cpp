@@ -75,11 +75,7 @@ struct DNSZone : Serializable
 	{
 		for (unsigned i = 0; i < zones->size(); ++i)
 			if (zones->at(i)->name.equals_ci(name))
-			{
-				DNSZone *z = zones->at(i);
-				z->QueueUpdate();
-				return z;
-			}
+				return zones->at(i);
 		return NULL;
 	}
 };
@@ -113,7 +109,7 @@ class DNSServer : public Serializable
 	const Anope::string &GetName() const { return server_name; }
 	std::vector<Anope::string> &GetIPs() { return ips; }
 	unsigned GetLimit() const { return limit; }
-	void SetLimit(unsigned l) { limit = l; }
+	void SetLimit(unsigned l) { limit = l; this->QueueUpdate(); }
 
 	bool Pooled() const { return pooled; }
 	void Pool(bool p)
@@ -121,6 +117,7 @@ class DNSServer : public Serializable
 		if (!p)
 			this->SetActive(p);
 		pooled = p;
+		this->QueueUpdate();
 	}
 
 	bool Active() const { return pooled && active; }
@@ -165,6 +162,7 @@ class DNSServer : public Serializable
 		else
 			req = new DNSServer(server_name);
 
+		req->ips.clear();
 		for (unsigned i = 0; true; ++i)
 		{
 			Anope::string ip_str;
@@ -194,11 +192,7 @@ class DNSServer : public Serializable
 	{
 		for (unsigned i = 0; i < dns_servers->size(); ++i)
 			if (dns_servers->at(i)->GetName().equals_ci(s))
-			{
-				DNSServer *serv = dns_servers->at(i);
-				serv->QueueUpdate();
-				return serv;
-			}
+				return dns_servers->at(i);
 		return NULL;
 	}
 };
@@ -319,7 +313,10 @@ class CommandOSDNS : public Command
 		{
 			DNSServer *s = DNSServer::Find(*it);
 			if (s)
+			{
 				s->zones.erase(z->name);
+				s->QueueUpdate();
+			}
 		}
 
 		source.Reply(_("Zone %s removed."), z->name.c_str());
@@ -356,6 +353,8 @@ class CommandOSDNS : public Command
 
 				z->servers.insert(s->GetName());
 				s->zones.insert(zone);
+				z->QueueUpdate();
+				s->QueueUpdate();
 
 				Log(LOG_ADMIN, source, this) << "to add server " << s->GetName() << " to zone " << z->name;
 
@@ -398,6 +397,7 @@ class CommandOSDNS : public Command
 
 			z->servers.insert(s->GetName());
 			s->zones.insert(z->name);
+			z->QueueUpdate();
 		}
 	}
 
@@ -431,6 +431,7 @@ class CommandOSDNS : public Command
 			Log(LOG_ADMIN, source, this) << "to remove server " << s->GetName() << " from zone " << z->name;
 
 			z->servers.erase(s->GetName());
+			z->QueueUpdate();
 			source.Reply(_("Removed server %s from zone %s."), s->GetName().c_str(), z->name.c_str());
 			return;
 		}
@@ -444,7 +445,10 @@ class CommandOSDNS : public Command
 		{
 			DNSZone *z = DNSZone::Find(*it);
 			if (z)
+			{
 				z->servers.erase(s->GetName());
+				z->QueueUpdate();
+			}
 		}
 
 		if (Anope::ReadOnly)
@@ -483,6 +487,7 @@ class CommandOSDNS : public Command
 			source.Reply(READ_ONLY_MODE);
 
 		s->GetIPs().push_back(params[2]);
+		s->QueueUpdate();
 		source.Reply(_("Added IP %s to %s."), params[2].c_str(), s->GetName().c_str());
 		Log(LOG_ADMIN, source, this) << "to add IP " << params[2] << " to " << s->GetName();
 
@@ -511,6 +516,7 @@ class CommandOSDNS : public Command
 			if (params[2].equals_ci(s->GetIPs()[i]))
 			{
 				s->GetIPs().erase(s->GetIPs().begin() + i);
+				s->QueueUpdate();
 				source.Reply(_("Removed IP %s from %s."), params[2].c_str(), s->GetName().c_str());
 				Log(LOG_ADMIN, source, this) << "to remove IP " << params[2] << " from " << s->GetName();
 
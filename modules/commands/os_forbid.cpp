@@ -169,6 +169,8 @@ class CommandOSForbid : public Command
 			d->type = ftype;
 			if (created)
 				this->fs->AddForbid(d);
+			else
+				d->QueueUpdate();
 
 			if (Anope::ReadOnly)
 				source.Reply(READ_ONLY_MODE);
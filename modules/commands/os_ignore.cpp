@@ -27,6 +27,7 @@ class OSIgnoreService : public IgnoreService
 				ign->time = 0;
 			else
 				ign->time = Anope::CurTime + delta;
+			ign->QueueUpdate();
 			return ign;
 		}
 		/* Create new entry.. */
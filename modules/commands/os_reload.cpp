@@ -28,6 +28,7 @@ class CommandOSReload : public Command
 			Configuration::Conf *new_config = new Configuration::Conf();
 			delete Config;
 			Config = new_config;
+			Anope::SetRegexEngine(Config->GetBlock("options")->Get<const Anope::string>("regexengine"));
 			source.Reply(_("Services' configuration has been reloaded."));
 		}
 		catch (const ConfigException &ex)
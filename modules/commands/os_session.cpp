@@ -35,12 +35,151 @@ namespace
 	unsigned ipv6_cidr;
 }
 
+/** An index of the session exceptions, so finding the exception for a user does not
+ * have to check every exception. IP and CIDR masks are kept in a binary radix tree per
+ * address family, host names without wildcards in a hash map, and only the masks with
+ * wildcards are matched one by one. Each entry remembers the position of its exception
+ * in the exception list, as the first matching exception in the list is the one used.
+ */
+class ExceptionIndex
+{
+	typedef std::pair<unsigned, Exception *> Entry;
+
+	/* IP and CIDR masks */
+	CIDRTree<Entry> ranges;
+	/* Masks without wildcards which are not addresses */
+	TR1NS::unordered_map<Anope::string, std::vector<Entry>, Anope::hash_ci, Anope::compare> hosts;
+	/* Masks with wildcards */
+	std::vector<Entry> wildcards;
+
+	static inline void Consider(const std::vector<Entry> &entries, const Entry *&best)
+	{
+		for (unsigned i = 0; i < entries.size(); ++i)
+			if (!best || entries[i].first < best->first)
+				best = &entries[i];
+	}
+
+ public:
+	void Clear()
+	{
+		this->ranges.Clear();
+		this->hosts.clear();
+		this->wildcards.clear();
+	}
+
+	void Build(const std::vector<Exception *> &exceptions)
+	{
+		this->Clear();
+
+		for (unsigned i = 0; i < exceptions.size(); ++i)
+		{
+			Exception *e = exceptions[i];
+			Entry entry(i, e);
+
+			/* Masks are addresses, address/length, or host names, matching cidr */
+			std::vector<Entry> *range = this->ranges.Get(e->mask, true);
+			if (range)
+				range->push_back(entry);
+
+			/* An address mask can still match a host or IP as a string */
+			if (e->mask.find_first_of("*?") != Anope::string::npos)
+				this->wildcards.push_back(entry);
+			else
+				this->hosts[e->mask].push_back(entry);
+		}
+	}
+
+	/** Find the first exception matching a host or an IP
+	 * @param host The host
+	 * @param ip The IP, may be the same as the host
+	 * @return The exception, if any
+	 */
+	Exception *Find(const Anope::string &host, const Anope::string &ip) const
+	{
+		const Entry *best = NULL;
+
+		std::vector<Entry> in_range;
+		this->ranges.Find(ip, in_range);
+		Consider(in_range, best);
+
+		TR1NS::unordered_map<Anope::string, std::vector<Entry>, Anope::hash_ci, Anope::compare>::const_iterator it = this->hosts.find(host);
+		if (it != this->hosts.end())
+			Consider(it->second, best);
+		if (ip != host)
+		{
+			it = this->hosts.find(ip);
+			if (it != this->hosts.end())
+				Consider(it->second, best);
+		}
+
+		/* Wildcards after an earlier match can not be the first match */
+		for (unsigned i = 0; i < this->wildcards.size() && (!best || this->wildcards[i].first < best->first); ++i)
+		{
+			const Entry &entry = this->wildcards[i];
+			if (Anope::Match(host, entry.second->mask) || (ip != host && Anope::Match(ip, entry.second->mask)))
+			{
+				best = &entry;
+				break;
+			}
+		}
+
+		return best ? best->second : NULL;
+	}
+};
+
+/** Deletes session exceptions when they expire
+ */
+class ExceptionExpiry : public ExpiryQueue
+{
+	SessionService *service;
+
+ public:
+	ExceptionExpiry(Module *creator, SessionService *ss) : ExpiryQueue(creator, "os_session/expire"), service(ss) { }
+
+	bool Check(Serializable *obj) anope_override
+	{
+		Exception *e = anope_dynamic_static_cast<Exception *>(obj);
+
+		if (!e->expires)
+			return false;
+		else if (e->expires > Anope::CurTime)
+		{
+			this->Schedule(e, e->expires);
+			return false;
+		}
+
+		BotInfo *OperServ = Config->GetClient("OperServ");
+		Log(OperServ, "expire/exception") << "Session exception for " << e->mask << "has expired.";
+		this->service->DelException(e);
+		delete e;
+		return true;
+	}
+};
+
 class MySessionService : public SessionService
 {
 	SessionMap Sessions;
 	Serialize::Checker<ExceptionVector> Exceptions;
+	ExceptionIndex Index;
+	/* Whether Index has to be built again before it is used */
+	bool reindex;
+	ExceptionExpiry Expiry;
+
+	ExceptionIndex &GetIndex()
+	{
+		/* This also gives the database a chance to add exceptions */
+		const ExceptionVector &exceptions = *this->Exceptions;
+
+		if (this->reindex)
+		{
+			this->Index.Build(exceptions);
+			this->reindex = false;
+		}
+		return this->Index;
+	}
+
  public:
-	MySessionService(Module *m) : SessionService(m), Exceptions("Exception") { }
+	MySessionService(Module *m) : SessionService(m), Exceptions("Exception"), reindex(true), Expiry(m, this) { }
 
 	Exception *CreateException() anope_override
 	{
@@ -50,6 +189,9 @@ class MySessionService : public SessionService
 	void AddException(Exception *e) anope_override
 	{
 		this->Exceptions->push_back(e);
+		this->reindex = true;
+		if (e->expires)
+			this->Expiry.Schedule(e, e->expires);
 	}
 
 	void DelException(Exception *e) anope_override
@@ -57,35 +199,34 @@ class MySessionService : public SessionService
 		ExceptionVector::iterator it = std::find(this->Exceptions->begin(), this->Exceptions->end(), e);
 		if (it != this->Exceptions->end())
 			this->Exceptions->erase(it);
+		this->reindex = true;
 	}
 
-	Exception *FindException(User *u) anope_override
+	void UpdateExceptions() anope_override
 	{
-		for (std::vector<Exception *>::const_iterator it = this->Exceptions->begin(), it_end = this->Exceptions->end(); it != it_end; ++it)
+		this->reindex = true;
+
+		for (unsigned i = 0; i < this->Exceptions->size(); ++i)
 		{
-			Exception *e = *it;
-			if (Anope::Match(u->host, e->mask) || Anope::Match(u->ip, e->mask))
-				return e;
-			
-			if (cidr(e->mask).match(sockaddrs(u->ip)))
-				return e;
+			Exception *e = this->Exceptions->at(i);
+			if (e->expires)
+				this->Expiry.Schedule(e, e->expires);
 		}
-		return NULL;
 	}
 
-	Exception *FindException(const Anope::string &host) anope_override
+	void ExpireExceptions()
 	{
-		for (std::vector<Exception *>::const_iterator it = this->Exceptions->begin(), it_end = this->Exceptions->end(); it != it_end; ++it)
-		{
-			Exception *e = *it;
-			if (Anope::Match(host, e->mask))
-				return e;
+		this->Expiry.Process();
+	}
 
-			if (cidr(e->mask).match(sockaddrs(host)))
-				return e;
-		}
+	Exception *FindException(User *u) anope_override
+	{
+		return this->GetIndex().Find(u->host, u->ip);
+	}
 
-		return NULL;
+	Exception *FindException(const Anope::string &host) anope_override
+	{
+		return this->GetIndex().Find(host, host);
 	}
 
 	ExceptionVector &GetExceptions() anope_override
@@ -355,6 +496,7 @@ class CommandOSException : public Command
 					if (e->limit != limit)
 					{
 						e->limit = limit;
+						e->QueueUpdate();
 						source.Reply(_("Exception for \002%s\002 has been updated to %d."), mask.c_str(), e->limit);
 					}
 					else
@@ -449,6 +591,7 @@ class CommandOSException : public Command
 			Exception *temp = session_service->GetExceptions()[n1];
 			session_service->GetExceptions()[n1] = session_service->GetExceptions()[n2];
 			session_service->GetExceptions()[n2] = temp;
+			session_service->UpdateExceptions();
 
 			Log(LOG_ADMIN, source, this) << "to move exception " << session_service->GetExceptions()[n1]->mask << " from position " << n1 + 1 << " to position " << n2 + 1;
 			source.Reply(_("Exception for \002%s\002 (#%d) moved to position \002%d\002."), session_service->GetExceptions()[n1]->mask.c_str(), n1 + 1, n2 + 1);
@@ -760,17 +903,8 @@ class OSSession : public Module
 	{
 		if (Anope::NoExpire)
 			return;
-		for (unsigned i = this->ss.GetExceptions().size(); i > 0; --i)
-		{
-			Exception *e = this->ss.GetExceptions()[i - 1];
-
-			if (!e->expires || e->expires > Anope::CurTime)
-				continue;
-			BotInfo *OperServ = Config->GetClient("OperServ");
-			Log(OperServ, "expire/exception") << "Session exception for " << e->mask << "has expired.";
-			this->ss.DelException(e);
-			delete e;
-		}
+
+		this->ss.ExpireExceptions();
 	}
 };
 
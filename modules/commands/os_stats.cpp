@@ -11,6 +11,8 @@
 
 #include "module.h"
 #include "modules/os_session.h"
+#include "modules/sql.h"
+#include "modules/dns.h"
 
 struct Stats : Serializable
 {
@@ -52,6 +54,7 @@ static int stats_count_servers(Server *s)
 class CommandOSStats : public Command
 {
 	ServiceReference<XLineManager> akills, snlines, sqlines;
+	Stats &stats_saver;
  private:
 	void DoStatsAkill(CommandSource &source)
 	{
@@ -121,6 +124,7 @@ class CommandOSStats : public Command
 	void DoStatsReset(CommandSource &source)
 	{
 		MaxUserCount = UserListByNick.size();
+		stats_saver.QueueUpdate();
 		source.Reply(_("Statistics reset."));
 		return;
 	}
@@ -146,6 +150,8 @@ class CommandOSStats : public Command
 		source.Reply(_("Uplink server: %s"), Me->GetLinks().front()->GetName().c_str());
 		source.Reply(_("Uplink capab: %s"), buf.c_str());
 		source.Reply(_("Servers found: %d"), stats_count_servers(Me->GetLinks().front()));
+		if (UplinkSock)
+			source.Reply(_("Send queue: %u lines (%d bytes), %lu bytes written on the last flush"), UplinkSock->WriteQueueDepth(), UplinkSock->WriteBufferLen(), static_cast<unsigned long>(UplinkSock->LastFlushed()));
 		return;
 	}
 
@@ -157,6 +163,49 @@ class CommandOSStats : public Command
 				max_chain = map.bucket_size(i);
 	}
 
+	void DoStatsSQL(CommandSource &source)
+	{
+		std::vector<Anope::string> providers = Service::GetServiceKeys("SQL::Provider");
+		for (unsigned i = 0; i < providers.size(); ++i)
+		{
+			ServiceReference<SQL::Provider> sql("SQL::Provider", providers[i]);
+			SQL::Provider::Stats stats;
+			if (!sql || !sql->GetStats(stats))
+				continue;
+
+			source.Reply(_("SQL %s: %u connections, %u queries queued, %u executing"), providers[i].c_str(), stats.connections, stats.queued, stats.running);
+			source.Reply(_("SQL %s: %lu queries executed, %lu failed, average wait %lums, average execution %lums, longest %lums"), providers[i].c_str(), stats.queries, stats.errors,
+				stats.queries ? stats.wait_time / stats.queries : 0, stats.queries ? stats.exec_time / stats.queries : 0, stats.max_latency);
+		}
+	}
+
+	void DoStatsDNS(CommandSource &source)
+	{
+		ServiceReference<DNS::Manager> dnsmanager("DNS::Manager", "dns/manager");
+		DNS::Manager::Stats stats;
+		if (!dnsmanager || !dnsmanager->GetStats(stats))
+			return;
+
+		source.Reply(_("DNS cache: %lu entries, %lu hits (%lu negative), %lu misses, %lu evictions"), stats.entries, stats.hits, stats.negative_hits, stats.misses, stats.evictions);
+		source.Reply(_("DNS queries: %lu sent, %lu waiting for an answer, %lu requests waited on an existing query"), stats.queries, stats.pending, stats.coalesced);
+		source.Reply(_("DNS queries: %lu timed out, %lu truncated and asked again over TCP"), stats.timeouts, stats.truncated);
+	}
+
+	void DoStatsExpire(CommandSource &source)
+	{
+		std::vector<Anope::string> queues = Service::GetServiceKeys("ExpiryQueue");
+		for (unsigned i = 0; i < queues.size(); ++i)
+		{
+			ServiceReference<ExpiryQueue> queue("ExpiryQueue", queues[i]);
+			if (!queue)
+				continue;
+
+			const ExpiryQueue::Stats &stats = queue->GetStats();
+			source.Reply(_("Expiry %s: %lu scheduled, last run checked %lu and expired %lu in %lums"), queues[i].c_str(), static_cast<unsigned long>(queue->GetCount()), stats.checked, stats.expired, stats.time);
+			source.Reply(_("Expiry %s: %lu runs, %lu checked, %lu expired in total"), queues[i].c_str(), stats.runs, stats.total_checked, stats.total_expired);
+		}
+	}
+
 	void DoStatsHash(CommandSource &source)
 	{
 		size_t entries, buckets, max_chain;
@@ -190,11 +239,11 @@ class CommandOSStats : public Command
 	}
 
  public:
-	CommandOSStats(Module *creator) : Command(creator, "operserv/stats", 0, 1),
-		akills("XLineManager", "xlinemanager/sgline"), snlines("XLineManager", "xlinemanager/snline"), sqlines("XLineManager", "xlinemanager/sqline")
+	CommandOSStats(Module *creator, Stats &saver) : Command(creator, "operserv/stats", 0, 1),
+		akills("XLineManager", "xlinemanager/sgline"), snlines("XLineManager", "xlinemanager/snline"), sqlines("XLineManager", "xlinemanager/sqline"), stats_saver(saver)
 	{
 		this->SetDesc(_("Show status of Services and network"));
-		this->SetSyntax(_("[AKILL | HASH | UPLINK | UPTIME | ALL | RESET]"));
+		this->SetSyntax(_("[AKILL | DNS | EXPIRE | HASH | SQL | UPLINK | UPTIME | ALL | RESET]"));
 	}
 
 	void Execute(CommandSource &source, const std::vector<Anope::string> &params) anope_override
@@ -209,16 +258,25 @@ class CommandOSStats : public Command
 		if (extra.equals_ci("ALL") || extra.equals_ci("AKILL"))
 			this->DoStatsAkill(source);
 
+		if (extra.equals_ci("ALL") || extra.equals_ci("DNS"))
+			this->DoStatsDNS(source);
+
+		if (extra.equals_ci("ALL") || extra.equals_ci("EXPIRE"))
+			this->DoStatsExpire(source);
+
 		if (extra.equals_ci("ALL") || extra.equals_ci("HASH"))
 			this->DoStatsHash(source);
 
+		if (extra.equals_ci("ALL") || extra.equals_ci("SQL"))
+			this->DoStatsSQL(source);
+
 		if (extra.equals_ci("ALL") || extra.equals_ci("UPLINK"))
 			this->DoStatsUplink(source);
 
 		if (extra.empty() || extra.equals_ci("ALL") || extra.equals_ci("UPTIME"))
 			this->DoStatsUptime(source);
 
-		if (!extra.empty() && !extra.equals_ci("ALL") && !extra.equals_ci("AKILL") && !extra.equals_ci("HASH") && !extra.equals_ci("UPLINK") && !extra.equals_ci("UPTIME"))
+		if (!extra.empty() && !extra.equals_ci("ALL") && !extra.equals_ci("AKILL") && !extra.equals_ci("DNS") && !extra.equals_ci("EXPIRE") && !extra.equals_ci("HASH") && !extra.equals_ci("SQL") && !extra.equals_ci("UPLINK") && !extra.equals_ci("UPTIME"))
 			source.Reply(_("Unknown STATS option: \002%s\002"), extra.c_str());
 	}
 
@@ -239,8 +297,17 @@ class CommandOSStats : public Command
 				"The \002UPLINK\002 option displays information about the current\n"
 				"server Anope uses as an uplink to the network.\n"
 				" \n"
+				"The \002DNS\002 option displays how well the DNS cache is working,\n"
+				"and how many DNS queries have been sent.\n"
+				" \n"
+				"The \002EXPIRE\002 option displays how many objects are waiting\n"
+				"to be checked for expiry, and how many were checked and expired.\n"
+				" \n"
 				"The \002HASH\002 option displays information about the hash maps.\n"
 				" \n"
+				"The \002SQL\002 option displays the number of queries waiting\n"
+				"and executing on each SQL database, and how long they take.\n"
+				" \n"
 				"The \002ALL\002 option displays all of the above statistics."));
 		return true;
 	}
@@ -254,10 +321,17 @@ class OSStats : public Module
 
  public:
 	OSStats(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, VENDOR),
-		commandosstats(this), stats_type("Stats", Stats::Unserialize)
+		commandosstats(this, stats_saver), stats_type("Stats", Stats::Unserialize)
 	{
 
 	}
+
+	void OnUserConnect(User *u, bool &exempt) anope_override
+	{
+		/* A new maximum user count was set by this user */
+		if (UserListByNick.size() == MaxUserCount && Anope::CurTime == MaxUserTime)
+			stats_saver.QueueUpdate();
+	}
 };
 
 MODULE_INIT(OSStats)
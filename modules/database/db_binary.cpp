@@ -0,0 +1,780 @@
+/*
+ * (C) 2003-2013 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ */
+
+#include "module.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+/* The database is a header followed by a sequence of records:
+ *
+ * T <u32 type> <u32 length> <name>                    declares a type
+ * F <u32 type> <u32 field> <u32 length> <name>        declares a field of a type
+ * O <u32 type> <u64 id> <u32 count> count * (<u32 field> <u32 length> <value>)
+ * E <u64 objects>                                     end of the database
+ *
+ * Types and fields are declared before the first object using them. Integers are
+ * stored in host byte order, the header records which that is.
+ */
+static const char db_magic[8] = { 'A', 'N', 'O', 'P', 'E', 'D', 'B', '\0' };
+static const uint32_t db_version = 1, db_byteorder = 0x01020304;
+
+/** Writes databases, keeping track of which types and fields have been declared.
+ */
+class BinaryWriter
+{
+	std::ostream &out;
+	std::map<Anope::string, uint32_t> types;
+	std::vector<std::map<Anope::string, uint32_t> > fields;
+	uint64_t objects;
+
+	void Write(uint32_t i)
+	{
+		out.write(reinterpret_cast<const char *>(&i), sizeof(i));
+	}
+
+	void Write(uint64_t i)
+	{
+		out.write(reinterpret_cast<const char *>(&i), sizeof(i));
+	}
+
+	void Write(const char *data, size_t len)
+	{
+		Write(static_cast<uint32_t>(len));
+		out.write(data, len);
+	}
+
+ public:
+	BinaryWriter(std::ostream &o) : out(o), objects(0)
+	{
+		out.write(db_magic, sizeof(db_magic));
+		Write(db_version);
+		Write(db_byteorder);
+	}
+
+	uint32_t GetType(const Anope::string &name)
+	{
+		std::map<Anope::string, uint32_t>::iterator it = types.find(name);
+		if (it != types.end())
+			return it->second;
+
+		uint32_t id = types.size();
+		types[name] = id;
+		fields.resize(id + 1);
+
+		out.put('T');
+		Write(id);
+		Write(name.c_str(), name.length());
+		return id;
+	}
+
+	uint32_t GetField(uint32_t type, const Anope::string &name)
+	{
+		std::map<Anope::string, uint32_t> &f = fields[type];
+		std::map<Anope::string, uint32_t>::iterator it = f.find(name);
+		if (it != f.end())
+			return it->second;
+
+		uint32_t id = f.size();
+		f[name] = id;
+
+		out.put('F');
+		Write(type);
+		Write(id);
+		Write(name.c_str(), name.length());
+		return id;
+	}
+
+	/** Writes an object.
+	 * @param type The object's type, from GetType
+	 * @param id The object's id
+	 * @param values The object's fields, from GetField, and their values
+	 */
+	void WriteObject(uint32_t type, uint64_t id, const std::vector<std::pair<uint32_t, Anope::string> > &values)
+	{
+		out.put('O');
+		Write(type);
+		Write(id);
+		Write(static_cast<uint32_t>(values.size()));
+		for (unsigned i = 0; i < values.size(); ++i)
+		{
+			Write(values[i].first);
+			Write(values[i].second.c_str(), values[i].second.length());
+		}
+		++objects;
+	}
+
+	void End()
+	{
+		out.put('E');
+		Write(objects);
+	}
+};
+
+/** Serializes objects into a single buffer, remembering where each field starts.
+ */
+class SaveData : public Serialize::Data
+{
+	std::vector<std::pair<Anope::string, size_t> > keys;
+
+ public:
+	std::stringstream ss;
+
+	std::iostream& operator[](const Anope::string &key) anope_override
+	{
+		if (keys.empty() || keys.back().first != key)
+			keys.push_back(std::make_pair(key, static_cast<size_t>(ss.tellp())));
+		return ss;
+	}
+
+	void Write(BinaryWriter &writer, const Anope::string &type_name, uint64_t id)
+	{
+		uint32_t type = writer.GetType(type_name);
+		const std::string &buf = ss.str();
+
+		std::vector<std::pair<uint32_t, Anope::string> > values;
+		std::map<uint32_t, unsigned> seen;
+		for (unsigned i = 0; i < keys.size(); ++i)
+		{
+			size_t end = i + 1 < keys.size() ? keys[i + 1].second : buf.length();
+			Anope::string value(buf.substr(keys[i].second, end - keys[i].second));
+			uint32_t field = writer.GetField(type, keys[i].first);
+
+			/* A field written to again after others were, append to it */
+			std::map<uint32_t, unsigned>::iterator it = seen.find(field);
+			if (it != seen.end())
+				values[it->second].second += value;
+			else
+			{
+				seen[field] = values.size();
+				values.push_back(std::make_pair(field, value));
+			}
+		}
+
+		writer.WriteObject(type, id, values);
+	}
+
+	void Reset()
+	{
+		keys.clear();
+		ss.clear();
+		ss.str("");
+	}
+};
+
+/** A read only stream buffer over memory owned by someone else.
+ */
+class MemoryBuf : public std::streambuf
+{
+ public:
+	void Set(const char *begin, const char *end)
+	{
+		char *b = const_cast<char *>(begin);
+		this->setg(b, b, const_cast<char *>(end));
+	}
+};
+
+/** A database mapped into memory.
+ */
+class BinaryFile
+{
+	const char *data;
+	size_t len;
+#ifdef _WIN32
+	std::vector<char> buffer;
+#endif
+
+ public:
+	BinaryFile() : data(NULL), len(0) { }
+
+	~BinaryFile()
+	{
+#ifndef _WIN32
+		if (data != NULL && len)
+			munmap(const_cast<char *>(data), len);
+#endif
+	}
+
+	bool Open(const Anope::string &name)
+	{
+#ifndef _WIN32
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) || st.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return false;
+
+#ifdef MADV_SEQUENTIAL
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+		data = static_cast<const char *>(p);
+		len = st.st_size;
+#else
+		std::ifstream f(name.c_str(), std::ios_base::in | std::ios_base::binary);
+		if (!f.is_open())
+			return false;
+
+		buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+		if (buffer.empty())
+			return false;
+
+		data = &buffer[0];
+		len = buffer.size();
+#endif
+		return true;
+	}
+
+	const char *GetData() const { return data; }
+	size_t GetLength() const { return len; }
+};
+
+/** Reads records from a database in memory, checking they are within bounds.
+ */
+class Reader
+{
+	const char *pos, *end;
+
+ public:
+	Reader(const char *b, const char *e) : pos(b), end(e) { }
+
+	const char *GetPos() const { return pos; }
+
+	bool Read(char &c)
+	{
+		if (pos >= end)
+			return false;
+		c = *pos++;
+		return true;
+	}
+
+	template<typename T> bool Read(T &i)
+	{
+		if (static_cast<size_t>(end - pos) < sizeof(T))
+			return false;
+		memcpy(&i, pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	bool Read(const char *&str, uint32_t &length)
+	{
+		if (!Read(length) || static_cast<size_t>(end - pos) < length)
+			return false;
+		str = pos;
+		pos += length;
+		return true;
+	}
+};
+
+/** The fields of a type, by name.
+ */
+typedef TR1NS::unordered_map<Anope::string, uint32_t, Anope::hash_cs> FieldMap;
+
+/** Unserializes an object directly from the mapped database.
+ */
+class LoadData : public Serialize::Data
+{
+	const FieldMap *fields;
+	const char *object;
+	uint32_t count;
+	MemoryBuf buf;
+	std::iostream stream;
+
+	/** Finds the value of a field of the object.
+	 * @return true if the object has the field
+	 */
+	bool Find(uint32_t field, const char *&value, uint32_t &length) const
+	{
+		const char *p = object;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t f;
+			memcpy(&f, p, sizeof(f));
+			memcpy(&length, p + sizeof(f), sizeof(length));
+			p += sizeof(f) + sizeof(length);
+
+			if (f == field)
+			{
+				value = p;
+				return true;
+			}
+
+			p += length;
+		}
+		return false;
+	}
+
+ public:
+	uint64_t id;
+
+	LoadData() : fields(NULL), object(NULL), count(0), stream(&buf), id(0) { }
+
+	/** Points this at an object.
+	 * @param f The object type's fields
+	 * @param o The object's fields, which have been checked to be in bounds
+	 * @param c The number of fields the object has
+	 */
+	void Set(const FieldMap *f, const char *o, uint32_t c, uint64_t i)
+	{
+		fields = f;
+		object = o;
+		count = c;
+		id = i;
+	}
+
+	std::iostream& operator[](const Anope::string &key) anope_override
+	{
+		const char *value = NULL;
+		uint32_t length = 0;
+
+		FieldMap::const_iterator it = fields->find(key);
+		if (it == fields->end() || !Find(it->second, value, length))
+			length = 0;
+
+		buf.Set(value, value + length);
+		stream.clear();
+		return stream;
+	}
+
+	std::set<Anope::string> KeySet() const anope_override
+	{
+		std::set<Anope::string> keys;
+		for (FieldMap::const_iterator it = fields->begin(), it_end = fields->end(); it != it_end; ++it)
+		{
+			const char *value;
+			uint32_t length;
+			if (Find(it->second, value, length))
+				keys.insert(it->first);
+		}
+		return keys;
+	}
+
+	size_t Hash() const anope_override
+	{
+		size_t hash = 0;
+		for (FieldMap::const_iterator it = fields->begin(), it_end = fields->end(); it != it_end; ++it)
+		{
+			const char *value;
+			uint32_t length;
+			if (Find(it->second, value, length) && length)
+				hash ^= Anope::hash_cs()(Anope::string(value, value + length));
+		}
+		return hash;
+	}
+};
+
+/** The contents of a database, indexed by type.
+ */
+struct DatabaseIndex
+{
+	struct Object
+	{
+		const char *fields;
+		uint32_t count;
+		uint64_t id;
+	};
+
+	struct Type
+	{
+		Anope::string name;
+		FieldMap fields;
+		std::vector<Object> objects;
+	};
+
+	std::vector<Type> types;
+	TR1NS::unordered_map<Anope::string, uint32_t, Anope::hash_cs> types_by_name;
+
+	/** Indexes a database.
+	 * @return An empty string on success, else an error
+	 */
+	Anope::string Build(const BinaryFile &file)
+	{
+		Reader r(file.GetData(), file.GetData() + file.GetLength());
+
+		char magic[sizeof(db_magic)];
+		uint32_t version, byteorder;
+		for (unsigned i = 0; i < sizeof(magic); ++i)
+			if (!r.Read(magic[i]))
+				return "truncated header";
+		if (memcmp(magic, db_magic, sizeof(magic)))
+			return "not a binary database";
+		if (!r.Read(version) || !r.Read(byteorder))
+			return "truncated header";
+		if (version != db_version)
+			return "unknown version " + stringify(version);
+		if (byteorder != db_byteorder)
+			return "database was written on a machine with a different byte order";
+
+		for (char kind; r.Read(kind);)
+		{
+			switch (kind)
+			{
+				case 'T':
+				{
+					uint32_t type, length;
+					const char *name;
+					if (!r.Read(type) || !r.Read(name, length) || type != types.size())
+						return "malformed type";
+
+					types.push_back(Type());
+					types.back().name = Anope::string(name, name + length);
+					types_by_name[types.back().name] = type;
+					break;
+				}
+				case 'F':
+				{
+					uint32_t type, field, length;
+					const char *name;
+					if (!r.Read(type) || !r.Read(field) || !r.Read(name, length) || type >= types.size())
+						return "malformed field";
+
+					types[type].fields[Anope::string(name, name + length)] = field;
+					break;
+				}
+				case 'O':
+				{
+					Object obj;
+					uint32_t type;
+					if (!r.Read(type) || !r.Read(obj.id) || !r.Read(obj.count) || type >= types.size())
+						return "malformed object";
+
+					obj.fields = r.GetPos();
+					for (uint32_t i = 0; i < obj.count; ++i)
+					{
+						uint32_t field, length;
+						const char *value;
+						if (!r.Read(field) || !r.Read(value, length))
+							return "truncated object";
+					}
+
+					types[type].objects.push_back(obj);
+					break;
+				}
+				case 'E':
+				{
+					uint64_t objects = 0, count;
+					if (!r.Read(count))
+						return "truncated end";
+					for (unsigned i = 0; i < types.size(); ++i)
+						objects += types[i].objects.size();
+					if (objects != count)
+						return "object count mismatch";
+					return "";
+				}
+				default:
+					return "unknown record";
+			}
+		}
+
+		return "truncated";
+	}
+
+	/** Unserializes all objects of the given type.
+	 * @return The number of objects loaded
+	 */
+	unsigned Load(Serialize::Type *stype)
+	{
+		TR1NS::unordered_map<Anope::string, uint32_t, Anope::hash_cs>::iterator it = types_by_name.find(stype->GetName());
+		if (it == types_by_name.end())
+			return 0;
+
+		Type &t = types[it->second];
+		LoadData ld;
+		unsigned loaded = 0;
+
+		for (unsigned i = 0; i < t.objects.size(); ++i)
+		{
+			const Object &obj = t.objects[i];
+
+			ld.Set(&t.fields, obj.fields, obj.count, obj.id);
+			Serializable *s = stype->Unserialize(NULL, ld);
+			if (s != NULL)
+			{
+				s->id = obj.id;
+				++loaded;
+			}
+		}
+
+		return loaded;
+	}
+};
+
+class DBBinary : public Module, public Pipe
+{
+	bool loaded;
+
+	Anope::string GetDatabase(Module *owner)
+	{
+		if (owner)
+			return Anope::DataDir + "/module_" + owner->name + ".bin";
+		return Anope::DataDir + "/" + Config->GetModule(this)->Get<const Anope::string>("database", "anope.bin");
+	}
+
+	/** Converts a db_flatfile database to a binary database.
+	 * @return true on success
+	 */
+	bool Convert(const Anope::string &flatfile, const Anope::string &db_name)
+	{
+		std::ifstream in(flatfile.c_str(), std::ios_base::in);
+		if (!in.is_open())
+			return false;
+
+		const Anope::string &tmp_name = db_name + ".tmp";
+		std::ofstream out(tmp_name.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+		if (!out.is_open())
+		{
+			Log(this) << "Unable to open " << tmp_name << " for writing";
+			return false;
+		}
+
+		BinaryWriter writer(out);
+		std::vector<std::pair<uint32_t, Anope::string> > values;
+		uint32_t type_id = 0;
+		uint64_t id = 0;
+		bool in_object = false;
+		unsigned objects = 0;
+
+		for (Anope::string buf; std::getline(in, buf.str());)
+		{
+			if (buf.find("OBJECT ") == 0)
+			{
+				type_id = writer.GetType(buf.substr(7));
+				id = 0;
+				values.clear();
+				in_object = true;
+			}
+			else if (!in_object)
+				continue;
+			else if (buf.find("ID ") == 0)
+			{
+				try
+				{
+					id = convertTo<uint64_t>(buf.substr(3));
+				}
+				catch (const ConvertException &) { }
+			}
+			else if (buf.find("DATA ") == 0)
+			{
+				size_t sp = buf.find(' ', 5);
+				if (sp != Anope::string::npos)
+					values.push_back(std::make_pair(writer.GetField(type_id, buf.substr(5, sp - 5)), buf.substr(sp + 1)));
+			}
+			else if (buf == "END")
+			{
+				writer.WriteObject(type_id, id, values);
+				in_object = false;
+				++objects;
+			}
+		}
+
+		writer.End();
+		out.close();
+
+		if (!out.good() || rename(tmp_name.c_str(), db_name.c_str()))
+		{
+			Log(this) << "Unable to write " << db_name;
+			unlink(tmp_name.c_str());
+			return false;
+		}
+
+		Log(this) << "Converted " << objects << " objects from " << flatfile << " to " << db_name;
+		return true;
+	}
+
+	/** Loads objects from a database.
+	 * @param db_name The database
+	 * @param only If set only objects of this type are loaded, otherwise all core types are
+	 */
+	void LoadDatabase(const Anope::string &db_name, Serialize::Type *only)
+	{
+		BinaryFile file;
+		if (!file.Open(db_name))
+		{
+			Log(this) << "Unable to open " << db_name << " for reading!";
+			return;
+		}
+
+		DatabaseIndex index;
+		const Anope::string &error = index.Build(file);
+		if (!error.empty())
+		{
+			Log(this) << "Unable to load " << db_name << ": " << error;
+
+			/* Do not overwrite a database we could not read with an empty one */
+			Anope::QuitReason = "Unable to load database " + db_name;
+			Anope::Quitting = true;
+			return;
+		}
+
+		if (only)
+		{
+			index.Load(only);
+			return;
+		}
+
+		unsigned objects = 0;
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+			if (stype && !stype->GetOwner())
+				objects += index.Load(stype);
+		}
+
+		Log(LOG_DEBUG) << "db_binary: Loaded " << objects << " objects from " << db_name;
+	}
+
+ public:
+	DBBinary(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE | VENDOR), loaded(false)
+	{
+	}
+
+	void OnNotify() anope_override
+	{
+		char buf[512];
+		int i = this->Read(buf, sizeof(buf) - 1);
+		if (i <= 0)
+			return;
+		buf[i] = 0;
+
+		if (!*buf)
+		{
+			Log(this) << "Finished saving databases";
+			return;
+		}
+
+		Log(this) << "Error saving databases: " << buf;
+
+		if (!Config->GetModule(this)->Get<bool>("nobackupok"))
+			Anope::Quitting = true;
+	}
+
+	EventReturn OnLoadDatabase() anope_override
+	{
+		const Anope::string &db_name = GetDatabase(NULL);
+
+		if (!Anope::IsFile(db_name))
+		{
+			const Anope::string &flatfile = Config->GetModule(this)->Get<const Anope::string>("convert");
+			if (!flatfile.empty() && Anope::IsFile(Anope::DataDir + "/" + flatfile))
+				Convert(Anope::DataDir + "/" + flatfile, db_name);
+		}
+
+		LoadDatabase(db_name, NULL);
+
+		loaded = true;
+		return EVENT_STOP;
+	}
+
+	void OnSaveDatabase() anope_override
+	{
+		int i = -1;
+#ifndef _WIN32
+		if (Config->GetModule(this)->Get<bool>("fork"))
+		{
+			i = fork();
+			if (i > 0)
+				return;
+			else if (i < 0)
+				Log(this) << "Unable to fork for database save";
+		}
+#endif
+
+		try
+		{
+			std::map<Module *, std::pair<std::ofstream *, BinaryWriter *> > databases;
+
+			/* Open the databases of all of the registered types, so databases of types with no objects are cleared */
+			for (std::map<Anope::string, Serialize::Type *>::const_iterator it = Serialize::Type::GetTypes().begin(), it_end = Serialize::Type::GetTypes().end(); it != it_end; ++it)
+			{
+				Module *owner = it->second->GetOwner();
+				if (databases.count(owner))
+					continue;
+
+				const Anope::string &db_name = GetDatabase(owner);
+				std::ofstream *fs = new std::ofstream((db_name + ".tmp").c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+				if (!fs->is_open())
+					Log(this) << "Unable to open " << db_name << ".tmp for writing";
+
+				databases[owner] = std::make_pair(fs, new BinaryWriter(*fs));
+			}
+
+			SaveData data;
+			const std::list<Serializable *> &items = Serializable::GetItems();
+			for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+			{
+				Serializable *base = *it;
+				Serialize::Type *s_type = base->GetSerializableType();
+				if (!s_type)
+					continue;
+
+				std::map<Module *, std::pair<std::ofstream *, BinaryWriter *> >::iterator dit = databases.find(s_type->GetOwner());
+				if (dit == databases.end() || !dit->second.first->is_open())
+					continue;
+
+				data.Reset();
+				base->Serialize(data);
+				data.Write(*dit->second.second, s_type->GetName(), base->id);
+			}
+
+			for (std::map<Module *, std::pair<std::ofstream *, BinaryWriter *> >::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
+			{
+				std::ofstream *f = it->second.first;
+				const Anope::string &db_name = GetDatabase(it->first);
+
+				it->second.second->End();
+				f->close();
+
+				/* The new database only replaces the old one once it is complete */
+				if (!f->good() || rename((db_name + ".tmp").c_str(), db_name.c_str()))
+				{
+					this->Write("Unable to write database " + db_name);
+					unlink((db_name + ".tmp").c_str());
+				}
+
+				delete it->second.second;
+				delete f;
+			}
+		}
+		catch (...)
+		{
+			if (i)
+				throw;
+		}
+
+		if (!i)
+		{
+			this->Notify();
+			exit(0);
+		}
+	}
+
+	/* Load just one type. Done if a module is reloaded during runtime */
+	void OnSerializeTypeCreate(Serialize::Type *stype) anope_override
+	{
+		if (!loaded)
+			return;
+
+		LoadDatabase(GetDatabase(stype->GetOwner()), stype);
+	}
+};
+
+MODULE_INIT(DBBinary)
@@ -10,11 +10,15 @@
 
 #include "module.h"
 
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
 class SaveData : public Serialize::Data
 {
  public:
  	Anope::string last;
-	std::fstream *fs;
+	std::iostream *fs;
 
 	SaveData() : fs(NULL) { }
 
@@ -30,46 +34,66 @@ class SaveData : public Serialize::Data
 	}
 };
 
+/** An object of a database loaded into memory, parsed into its fields.
+ */
+struct ParsedObject
+{
+	uint64_t id;
+	std::map<Anope::string, Anope::string> data;
+
+	ParsedObject() : id(0) { }
+};
+
 class LoadData : public Serialize::Data
 {
  public:
- 	std::fstream *fs;
-	unsigned int id;
+ 	std::iostream *fs;
+	uint64_t id;
 	std::map<Anope::string, Anope::string> data;
 	std::stringstream ss;
 	bool read;
 
 	LoadData() : fs(NULL), id(0), read(false) { }
 
-	std::iostream& operator[](const Anope::string &key) anope_override
+	/** Reads the rest of the object from the stream.
+	 * @return true if the object was terminated by an END line
+	 */
+	bool Read()
 	{
-		if (!read)
+		Anope::string token;
+		while (std::getline(*this->fs, token.str()))
 		{
-			for (Anope::string token; std::getline(*this->fs, token.str());)
+			if (token.find("ID ") == 0)
 			{
-				if (token.find("ID ") == 0)
+				try
 				{
-					try
-					{
-						this->id = convertTo<unsigned int>(token.substr(3));
-					}
-					catch (const ConvertException &) { }
-
-					continue;
+					this->id = convertTo<uint64_t>(token.substr(3));
 				}
-				else if (token.find("DATA ") != 0)
-					break;
+				catch (const ConvertException &) { }
 
-				size_t sp = token.find(' ', 5); // Skip DATA
-				if (sp != Anope::string::npos)
-					data[token.substr(5, sp - 5)] = token.substr(sp + 1);
+				continue;
 			}
+			else if (token.find("DATA ") != 0)
+				break;
 
-			read = true;
+			size_t sp = token.find(' ', 5); // Skip DATA
+			if (sp != Anope::string::npos)
+				data[token.substr(5, sp - 5)] = token.substr(sp + 1);
 		}
 
+		read = true;
+		return token == "END";
+	}
+
+	std::iostream& operator[](const Anope::string &key) anope_override
+	{
+		if (!read)
+			this->Read();
+
+		/* Do not insert keys the object does not have, objects are asked for every extension */
+		std::map<Anope::string, Anope::string>::const_iterator it = this->data.find(key);
 		ss.clear();
-		this->ss << this->data[key];
+		this->ss.str(it != this->data.end() ? it->second.str() : "");
 		return this->ss;
 	}
 
@@ -96,6 +120,156 @@ class LoadData : public Serialize::Data
 		read = false;
 		data.clear();
 	}
+
+	/** Uses an object already parsed instead of reading one from the stream.
+	 */
+	void Set(ParsedObject &obj)
+	{
+		id = obj.id;
+		read = true;
+		data.swap(obj.data);
+	}
+};
+
+/** Objects of a database loaded into memory, which are parsed by a pool of worker
+ * threads and handed to the main thread in type order to be unserialized.
+ */
+class LoadQueue : public Condition
+{
+ public:
+	struct Chunk
+	{
+		Serialize::Type *type;
+		/* Where each object's lines begin and end */
+		std::vector<std::pair<const char *, const char *> > blocks;
+		std::vector<ParsedObject> objects;
+		bool done;
+
+		Chunk() : type(NULL), done(false) { }
+	};
+
+ private:
+	std::vector<Chunk> chunks;
+	/* The next chunk to be parsed */
+	size_t next;
+
+	static void Parse(Chunk &chunk)
+	{
+		chunk.objects.resize(chunk.blocks.size());
+
+		for (unsigned i = 0; i < chunk.blocks.size(); ++i)
+		{
+			ParsedObject &obj = chunk.objects[i];
+
+			for (const char *p = chunk.blocks[i].first, *end = chunk.blocks[i].second; p < end;)
+			{
+				const char *nl = static_cast<const char *>(memchr(p, '\n', end - p)), *le = nl ? nl : end;
+
+				if (le - p > 3 && !memcmp(p, "ID ", 3))
+				{
+					obj.id = 0;
+					for (const char *c = p + 3; c < le && *c >= '0' && *c <= '9'; ++c)
+						obj.id = obj.id * 10 + (*c - '0');
+				}
+				else if (le - p > 5 && !memcmp(p, "DATA ", 5))
+				{
+					const char *sp = static_cast<const char *>(memchr(p + 5, ' ', le - p - 5));
+					if (sp != NULL)
+						obj.data[Anope::string(p + 5, sp)] = Anope::string(sp + 1, le);
+				}
+				else
+					break;
+
+				p = le + 1;
+			}
+		}
+	}
+
+	/** Claims the next chunk to parse.
+	 * @return The chunk, or chunks.size() if there are none left
+	 */
+	size_t Claim()
+	{
+		this->Lock();
+		size_t c = next < chunks.size() ? next++ : chunks.size();
+		this->Unlock();
+		return c;
+	}
+
+ public:
+	LoadQueue() : next(0) { }
+
+	/** Adds objects of a type, which must be added in the order they are to be unserialized.
+	 * @param type The type
+	 * @param blocks Where each object's lines begin and end
+	 */
+	void Add(Serialize::Type *type, const std::vector<std::pair<const char *, const char *> > &blocks)
+	{
+		/* Small enough for the main thread to not wait long for any one chunk */
+		static const unsigned chunk_size = 512;
+
+		for (unsigned i = 0; i < blocks.size(); i += chunk_size)
+		{
+			chunks.push_back(Chunk());
+			chunks.back().type = type;
+			chunks.back().blocks.assign(blocks.begin() + i, blocks.begin() + std::min<size_t>(i + chunk_size, blocks.size()));
+		}
+	}
+
+	/** Parses chunks until there are none left. Run by the worker threads.
+	 */
+	void Work()
+	{
+		for (size_t c; (c = this->Claim()) < chunks.size();)
+		{
+			Parse(chunks[c]);
+
+			this->Lock();
+			chunks[c].done = true;
+			this->Wakeup();
+			this->Unlock();
+		}
+	}
+
+	size_t Size() const
+	{
+		return chunks.size();
+	}
+
+	/** Gets a chunk once it is parsed, parsing it on this thread if no worker has started to.
+	 * Chunks must be gotten in order.
+	 */
+	Chunk &Get(size_t c)
+	{
+		this->Lock();
+		if (next == c)
+		{
+			++next;
+			this->Unlock();
+
+			Parse(chunks[c]);
+			return chunks[c];
+		}
+
+		while (!chunks[c].done)
+			this->Wait();
+		this->Unlock();
+
+		return chunks[c];
+	}
+};
+
+class LoadWorker : public Thread
+{
+	LoadQueue &queue;
+
+ public:
+	LoadWorker(LoadQueue &q) : queue(q) { }
+
+	void Run() anope_override
+	{
+		queue.Work();
+	}
 };
 
 class DBFlatFile : public Module, public Pipe
@@ -105,6 +279,58 @@ class DBFlatFile : public Module, public Pipe
 	/* Backup file names */
 	std::map<Anope::string, std::list<Anope::string> > backups;
 	bool loaded;
+	/* Whether we are currently unserializing objects from the databases */
+	bool loading;
+	bool shutting_down;
+
+	/* Whether changes are appended to the journals between full saves */
+	bool journal;
+	/* How often the journals are compacted into a full save */
+	time_t journal_compact;
+	/* When the last full save was started */
+	time_t last_compact;
+	/* Set when the next save must be a full one */
+	bool need_compact;
+	/* Set while a forked child is writing a full save */
+	bool compacting;
+	/* Set while a module is being unloaded, deletions of its objects are not journaled */
+	bool unloading;
+	/* The last object id given out */
+	uint64_t last_id;
+
+	/* Objects created or updated since the journals were last written */
+	std::set<Serializable *> touched;
+	/* Journal records of objects destroyed since the journals were last written, by database */
+	std::vector<std::pair<Anope::string, Anope::string> > deleted;
+	/* Size of each database's journal when the full save in progress was started */
+	std::map<Anope::string, std::streamoff> checkpoints;
+
+	static unsigned DefaultThreads()
+	{
+#ifndef _WIN32
+		/* The main thread parses too when it is waiting for the workers */
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (cpus > 1)
+			return std::min<long>(cpus - 1, 8);
+#endif
+		return 0;
+	}
+
+	/** Gets the milliseconds since a time.
+	 */
+	static long Elapsed(const timeval &since)
+	{
+		timeval now;
+		gettimeofday(&now, NULL);
+		return (now.tv_sec - since.tv_sec) * 1000 + (now.tv_usec - since.tv_usec) / 1000;
+	}
+
+	Anope::string GetDatabase(Module *owner)
+	{
+		if (owner)
+			return Anope::DataDir + "/module_" + owner->name + ".db";
+		return Anope::DataDir + "/" + Config->GetModule(this)->Get<const Anope::string>("database", "anope.db");
+	}
 
 	void BackupDatabase()
 	{
@@ -160,10 +386,279 @@ class DBFlatFile : public Module, public Pipe
 		}
 	}
 
+	/** Gives every object without one an id, so journal records can refer to it.
+	 * Objects which did not come from the databases are journaled as new.
+	 * Ids are only given out while journaling, as otherwise they are left to database
+	 * modules such as db_sql, which use them as row ids.
+	 */
+	void AssignIds()
+	{
+		if (!this->journal)
+			return;
+
+		const std::list<Serializable *> &items = Serializable::GetItems();
+
+		for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+			if ((*it)->id > last_id)
+				last_id = (*it)->id;
+
+		for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+		{
+			Serializable *obj = *it;
+			Serialize::Type *s_type = obj->GetSerializableType();
+			if (!s_type)
+				continue;
+
+			if (!obj->id)
+			{
+				obj->id = ++last_id;
+				touched.insert(obj);
+			}
+
+			s_type->objects[obj->id] = obj;
+		}
+	}
+
+	/** Replays a database's journal on top of its last full save.
+	 * @param db_name The database
+	 * @param only If set only records for this type are replayed, otherwise records for all core types are
+	 */
+	void ReplayJournal(const Anope::string &db_name, Serialize::Type *only)
+	{
+		const Anope::string &journal_name = db_name + ".journal";
+
+		std::fstream fd(journal_name.c_str(), std::ios_base::in);
+		if (!fd.is_open())
+			return;
+
+		unsigned records = 0;
+		LoadData ld;
+		ld.fs = &fd;
+
+		for (Anope::string buf; std::getline(fd, buf.str());)
+		{
+			if (buf.find("OBJECT ") == 0)
+			{
+				Serialize::Type *stype = Serialize::Type::Find(buf.substr(7));
+
+				ld.Reset();
+				/* A record cut short by a failed write is ignored */
+				if (!ld.Read() || !stype || (only ? stype != only : stype->GetOwner() != NULL))
+					continue;
+
+				std::map<uint64_t, Serializable *>::iterator it = ld.id ? stype->objects.find(ld.id) : stype->objects.end();
+				Serializable *obj = stype->Unserialize(it != stype->objects.end() ? it->second : NULL, ld);
+				if (obj != NULL && ld.id)
+				{
+					obj->id = ld.id;
+					stype->objects[obj->id] = obj;
+				}
+
+				++records;
+			}
+			else if (buf.find("DELETE ") == 0)
+			{
+				spacesepstream sep(buf.substr(7));
+				Anope::string type_name, id;
+				sep.GetToken(type_name);
+				sep.GetToken(id);
+
+				Serialize::Type *stype = Serialize::Type::Find(type_name);
+				if (!stype || (only ? stype != only : stype->GetOwner() != NULL))
+					continue;
+
+				try
+				{
+					std::map<uint64_t, Serializable *>::iterator it = stype->objects.find(convertTo<uint64_t>(id));
+					if (it != stype->objects.end())
+						delete it->second;
+				}
+				catch (const ConvertException &) { }
+
+				++records;
+			}
+		}
+
+		fd.close();
+
+		if (records)
+			Log(this) << "Replayed " << records << " records from " << journal_name;
+	}
+
+	/** Appends records for everything created, updated, or destroyed since the last
+	 * call to the journals.
+	 * @return true on success
+	 */
+	bool WriteJournal()
+	{
+		std::map<Serialize::Type *, std::vector<Serializable *> > by_type;
+		for (std::set<Serializable *>::iterator it = touched.begin(), it_end = touched.end(); it != it_end; ++it)
+			by_type[(*it)->GetSerializableType()].push_back(*it);
+		touched.clear();
+
+		std::map<Anope::string, std::fstream *> journals;
+
+		/* Write objects in type order, so objects are replayed after those they depend on */
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+			std::map<Serialize::Type *, std::vector<Serializable *> >::iterator it = by_type.find(stype);
+			if (it == by_type.end())
+				continue;
+
+			const Anope::string &db_name = GetDatabase(stype->GetOwner());
+			std::fstream *&fs = journals[db_name];
+			if (!fs)
+				fs = new std::fstream((db_name + ".journal").c_str(), std::ios_base::out | std::ios_base::app);
+
+			SaveData data;
+			data.fs = fs;
+
+			for (unsigned j = 0; j < it->second.size(); ++j)
+			{
+				Serializable *obj = it->second[j];
+
+				*fs << "OBJECT " << stype->GetName() << "\nID " << obj->id;
+				data.last.clear();
+				obj->Serialize(data);
+				*fs << "\nEND\n";
+			}
+		}
+
+		for (unsigned i = 0; i < deleted.size(); ++i)
+		{
+			std::fstream *&fs = journals[deleted[i].first];
+			if (!fs)
+				fs = new std::fstream((deleted[i].first + ".journal").c_str(), std::ios_base::out | std::ios_base::app);
+
+			*fs << deleted[i].second << "\n";
+		}
+		deleted.clear();
+
+		bool ok = true;
+		for (std::map<Anope::string, std::fstream *>::iterator it = journals.begin(), it_end = journals.end(); it != it_end; ++it)
+		{
+			std::fstream *f = it->second;
+
+			if (!f->is_open() || !f->good())
+			{
+				Log(this) << "Unable to write journal " << it->first << ".journal";
+				ok = false;
+			}
+
+			f->close();
+			delete f;
+		}
+
+		/* Changes that did not make it to the journal are saved by a full save */
+		if (!ok)
+			need_compact = true;
+
+		return ok;
+	}
+
+	/** Records the size of the journals of all databases, so the records a full save makes
+	 * redundant can be dropped once it completes.
+	 */
+	void SetCheckpoints()
+	{
+		checkpoints.clear();
+
+		for (std::map<Anope::string, Serialize::Type *>::const_iterator it = Serialize::Type::GetTypes().begin(), it_end = Serialize::Type::GetTypes().end(); it != it_end; ++it)
+		{
+			const Anope::string &db_name = GetDatabase(it->second->GetOwner());
+			if (checkpoints.count(db_name))
+				continue;
+
+			std::ifstream f((db_name + ".journal").c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+			checkpoints[db_name] = f.is_open() ? static_cast<std::streamoff>(f.tellg()) : 0;
+		}
+	}
+
+	/** Drops the records up to the checkpoints from the journals, after a full save completed.
+	 * Records appended since then are kept.
+	 */
+	void TrimJournals()
+	{
+		for (std::map<Anope::string, std::streamoff>::iterator it = checkpoints.begin(), it_end = checkpoints.end(); it != it_end; ++it)
+		{
+			const Anope::string &journal_name = it->first + ".journal", &tmp_name = journal_name + ".tmp";
+
+			std::ifstream in(journal_name.c_str(), std::ios_base::in | std::ios_base::binary);
+			if (!in.is_open())
+				continue;
+
+			std::ofstream out(tmp_name.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+			in.seekg(it->second);
+			if (in.peek() != std::ifstream::traits_type::eof())
+				out << in.rdbuf();
+
+			if (!out.is_open() || !out.good())
+			{
+				Log(this) << "Unable to trim journal " << journal_name;
+				out.close();
+				unlink(tmp_name.c_str());
+				continue;
+			}
+
+			out.close();
+			in.close();
+
+			rename(tmp_name.c_str(), journal_name.c_str());
+		}
+
+		checkpoints.clear();
+	}
+
  public:
-	DBFlatFile(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE | VENDOR), last_day(0), loaded(false)
+	DBFlatFile(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE | VENDOR), last_day(0), loaded(false), loading(false), shutting_down(false),
+		journal(false), journal_compact(0), last_compact(Anope::CurTime), need_compact(false), compacting(false), unloading(false), last_id(0)
+	{
+
+	}
+
+	void OnReload(Configuration::Conf *conf) anope_override
+	{
+		Configuration::Block *block = conf->GetModule(this);
+
+		bool was_journal = this->journal;
+		this->journal = block->Get<bool>("journal");
+		this->journal_compact = block->Get<time_t>("journalcompact", "6h");
+
+		/* Changes made before the journal was enabled were not recorded */
+		if (this->journal && !was_journal && this->loaded)
+		{
+			this->need_compact = true;
+			this->AssignIds();
+		}
+		else if (!this->journal)
+		{
+			this->touched.clear();
+			this->deleted.clear();
+		}
+	}
+
+	void OnShutdown() anope_override
 	{
+		this->shutting_down = true;
+	}
 
+	void OnRestart() anope_override
+	{
+		this->shutting_down = true;
+	}
+
+	void OnModuleUnload(User *, Module *) anope_override
+	{
+		/* Objects destroyed by unloading a module are dropped by the next full save, as
+		 * they always were, instead of being journaled as deleted. This way they are still
+		 * there if the module is loaded again.
+		 */
+		this->unloading = true;
+		if (this->journal)
+			this->need_compact = true;
 	}
 
 	void OnNotify() anope_override
@@ -174,13 +669,18 @@ class DBFlatFile : public Module, public Pipe
 			return;
 		buf[i] = 0;
 
+		this->compacting = false;
+
 		if (!*buf)
 		{
 			Log(this) << "Finished saving databases";
+			this->TrimJournals();
 			return;
 		}
 
 		Log(this) << "Error saving databases: " << buf;
+		this->checkpoints.clear();
+		this->need_compact = true;
 
 		if (!Config->GetModule(this)->Get<bool>("nobackupok"))
 			Anope::Quitting = true;
@@ -189,69 +689,181 @@ class DBFlatFile : public Module, public Pipe
 	EventReturn OnLoadDatabase() anope_override
 	{
 		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
-		std::set<Anope::string> tried_dbs;
 
 		const Anope::string &db_name = Anope::DataDir + "/" + Config->GetModule(this)->Get<const Anope::string>("database", "anope.db");
 
-		std::fstream fd(db_name.c_str(), std::ios_base::in);
+		this->loading = true;
+
+		std::ifstream fd(db_name.c_str(), std::ios_base::in | std::ios_base::binary);
 		if (!fd.is_open())
-		{
 			Log(this) << "Unable to open " << db_name << " for reading!";
-			return EVENT_STOP;
-		}
+		else
+		{
+			std::string buf;
+			fd.seekg(0, std::ios_base::end);
+			std::streamoff size = fd.tellg();
+			fd.seekg(0, std::ios_base::beg);
+			if (size > 0)
+			{
+				buf.resize(size);
+				fd.read(&buf[0], size);
+			}
+			fd.close();
 
-		std::map<Anope::string, std::vector<std::streampos> > positions;
+			/* Split the database into objects */
+			std::map<Anope::string, std::vector<std::pair<const char *, const char *> > > positions;
+			std::vector<std::pair<const char *, const char *> > *blocks = NULL;
+			for (const char *p = buf.data(), *end = p + buf.size(); p < end;)
+			{
+				const char *nl = static_cast<const char *>(memchr(p, '\n', end - p)), *le = nl ? nl : end;
 
-		for (Anope::string buf; std::getline(fd, buf.str());)
-			if (buf.find("OBJECT ") == 0)
-				positions[buf.substr(7)].push_back(fd.tellg());
+				if (le - p > 7 && !memcmp(p, "OBJECT ", 7))
+				{
+					if (blocks)
+						blocks->back().second = p;
+					blocks = &positions[Anope::string(p + 7, le)];
+					blocks->push_back(std::make_pair(le + 1 < end ? le + 1 : end, end));
+				}
 
-		LoadData ld;
-		ld.fs = &fd;
+				p = le + 1;
+			}
 
-		for (unsigned i = 0; i < type_order.size(); ++i)
-		{
-			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
-			if (!stype || stype->GetOwner())
-				continue;
-				
-			std::vector<std::streampos> &pos = positions[stype->GetName()];
+			LoadQueue queue;
+			for (unsigned i = 0; i < type_order.size(); ++i)
+			{
+				Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+				if (stype && !stype->GetOwner())
+					queue.Add(stype, positions[stype->GetName()]);
+			}
+
+			/* Parse on worker threads while the main thread unserializes what they have parsed */
+			std::vector<LoadWorker *> workers;
+			unsigned threads = std::min<size_t>(Config->GetModule(this)->Get<unsigned>("loadthreads", stringify(DefaultThreads())), queue.Size());
+			for (unsigned i = 0; i < threads; ++i)
+			{
+				LoadWorker *worker = new LoadWorker(queue);
+				try
+				{
+					worker->Start();
+					workers.push_back(worker);
+				}
+				catch (const CoreException &ex)
+				{
+					Log(this) << ex.GetReason();
+					delete worker;
+					break;
+				}
+			}
+
+			timeval start;
+			gettimeofday(&start, NULL);
 
-			for (unsigned j = 0; j < pos.size(); ++j)
+			LoadData ld;
+			Serialize::Type *stype = NULL;
+			unsigned objects = 0, total = 0;
+			timeval type_start = start;
+
+			for (size_t c = 0; c < queue.Size(); ++c)
 			{
-				fd.clear();
-				fd.seekg(pos[j]);
+				LoadQueue::Chunk &chunk = queue.Get(c);
 
-				Serializable *obj = stype->Unserialize(NULL, ld);
-				if (obj != NULL)
-					obj->id = ld.id;
-				ld.Reset();
+				if (chunk.type != stype)
+				{
+					if (stype)
+						Log(LOG_DEBUG) << "db_flatfile: Loaded " << objects << " objects of type " << stype->GetName() << " in " << Elapsed(type_start) << "ms";
+					stype = chunk.type;
+					objects = 0;
+					gettimeofday(&type_start, NULL);
+				}
+
+				for (unsigned j = 0; j < chunk.objects.size(); ++j)
+				{
+					ld.Set(chunk.objects[j]);
+
+					Serializable *obj = stype->Unserialize(NULL, ld);
+					if (obj != NULL)
+					{
+						obj->id = ld.id;
+						if (obj->id)
+							stype->objects[obj->id] = obj;
+						else if (this->journal)
+							/* Saved without an id, journal records can only refer to it once a full save gives it one */
+							this->need_compact = true;
+					}
+					ld.Reset();
+				}
+
+				objects += chunk.objects.size();
+				total += chunk.objects.size();
+				/* Free the parsed objects as soon as they are used */
+				std::vector<ParsedObject>().swap(chunk.objects);
 			}
+
+			if (stype)
+				Log(LOG_DEBUG) << "db_flatfile: Loaded " << objects << " objects of type " << stype->GetName() << " in " << Elapsed(type_start) << "ms";
+
+			for (unsigned i = 0; i < workers.size(); ++i)
+			{
+				workers[i]->Join();
+				delete workers[i];
+			}
+
+			Log(this) << "Loaded " << total << " objects from " << db_name << " in " << Elapsed(start) << "ms using " << workers.size() << " worker threads";
 		}
 
-		fd.close();
+		this->ReplayJournal(db_name, NULL);
+		/* Deliver the updates queued while unserializing now, so they are not mistaken for changes to journal */
+		Serializable::ProcessUpdates();
+		this->loading = false;
+
+		this->AssignIds();
 
 		loaded = true;
 		return EVENT_STOP;
 	}
 
-
 	void OnSaveDatabase() anope_override
 	{
+		this->unloading = false;
+
+		if (this->journal && !this->need_compact && (this->compacting || this->last_compact + this->journal_compact > Anope::CurTime))
+		{
+			this->WriteJournal();
+			return;
+		}
+
+		/* The full save includes everything not yet journaled */
+		this->touched.clear();
+		this->deleted.clear();
+
+		/* Objects given ids this session must be on disk before journal records referring to
+		 * them can be replayed, so do not fork for that.
+		 */
+		bool can_fork = !this->need_compact;
+
+		this->last_compact = Anope::CurTime;
+		this->need_compact = false;
+
 		BackupDatabase();
+		SetCheckpoints();
 
 		int i = -1;
 #ifndef _WIN32
-		if (Config->GetModule(this)->Get<bool>("fork"))
+		if (can_fork && Config->GetModule(this)->Get<bool>("fork"))
 		{
 			i = fork();
 			if (i > 0)
+			{
+				this->compacting = true;
 				return;
+			}
 			else if (i < 0)
 				Log(this) << "Unable to fork for database save";
 		}
 #endif
 
+		bool failed = false;
+
 		try
 		{
 			std::map<Module *, std::fstream *> databases;
@@ -264,11 +876,7 @@ class DBFlatFile : public Module, public Pipe
 				if (databases[s_type->GetOwner()])
 					continue;
 
-				Anope::string db_name;
-				if (s_type->GetOwner())
-					db_name = Anope::DataDir + "/module_" + s_type->GetOwner()->name + ".db";
-				else
-					db_name = Anope::DataDir + "/" + Config->GetModule(this)->Get<const Anope::string>("database", "anope.db");
+				const Anope::string &db_name = GetDatabase(s_type->GetOwner());
 
 				if (Anope::IsFile(db_name))
 					rename(db_name.c_str(), (db_name + ".tmp").c_str());
@@ -286,13 +894,16 @@ class DBFlatFile : public Module, public Pipe
 				Serializable *base = *it;
 				Serialize::Type *s_type = base->GetSerializableType();
 
-				data.fs = databases[s_type->GetOwner()];
-				if (!data.fs || !data.fs->is_open())
+				std::fstream *fs = databases[s_type->GetOwner()];
+				if (!fs || !fs->is_open())
 					continue;
 
+				data.fs = fs;
+
 				*data.fs << "OBJECT " << s_type->GetName();
 				if (base->id)
 					*data.fs << "\nID " << base->id;
+				data.last.clear();
 				base->Serialize(data);
 				*data.fs << "\nEND\n";
 			}
@@ -300,11 +911,12 @@ class DBFlatFile : public Module, public Pipe
 			for (std::map<Module *, std::fstream *>::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
 			{
 				std::fstream *f = it->second;
-				const Anope::string &db_name = Anope::DataDir + "/" + (it->first ? (it->first->name + ".db") : Config->GetModule(this)->Get<const Anope::string>("database"));
+				const Anope::string &db_name = GetDatabase(it->first);
 
 				if (!f->is_open() || !f->good())
 				{
 					this->Write("Unable to write database " + db_name);
+					failed = true;
 
 					f->close();
 
@@ -331,6 +943,51 @@ class DBFlatFile : public Module, public Pipe
 			this->Notify();
 			exit(0);
 		}
+
+		if (!failed)
+			this->TrimJournals();
+		else
+		{
+			this->checkpoints.clear();
+			this->need_compact = true;
+		}
+	}
+
+	void OnSerializableConstruct(Serializable *obj) anope_override
+	{
+		/* Objects created before the databases are loaded are given ids afterwards */
+		if (!this->journal || !this->loaded || this->loading || this->shutting_down)
+			return;
+
+		Serialize::Type *s_type = obj->GetSerializableType();
+		if (!s_type)
+			return;
+
+		obj->id = ++this->last_id;
+		s_type->objects[obj->id] = obj;
+		this->touched.insert(obj);
+	}
+
+	void OnSerializableUpdate(Serializable *obj) anope_override
+	{
+		if (this->journal && this->loaded && !this->loading && obj->id)
+			this->touched.insert(obj);
+	}
+
+	void OnSerializableDestruct(Serializable *obj) anope_override
+	{
+		this->touched.erase(obj);
+
+		Serialize::Type *s_type = obj->GetSerializableType();
+		if (!s_type || !obj->id)
+			return;
+
+		std::map<uint64_t, Serializable *>::iterator it = s_type->objects.find(obj->id);
+		if (it != s_type->objects.end() && it->second == obj)
+			s_type->objects.erase(it);
+
+		if (this->journal && this->loaded && !this->loading && !this->shutting_down && !this->unloading)
+			this->deleted.push_back(std::make_pair(GetDatabase(s_type->GetOwner()), "DELETE " + s_type->GetName() + " " + stringify(obj->id)));
 	}
 
 	/* Load just one type. Done if a module is reloaded during runtime */
@@ -339,35 +996,43 @@ class DBFlatFile : public Module, public Pipe
 		if (!loaded)
 			return;
 
-		Anope::string db_name;
-		if (stype->GetOwner())
-			db_name = Anope::DataDir + "/module_" + stype->GetOwner()->name + ".db";
-		else
-			db_name = Anope::DataDir + "/" + Config->GetModule(this)->Get<const Anope::string>("database", "anope.db");
+		const Anope::string &db_name = GetDatabase(stype->GetOwner());
+
+		this->loading = true;
 
 		std::fstream fd(db_name.c_str(), std::ios_base::in);
 		if (!fd.is_open())
-		{
 			Log(this) << "Unable to open " << db_name << " for reading!";
-			return;
-		}
-
-		LoadData ld;
-		ld.fs = &fd;
-
-		for (Anope::string buf; std::getline(fd, buf.str());)
+		else
 		{
-			if (buf == "OBJECT " + stype->GetName())
+			LoadData ld;
+			ld.fs = &fd;
+
+			for (Anope::string buf; std::getline(fd, buf.str());)
 			{
-				stype->Unserialize(NULL, ld);
-				ld.Reset();
+				if (buf == "OBJECT " + stype->GetName())
+				{
+					Serializable *obj = stype->Unserialize(NULL, ld);
+					if (obj != NULL && ld.id)
+					{
+						obj->id = ld.id;
+						stype->objects[obj->id] = obj;
+					}
+					else if (obj != NULL && !obj->id && this->journal)
+						this->need_compact = true;
+					ld.Reset();
+				}
 			}
+
+			fd.close();
 		}
 
-		fd.close();
+		this->ReplayJournal(db_name, stype);
+		Serializable::ProcessUpdates();
+		this->loading = false;
+
+		this->AssignIds();
 	}
 };
 
 MODULE_INIT(DBFlatFile)
-
-
@@ -32,26 +32,33 @@ class SQLSQLInterface : public Interface
 	}
 };
 
-class ResultSQLSQLInterface : public SQLSQLInterface
+class DBSQL;
+
+/** Receives the result of each query of a flush, which are run as one transaction
+ */
+class FlushSQLSQLInterface : public SQLSQLInterface
 {
-	Reference<Serializable> obj;
+	DBSQL *dbsql;
+	/* The number of rows each query writes, and the new object it inserts if any */
+	std::vector<std::pair<unsigned, Reference<Serializable> > > writes;
+	/* Results received so far */
+	unsigned done;
+	/* Rows written so far */
+	unsigned rows;
+	bool failed;
 
-public:
-	ResultSQLSQLInterface(Module *o, Serializable *ob) : SQLSQLInterface(o), obj(ob) { }
+	void Done();
 
-	void OnResult(const Result &r) anope_override
-	{
-		SQLSQLInterface::OnResult(r);
-		if (r.GetID() > 0 && this->obj)
-			this->obj->id = r.GetID();
-		delete this;
-	}
+ public:
+	FlushSQLSQLInterface(Module *o, DBSQL *d) : SQLSQLInterface(o), dbsql(d), done(0), rows(0), failed(false) { }
 
-	void OnError(const Result &r) anope_override
+	void AddWrite(unsigned r, Serializable *obj = NULL)
 	{
-		SQLSQLInterface::OnError(r);
-		delete this;
+		this->writes.push_back(std::make_pair(r, Reference<Serializable>(obj)));
 	}
+
+	void OnResult(const Result &r) anope_override;
+	void OnError(const Result &r) anope_override;
 };
 
 class DBSQL : public Module, public Pipe
@@ -62,12 +69,45 @@ class DBSQL : public Module, public Pipe
 	bool import;
 
 	std::set<Serializable *> updated_items;
+	/* Ids of destroyed objects waiting to be deleted, by table */
+	std::map<Anope::string, std::vector<uint64_t> > deleted_items;
 	bool shutting_down;
 	bool loading_databases;
 	bool loaded;
 	bool imported;
 
-	void RunBackground(const Query &q, Interface *iface = NULL)
+	/* Maximum number of rows written by one query */
+	unsigned batch_size;
+	/* How long to collect changes for before writing them, 0 to write them immediately */
+	time_t flush_interval;
+
+	class FlushTimer : public Timer
+	{
+		DBSQL *dbsql;
+
+	 public:
+		FlushTimer(DBSQL *d, time_t delay) : Timer(delay), dbsql(d) { }
+
+		void Tick(time_t) anope_override
+		{
+			dbsql->flush_timer = NULL;
+			dbsql->OnNotify();
+		}
+	};
+	FlushTimer *flush_timer;
+
+	/* Rows written since write_start, to report the write rate */
+	unsigned long rows_written;
+	time_t write_start;
+
+	/* The flush being written, if any */
+	FlushSQLSQLInterface *flushing;
+	/* The objects written by the current flush and their data, which is cached once it is committed */
+	std::vector<std::pair<Reference<Serializable>, Data *> > written_items;
+	/* Ids deleted by the current flush, to delete again if it fails */
+	std::map<Anope::string, std::vector<uint64_t> > deleting_items;
+
+	bool CheckSQL()
 	{
 		if (!this->sql)
 		{
@@ -77,19 +117,104 @@ class DBSQL : public Module, public Pipe
 				last_warn = Anope::CurTime;
 				Log(this) << "db_sql: Unable to execute query, is SQL configured correctly?";
 			}
+			return false;
+		}
+		return true;
+	}
+
+	void RunNow(const Query &q)
+	{
+		Result r = this->sql->RunQuery(q);
+		if (r)
+			this->sqlinterface.OnResult(r);
+		else
+			this->sqlinterface.OnError(r);
+	}
+
+	/** Whether writes have to be done synchronously. Until the first write is done we are importing
+	 * objects from another database module, so don't do asynchronous queries in case the core has
+	 * to shut down, it will cut short the import
+	 */
+	bool WriteNow() const
+	{
+		return !this->imported || Anope::Quitting;
+	}
+
+	/** Run a query writing objects
+	 */
+	void RunWrite(const Query &q)
+	{
+		if (!this->CheckSQL())
+			return;
+		else if (!this->WriteNow())
+			this->sql->Run(&this->sqlinterface, q);
+		else
+			this->RunNow(q);
+	}
+
+	/** Run the queries of a flush, as one transaction
+	 */
+	void RunFlush(FlushSQLSQLInterface *flush, const std::vector<Query> &queries)
+	{
+		if (!this->WriteNow())
+		{
+			this->sql->RunTransaction(flush, queries);
+			return;
 		}
-		else if (!Anope::Quitting)
+
+		std::vector<Result> results = this->sql->RunTransactionQuery(queries);
+		/* The interface deletes itself once it has every result */
+		for (unsigned i = 0; i < results.size(); ++i)
+			if (results[i])
+				flush->OnResult(results[i]);
+			else
+				flush->OnError(results[i]);
+	}
+
+	/** Called when the current flush is done, or abandoned. If it succeeded the objects written
+	 * are cached, otherwise they are queued to be written again later.
+	 */
+	void EndFlush(bool failed)
+	{
+		this->flushing = NULL;
+
+		for (unsigned i = 0; i < this->written_items.size(); ++i)
 		{
-			if (iface == NULL)
-				iface = &this->sqlinterface;
-			this->sql->Run(iface, q);
+			Serializable *obj = this->written_items[i].first;
+			if (obj)
+			{
+				if (!failed)
+					obj->UpdateCache(*this->written_items[i].second);
+				else
+					this->updated_items.insert(obj);
+			}
+			delete this->written_items[i].second;
 		}
+		this->written_items.clear();
+
+		if (failed)
+			for (std::map<Anope::string, std::vector<uint64_t> >::iterator it = this->deleting_items.begin(), it_end = this->deleting_items.end(); it != it_end; ++it)
+			{
+				std::vector<uint64_t> &ids = this->deleted_items[it->first];
+				ids.insert(ids.end(), it->second.begin(), it->second.end());
+			}
+		this->deleting_items.clear();
+	}
+
+	void Schedule()
+	{
+		/* Also waits out the delay before retrying a failed flush */
+		if (this->flush_timer)
+			return;
+		else if (!this->flush_interval)
+			this->Notify();
 		else
-			this->sql->RunQuery(q);
+			this->flush_timer = new FlushTimer(this, this->flush_interval);
 	}
 
  public:
-	DBSQL(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE | VENDOR), sql("", ""), sqlinterface(this), shutting_down(false), loading_databases(false), loaded(false), imported(false)
+	DBSQL(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE | VENDOR), sql("", ""), sqlinterface(this), shutting_down(false), loading_databases(false), loaded(false), imported(false),
+		batch_size(500), flush_interval(0), flush_timer(NULL), rows_written(0), write_start(Anope::CurTime), flushing(NULL)
 	{
 
 
@@ -97,51 +222,171 @@ class DBSQL : public Module, public Pipe
 			throw ModuleException("db_sql can not be loaded after db_sql_live");
 	}
 
+	~DBSQL()
+	{
+		delete this->flush_timer;
+		for (unsigned i = 0; i < this->written_items.size(); ++i)
+			delete this->written_items[i].second;
+	}
+
+	/** Called when every query of a flush has finished. The SQL module has committed it, or rolled
+	 * it back if any of them failed.
+	 */
+	void OnFlushDone(FlushSQLSQLInterface *flush, bool ok, unsigned rows)
+	{
+		/* A flush abandoned on shutdown */
+		if (flush != this->flushing)
+			return;
+
+		if (!ok)
+		{
+			Log(this) << "db_sql: Unable to write changes to the database, retrying in 60 seconds";
+			this->EndFlush(true);
+			if (!this->flush_timer)
+				this->flush_timer = new FlushTimer(this, 60);
+		}
+		else
+		{
+			this->rows_written += rows;
+			this->EndFlush(false);
+			if (!this->updated_items.empty() || !this->deleted_items.empty())
+				this->Schedule();
+		}
+	}
+
 	void OnNotify() anope_override
 	{
+		typedef std::vector<std::pair<unsigned int, Data *> > Rows;
+		/* Objects which already have an id are written in batches, by table */
+		std::map<Anope::string, Rows> batches;
+		/* New objects are inserted one at a time to learn their ids */
+		std::vector<std::pair<Query, Serializable *> > inserts;
+
+		if (this->flushing)
+		{
+			/* Wait for the last flush, it schedules another one when it is done */
+			if (!this->shutting_down)
+				return;
+
+			/* Shutting down can not wait for it, so write everything in it again */
+			this->EndFlush(true);
+		}
+
 		for (std::set<Serializable *>::iterator it = this->updated_items.begin(), it_end = this->updated_items.end(); it != it_end; ++it)
 		{
 			Serializable *obj = *it;
 
 			if (this->sql)
 			{
-				Data data;
-				obj->Serialize(data);
+				Data *data = new Data();
+				obj->Serialize(*data);
 
-				if (obj->IsCached(data))
+				if (obj->IsCached(*data))
+				{
+					delete data;
 					continue;
+				}
 
-				obj->UpdateCache(data);
+				Serialize::Type *s_type = obj->GetSerializableType();
 
 				/* If we didn't load these objects and we don't want to import just update the cache and continue */
-				if (!this->loaded && !this->imported && !this->import)
+				if ((!this->loaded && !this->imported && !this->import) || !s_type)
+				{
+					obj->UpdateCache(*data);
+					delete data;
 					continue;
+				}
 
-				Serialize::Type *s_type = obj->GetSerializableType();
-				if (!s_type)
-					continue;
+				const Anope::string table = this->prefix + s_type->GetName();
 
-				std::vector<Query> create = this->sql->CreateTable(this->prefix + s_type->GetName(), data);
+				/* Schema changes must not be made within the transaction below */
+				std::vector<Query> create = this->sql->CreateTable(table, *data);
 				for (unsigned i = 0; i < create.size(); ++i)
-					this->RunBackground(create[i]);
+					this->RunWrite(create[i]);
+
+				/* The data is cached only once the flush writing it is committed */
+				this->written_items.push_back(std::make_pair(obj, data));
 
-				Query insert = this->sql->BuildInsert(this->prefix + s_type->GetName(), obj->id, data);
-				if (this->imported)
-					this->RunBackground(insert, new ResultSQLSQLInterface(this, obj));
+				if (obj->id > 0)
+					batches[table].push_back(std::make_pair(obj->id, data));
 				else
 				{
-					/* We are importing objects from another database module, so don't do asynchronous
-					 * queries in case the core has to shut down, it will cut short the import
-					 */
-					Result r = this->sql->RunQuery(insert);
-					if (r.GetID() > 0)
-						obj->id = r.GetID();
+					inserts.push_back(std::make_pair(this->sql->BuildInsert(table, obj->id, *data), obj));
+					inserts.back().first.prepare = true;
 				}
 			}
 		}
 
 		this->updated_items.clear();
+
+		if ((!batches.empty() || !inserts.empty() || !this->deleted_items.empty()) && this->CheckSQL())
+		{
+			FlushSQLSQLInterface *flush = new FlushSQLSQLInterface(this, this);
+			std::vector<Query> queries;
+			unsigned long rows = 0;
+
+			this->deleting_items.swap(this->deleted_items);
+
+			for (std::map<Anope::string, std::vector<uint64_t> >::iterator it = this->deleting_items.begin(), it_end = this->deleting_items.end(); it != it_end; ++it)
+			{
+				const std::vector<uint64_t> &ids = it->second;
+				for (unsigned i = 0; i < ids.size(); i += this->batch_size)
+				{
+					unsigned count = std::min<unsigned>(ids.size() - i, this->batch_size);
+					Anope::string query_text = "DELETE FROM `" + it->first + "` WHERE `id` IN (";
+					for (unsigned j = 0; j < count; ++j)
+						query_text += (j ? "," : "") + stringify(ids[i + j]);
+					query_text += ")";
+
+					queries.push_back(query_text);
+					flush->AddWrite(count);
+					rows += count;
+				}
+			}
+
+			for (std::map<Anope::string, Rows>::iterator it = batches.begin(), it_end = batches.end(); it != it_end; ++it)
+			{
+				const Rows &all = it->second;
+				for (unsigned i = 0; i < all.size(); i += this->batch_size)
+				{
+					Rows batch(all.begin() + i, all.begin() + std::min<size_t>(all.size(), i + this->batch_size));
+					Query query = this->sql->BuildBatchInsert(it->first, batch);
+					/* Full batches of a table are all the same statement, the rest are not worth preparing */
+					query.prepare = batch.size() == this->batch_size;
+					queries.push_back(query);
+					flush->AddWrite(batch.size());
+					rows += batch.size();
+				}
+			}
+
+			for (unsigned i = 0; i < inserts.size(); ++i)
+			{
+				queries.push_back(inserts[i].first);
+				flush->AddWrite(1, inserts[i].second);
+				++rows;
+			}
+
+			Log(LOG_DEBUG) << "db_sql: Writing " << rows << " rows using " << queries.size() << " queries";
+
+			this->flushing = flush;
+			this->RunFlush(flush, queries);
+		}
+		else
+		{
+			this->EndFlush(false);
+			this->deleted_items.clear();
+		}
+
+		/* Only now that the first flush has been written may later ones run in the background */
 		this->imported = true;
+
+		if (Anope::CurTime - this->write_start >= 60)
+		{
+			if (this->rows_written)
+				Log(LOG_DEBUG) << "db_sql: Wrote " << this->rows_written << " rows in the last " << (Anope::CurTime - this->write_start) << " seconds (" << this->rows_written / (Anope::CurTime - this->write_start) << " rows/s)";
+			this->rows_written = 0;
+			this->write_start = Anope::CurTime;
+		}
 	}
 
 	void OnReload(Configuration::Conf *conf) anope_override
@@ -150,6 +395,8 @@ class DBSQL : public Module, public Pipe
 		this->sql = ServiceReference<Provider>("SQL::Provider", block->Get<const Anope::string>("engine"));
 		this->prefix = block->Get<const Anope::string>("prefix", "anope_db_");
 		this->import = block->Get<bool>("import");
+		this->batch_size = std::max(1, block->Get<int>("batchsize", "500"));
+		this->flush_interval = block->Get<time_t>("flushinterval");
 	}
 
 	void OnShutdown() anope_override
@@ -190,9 +437,8 @@ class DBSQL : public Module, public Pipe
 	{
 		if (this->shutting_down || this->loading_databases)
 			return;
-		obj->UpdateTS();
 		this->updated_items.insert(obj);
-		this->Notify();
+		this->Schedule();
 	}
 
 	void OnSerializableDestruct(Serializable *obj) anope_override
@@ -201,17 +447,19 @@ class DBSQL : public Module, public Pipe
 			return;
 		Serialize::Type *s_type = obj->GetSerializableType();
 		if (s_type && obj->id > 0)
-			this->RunBackground("DELETE FROM `" + this->prefix + s_type->GetName() + "` WHERE `id` = " + stringify(obj->id));
+		{
+			this->deleted_items[this->prefix + s_type->GetName()].push_back(obj->id);
+			this->Schedule();
+		}
 		this->updated_items.erase(obj);
 	}
 
 	void OnSerializableUpdate(Serializable *obj) anope_override
 	{
-		if (this->shutting_down || obj->IsTSCached())
+		if (this->shutting_down)
 			return;
-		obj->UpdateTS();
 		this->updated_items.insert(obj);
-		this->Notify();
+		this->Schedule();
 	}
 
 	void OnSerializeTypeCreate(Serialize::Type *sb) anope_override
@@ -256,5 +504,33 @@ class DBSQL : public Module, public Pipe
 	}
 };
 
+void FlushSQLSQLInterface::OnResult(const Result &r)
+{
+	SQLSQLInterface::OnResult(r);
+
+	std::pair<unsigned, Reference<Serializable> > &write = this->writes[this->done];
+	if (write.second && r.GetID() > 0)
+		write.second->id = r.GetID();
+	this->rows += write.first;
+
+	this->Done();
+}
+
+void FlushSQLSQLInterface::OnError(const Result &r)
+{
+	SQLSQLInterface::OnError(r);
+	this->failed = true;
+	this->Done();
+}
+
+void FlushSQLSQLInterface::Done()
+{
+	if (++this->done < this->writes.size())
+		return;
+
+	this->dbsql->OnFlushDone(this, !this->failed, this->rows);
+	delete this;
+}
+
 MODULE_INIT(DBSQL)
 
@@ -102,7 +102,9 @@ class DBMySQL : public Module, public Pipe
 				for (unsigned i = 0; i < create.size(); ++i)
 					this->RunQueryResult(create[i]);
 
-				Result res = this->RunQueryResult(this->SQL->BuildInsert(this->prefix + s_type->GetName(), obj->id, data));
+				Query insert = this->SQL->BuildInsert(this->prefix + s_type->GetName(), obj->id, data);
+				insert.prepare = true;
+				Result res = this->RunQueryResult(insert);
 				if (res.GetID() && obj->id != res.GetID())
 				{
 					/* In this case obj is new, so place it into the object map */
@@ -142,7 +144,6 @@ class DBMySQL : public Module, public Pipe
 	{
 		if (!this->CheckInit())
 			return;
-		obj->UpdateTS();
 		this->updated_items.insert(obj);
 		this->Notify();
 	}
@@ -155,7 +156,11 @@ class DBMySQL : public Module, public Pipe
 		if (s_type)
 		{
 			if (obj->id > 0)
-				this->RunQuery("DELETE FROM `" + this->prefix + s_type->GetName() + "` WHERE `id` = " + stringify(obj->id));
+			{
+				Query query("DELETE FROM `" + this->prefix + s_type->GetName() + "` WHERE `id` = @id@", true);
+				query.SetValue("id", obj->id);
+				this->RunQuery(query);
+			}
 			s_type->objects.erase(obj->id);
 		}
 		this->updated_items.erase(obj);
@@ -242,9 +247,8 @@ class DBMySQL : public Module, public Pipe
 
 	void OnSerializableUpdate(Serializable *obj) anope_override
 	{
-		if (!this->CheckInit() || obj->IsTSCached())
+		if (!this->CheckInit())
 			return;
-		obj->UpdateTS();
 		this->updated_items.insert(obj);
 		this->Notify();
 	}
@@ -386,7 +386,10 @@ class EMD5 : public Module
 			 * we want to re-encrypt the pass with the new encryption
 			 */
 			if (ModuleManager::FindFirstOf(ENCRYPTION) != this)
+			{
 				Anope::Encrypt(req->GetPassword(), nc->pass);
+				nc->QueueUpdate();
+			}
 			req->Success(this);
 		}
 	}
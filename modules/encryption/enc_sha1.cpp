@@ -238,7 +238,10 @@ class ESHA1 : public Module
 		if (nc->pass.equals_cs(buf))
 		{
 			if (ModuleManager::FindFirstOf(ENCRYPTION) != this)
+			{
 				Anope::Encrypt(req->GetPassword(), nc->pass);
+				nc->QueueUpdate();
+			}
 			req->Success(this);
 		}
 	}
@@ -118,16 +118,20 @@ class MyHTTPClient : public HTTPClient
 	{
 		message.content.append(buffer, l);
 
-		for (size_t nl; !this->header_done && (nl = message.content.find('\n')) != Anope::string::npos;)
+		/* Consume header lines by offset, and only remove them from the buffer once done */
+		size_t pos = 0;
+		for (size_t nl; !this->header_done && (nl = message.content.find('\n', pos)) != Anope::string::npos;)
 		{
-			Anope::string token = message.content.substr(0, nl).trim();
-			message.content = message.content.substr(nl + 1);
+			Anope::string token = message.content.substr(pos, nl - pos).trim();
+			pos = nl + 1;
 
 			if (token.empty())
 				this->header_done = true;
 			else
 				this->Read(token);
 		}
+		if (pos)
+			message.content.erase(0, pos);
 
 		if (!this->header_done)
 			return true;
@@ -345,10 +349,9 @@ class HTTPD : public Module
 
 	~HTTPD()
 	{
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
 
 			if (dynamic_cast<MyHTTPProvider *>(s) || dynamic_cast<MyHTTPClient *>(s))
 				delete s;
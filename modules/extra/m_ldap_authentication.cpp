@@ -110,6 +110,7 @@ class IdentifyInterface : public LDAPInterface
 					}
 					// encrypt and store the password in the nickcore
 					Anope::Encrypt(ii->req->GetPassword(), na->nc->pass);
+					na->nc->QueueUpdate();
 
 					na->nc->Extend<Anope::string>("m_ldap_authentication_dn", ii->dn);
 					ii->req->Success(me);
@@ -165,6 +166,7 @@ class OnIdentifyInterface : public LDAPInterface
 			if (!email.equals_ci(u->Account()->email))
 			{
 				u->Account()->email = email;
+				u->Account()->QueueUpdate();
 				BotInfo *NickServ = Config->GetClient("NickServ");
 				if (NickServ)
 					u->SendMessage(NickServ, _("Your email has been updated to \002%s\002"), email.c_str());
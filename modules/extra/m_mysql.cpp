@@ -4,33 +4,77 @@
 #include "modules/sql.h"
 #define NO_CLIENT_LONG_LONG
 #include <mysql/mysql.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
 
 using namespace SQL;
 
 /** Non blocking threaded MySQL API, based loosely from InspIRCd's m_mysql.cpp
  *
- * This module spawns a single thread that is used to execute blocking MySQL queries.
- * When a module requests a query to be executed it is added to a list for the thread
- * (which never stops looping and sleeing) to pick up and execute, the result of which
+ * This module spawns worker threads that are used to execute blocking MySQL queries.
+ * When a module requests a query to be executed it is added to a list for the threads
+ * (which never stop looping and sleeping) to pick up and execute, the result of which
  * is inserted in to another queue to be picked up by the main thread. The main thread
  * uses Pipe to become notified through the socket engine when there are results waiting
- * to be sent back to the modules requesting the query
+ * to be sent back to the modules requesting the query.
+ *
+ * Each service has a pool of connections. All queries from one module are run on the
+ * same connection of a service in the order they were requested, so modules relying
+ * on the order of their queries keep working, while queries from different modules
+ * can run at the same time. Transactions requested with RunTransaction are executed
+ * on their connection as one request, so no other query ever ends up in them.
+ *
+ * Queries which ask to be prepared are executed as prepared statements, which each
+ * connection keeps so later queries with the same text only bind their parameters.
+ * Queries the server can not prepare are run as text queries instead.
  */
 
 class MySQLService;
 
+/** A connection to a database, each service has a pool of these
+ */
+struct Connection
+{
+	MYSQL *sql;
+	/* Held while a query is executing on this connection */
+	Mutex Lock;
+	/* Prepared statements, by the text they were prepared from, NULL if the server could not prepare it */
+	std::map<Anope::string, MYSQL_STMT *> statements;
+
+	Connection() : sql(NULL) { }
+
+	void ClearStatements()
+	{
+		for (std::map<Anope::string, MYSQL_STMT *>::iterator it = this->statements.begin(), it_end = this->statements.end(); it != it_end; ++it)
+			if (it->second)
+				mysql_stmt_close(it->second);
+		this->statements.clear();
+	}
+};
+
 /** A query request
  */
 struct QueryRequest
 {
-	/* The connection to the database */
+	/* The service the query is for, NULL if it went away while the query was running */
 	MySQLService *service;
+	/* The connection the query must be run on */
+	Connection *conn;
 	/* The interface to use once we have the result to send the data back */
 	Interface *sqlinterface;
 	/* The actual query */
 	Query query;
+	/* The queries of a transaction, which are run instead of query */
+	std::vector<Query> transaction;
+	/* Whether a thread is executing this query now */
+	bool running;
+	/* When this request was made, in milliseconds */
+	unsigned long queued_at;
+
+	QueryRequest(MySQLService *s, Connection *c, Interface *i, const Query &q, unsigned long t) : service(s), conn(c), sqlinterface(i), query(q), running(false), queued_at(t) { }
 
-	QueryRequest(MySQLService *s, Interface *i, const Query &q) : service(s), sqlinterface(i), query(q) { }
+	QueryRequest(MySQLService *s, Connection *c, Interface *i, const std::vector<Query> &q, unsigned long t) : service(s), conn(c), sqlinterface(i), transaction(q), running(false), queued_at(t) { }
 };
 
 /** A query result */
@@ -85,6 +129,11 @@ class MySQLResult : public Result
 	{
 	}
 
+	void AddRow(const std::map<Anope::string, Anope::string> &data)
+	{
+		this->entries.push_back(data);
+	}
+
 	~MySQLResult()
 	{
 		if (this->res)
@@ -92,7 +141,7 @@ class MySQLResult : public Result
 	}
 };
 
-/** A MySQL connection, there can be multiple
+/** A MySQL database, there can be multiple
  */
 class MySQLService : public Provider
 {
@@ -104,46 +153,105 @@ class MySQLService : public Provider
 	Anope::string password;
 	int port;
 
-	MYSQL *sql;
+	/* The connection pool */
+	std::vector<Connection *> connections;
+	/* The connection queries from each module are run on */
+	std::map<Module *, Connection *> lanes;
+	unsigned next_lane;
 
 	/** Escape a query.
-	 * Note the mutex must be held!
+	 * Note the connection's mutex must be held!
 	 */
-	Anope::string Escape(const Anope::string &query);
+	Anope::string Escape(Connection *conn, const Anope::string &query);
 
- public:
-	/* Locked by the SQL thread when a query is pending on this database,
-	 * prevents us from deleting a connection while a query is executing
-	 * in the thread
+	/** Build the text of a query to prepare, with a placeholder for each use of an escaped parameter.
+	 * @param q The query
+	 * @param values Filled in with the value to bind to each placeholder
+	 * @return The text, or an empty string if the query has too many parameters to bind
 	 */
-	Mutex Lock;
+	Anope::string BuildStatement(const Query &q, std::vector<const Anope::string *> &values);
+
+	/** Find or prepare the statement for the text of a query.
+	 * Note the connection's mutex must be held, and the connection checked!
+	 * @return The statement, or NULL if it can not be prepared and the query must be run as text
+	 */
+	MYSQL_STMT *Prepare(Connection *conn, const Anope::string &statement);
+
+	/** Execute a query as a prepared statement.
+	 * Note the connection's mutex must be held, and the connection checked!
+	 */
+	Result ExecuteStatement(Connection *conn, MYSQL_STMT *stmt, const Query &query, const Anope::string &statement, const std::vector<const Anope::string *> &values);
+
+	/** Queue a request on the connection queries from its module are run on
+	 */
+	void Queue(Interface *i, const Query &query, const std::vector<Query> &transaction);
+
+	/** Find a connection for a query run now, preferring one no thread is using
+	 */
+	Connection *GetFreeConnection();
+
+ public:
+	/* Statistics, protected by the dispatcher lock */
+	unsigned queued, running;
+	unsigned long completed, errors, wait_time, exec_time, max_latency;
 
-	MySQLService(Module *o, const Anope::string &n, const Anope::string &d, const Anope::string &s, const Anope::string &u, const Anope::string &p, int po);
+	MySQLService(Module *o, const Anope::string &n, const Anope::string &d, const Anope::string &s, const Anope::string &u, const Anope::string &p, int po, unsigned pool);
 
 	~MySQLService();
 
+	unsigned GetConnections() const { return this->connections.size(); }
+
+	/** Forget the connection queries from a module are run on
+	 * @param m The module
+	 */
+	void RemoveLane(Module *m) { this->lanes.erase(m); }
+
 	void Run(Interface *i, const Query &query) anope_override;
 
 	Result RunQuery(const Query &query) anope_override;
 
+	void RunTransaction(Interface *i, const std::vector<Query> &queries) anope_override;
+
+	std::vector<Result> RunTransactionQuery(const std::vector<Query> &queries) anope_override;
+
+	/** Execute a query on a specific connection, blocking until it is done.
+	 * Note the connection's mutex must be held!
+	 * @param conn The connection
+	 * @param query The query
+	 * @return The result
+	 */
+	Result Execute(Connection *conn, const Query &query);
+
+	/** Execute queries in one transaction on a specific connection, which is rolled back if any of them fails.
+	 * Note the connection's mutex must be held!
+	 * @param conn The connection
+	 * @param queries The queries
+	 * @param results Filled in with the result of each query
+	 */
+	void ExecuteTransaction(Connection *conn, const std::vector<Query> &queries, std::vector<Result> &results);
+
+	bool GetStats(Stats &stats) anope_override;
+
 	std::vector<Query> CreateTable(const Anope::string &table, const Data &data) anope_override;
 
 	Query BuildInsert(const Anope::string &table, unsigned int id, Data &data) anope_override;
 
+	Query BuildBatchInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows) anope_override;
+
 	Query GetTables(const Anope::string &prefix) anope_override;
 
-	void Connect();
+	void Connect(Connection *conn);
 
-	bool CheckConnection();
+	bool CheckConnection(Connection *conn);
 
-	Anope::string BuildQuery(const Query &q);
+	Anope::string BuildQuery(Connection *conn, const Query &q);
 
 	Anope::string FromUnixtime(time_t);
 };
 
-/** The SQL thread used to execute queries
+/** A thread used to execute queries
  */
-class DispatcherThread : public Thread, public Condition
+class DispatcherThread : public Thread
 {
  public:
 	DispatcherThread() : Thread() { }
@@ -151,6 +259,19 @@ class DispatcherThread : public Thread, public Condition
 	void Run() anope_override;
 };
 
+/** The time now in milliseconds, for measuring query latency
+ */
+static unsigned long Now()
+{
+#ifndef _WIN32
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+#else
+	return GetTickCount();
+#endif
+}
+
 class ModuleSQL;
 static ModuleSQL *me;
 class ModuleSQL : public Module, public Pipe
@@ -158,20 +279,20 @@ class ModuleSQL : public Module, public Pipe
 	/* SQL connections */
 	std::map<Anope::string, MySQLService *> MySQLServices;
  public:
+	/* Protects the request queues and the statistics, and is signalled when there are new requests */
+	Condition Dispatcher;
 	/* Pending query requests */
-	std::deque<QueryRequest> QueryRequests;
+	std::list<QueryRequest> QueryRequests;
+	/* Connections a thread is executing a query on */
+	std::set<Connection *> Busy;
 	/* Pending finished requests with results */
 	std::deque<QueryResult> FinishedRequests;
-	/* The thread used to execute queries */
-	DispatcherThread *DThread;
+	/* The threads used to execute queries */
+	std::vector<DispatcherThread *> DThreads;
 
 	ModuleSQL(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, EXTRA | VENDOR)
 	{
 		me = this;
-
-
-		DThread = new DispatcherThread();
-		DThread->Start();
 	}
 
 	~ModuleSQL()
@@ -180,10 +301,18 @@ class ModuleSQL : public Module, public Pipe
 			delete it->second;
 		MySQLServices.clear();
 
-		DThread->SetExitState();
-		DThread->Wakeup();
-		DThread->Join();
-		delete DThread;
+		this->Dispatcher.Lock();
+		for (unsigned i = 0; i < this->DThreads.size(); ++i)
+			this->DThreads[i]->SetExitState();
+		for (unsigned i = 0; i < this->DThreads.size(); ++i)
+			this->Dispatcher.Wakeup();
+		this->Dispatcher.Unlock();
+
+		for (unsigned i = 0; i < this->DThreads.size(); ++i)
+		{
+			this->DThreads[i]->Join();
+			delete this->DThreads[i];
+		}
 	}
 
 	void OnReload(Configuration::Conf *conf) anope_override
@@ -223,10 +352,11 @@ class ModuleSQL : public Module, public Pipe
 				const Anope::string &user = block->Get<const Anope::string>("username", "anope");
 				const Anope::string &password = block->Get<const Anope::string>("password");
 				int port = block->Get<int>("port", "3306");
+				unsigned pool = std::max(1, block->Get<int>("connections", "1"));
 
 				try
 				{
-					MySQLService *ss = new MySQLService(this, connname, database, server, user, password, port);
+					MySQLService *ss = new MySQLService(this, connname, database, server, user, password, port, pool);
 					this->MySQLServices.insert(std::make_pair(connname, ss));
 
 					Log(LOG_NORMAL, "mysql") << "MySQL: Successfully connected to server " << connname << " (" << server << ")";
@@ -237,39 +367,56 @@ class ModuleSQL : public Module, public Pipe
 				}
 			}
 		}
+
+		/* One thread per connection, more could only wait for a connection to be free */
+		unsigned threads = 0;
+		for (std::map<Anope::string, MySQLService *>::iterator it = this->MySQLServices.begin(); it != this->MySQLServices.end(); ++it)
+			threads += it->second->GetConnections();
+		while (this->DThreads.size() < threads)
+		{
+			DispatcherThread *thread = new DispatcherThread();
+			thread->Start();
+			this->DThreads.push_back(thread);
+		}
 	}
 
 	void OnModuleUnload(User *, Module *m) anope_override
 	{
-		this->DThread->Lock();
+		this->Dispatcher.Lock();
 
-		for (unsigned i = this->QueryRequests.size(); i > 0; --i)
+		for (std::list<QueryRequest>::iterator it = this->QueryRequests.begin(); it != this->QueryRequests.end();)
 		{
-			QueryRequest &r = this->QueryRequests[i - 1];
+			QueryRequest &r = *it;
 
-			if (r.sqlinterface && r.sqlinterface->owner == m)
+			if (!r.sqlinterface || r.sqlinterface->owner != m)
+				++it;
+			else if (r.running)
 			{
-				if (i == 1)
-				{
-					r.service->Lock.Lock();
-					r.service->Lock.Unlock();
-				}
-
-				this->QueryRequests.erase(this->QueryRequests.begin() + i - 1);
+				/* Queries already executing are left to finish, but their result is dropped */
+				r.sqlinterface = NULL;
+				++it;
+			}
+			else
+			{
+				--r.service->queued;
+				it = this->QueryRequests.erase(it);
 			}
 		}
 
-		this->DThread->Unlock();
+		this->Dispatcher.Unlock();
+
+		for (std::map<Anope::string, MySQLService *>::iterator it = this->MySQLServices.begin(); it != this->MySQLServices.end(); ++it)
+			it->second->RemoveLane(m);
 
 		this->OnNotify();
 	}
 
 	void OnNotify() anope_override
 	{
-		this->DThread->Lock();
+		this->Dispatcher.Lock();
 		std::deque<QueryResult> finishedRequests = this->FinishedRequests;
 		this->FinishedRequests.clear();
-		this->DThread->Unlock();
+		this->Dispatcher.Unlock();
 
 		for (std::deque<QueryResult>::const_iterator it = finishedRequests.begin(), it_end = finishedRequests.end(); it != it_end; ++it)
 		{
@@ -286,52 +433,200 @@ class ModuleSQL : public Module, public Pipe
 	}
 };
 
-MySQLService::MySQLService(Module *o, const Anope::string &n, const Anope::string &d, const Anope::string &s, const Anope::string &u, const Anope::string &p, int po)
-: Provider(o, n), database(d), server(s), user(u), password(p), port(po), sql(NULL)
+MySQLService::MySQLService(Module *o, const Anope::string &n, const Anope::string &d, const Anope::string &s, const Anope::string &u, const Anope::string &p, int po, unsigned pool)
+: Provider(o, n), database(d), server(s), user(u), password(p), port(po), next_lane(0), queued(0), running(0), completed(0), errors(0), wait_time(0), exec_time(0), max_latency(0)
 {
-	Connect();
+	try
+	{
+		for (unsigned i = 0; i < pool; ++i)
+		{
+			this->connections.push_back(new Connection());
+			Connect(this->connections.back());
+		}
+	}
+	catch (const SQL::Exception &)
+	{
+		for (unsigned i = 0; i < this->connections.size(); ++i)
+		{
+			mysql_close(this->connections[i]->sql);
+			delete this->connections[i];
+		}
+		throw;
+	}
 }
 
 MySQLService::~MySQLService()
 {
-	me->DThread->Lock();
-	this->Lock.Lock();
-	mysql_close(this->sql);
-	this->sql = NULL;
+	me->Dispatcher.Lock();
 
-	for (unsigned i = me->QueryRequests.size(); i > 0; --i)
+	for (std::list<QueryRequest>::iterator it = me->QueryRequests.begin(); it != me->QueryRequests.end();)
 	{
-		QueryRequest &r = me->QueryRequests[i - 1];
+		QueryRequest &r = *it;
 
-		if (r.service == this)
+		if (r.service != this)
+			++it;
+		else if (r.running)
+		{
+			/* The thread executing this finishes it on its own, but must not touch us afterwards */
+			r.service = NULL;
+			r.conn = NULL;
+			++it;
+		}
+		else
 		{
 			if (r.sqlinterface)
-				r.sqlinterface->OnError(Result(0, r.query, "SQL Interface is going away"));
-			me->QueryRequests.erase(me->QueryRequests.begin() + i - 1);
+			{
+				if (r.transaction.empty())
+					r.sqlinterface->OnError(Result(0, r.query, "SQL Interface is going away"));
+				for (unsigned i = 0; i < r.transaction.size(); ++i)
+					r.sqlinterface->OnError(Result(0, r.transaction[i], "SQL Interface is going away"));
+			}
+			it = me->QueryRequests.erase(it);
 		}
 	}
-	this->Lock.Unlock();
-	me->DThread->Unlock();
+
+	for (unsigned i = 0; i < this->connections.size(); ++i)
+	{
+		Connection *conn = this->connections[i];
+
+		/* Wait for any query executing on this connection */
+		conn->Lock.Lock();
+		conn->ClearStatements();
+		mysql_close(conn->sql);
+		conn->Lock.Unlock();
+
+		me->Busy.erase(conn);
+		delete conn;
+	}
+
+	me->Dispatcher.Unlock();
+}
+
+void MySQLService::Queue(Interface *i, const Query &query, const std::vector<Query> &transaction)
+{
+	/* Queries from the same module always use the same connection, so they execute in order */
+	Connection *&conn = this->lanes[i ? i->owner : NULL];
+	if (!conn)
+		conn = this->connections[this->next_lane++ % this->connections.size()];
+
+	me->Dispatcher.Lock();
+	if (transaction.empty())
+		me->QueryRequests.push_back(QueryRequest(this, conn, i, query, Now()));
+	else
+		me->QueryRequests.push_back(QueryRequest(this, conn, i, transaction, Now()));
+	++this->queued;
+	me->Dispatcher.Unlock();
+	me->Dispatcher.Wakeup();
+}
+
+Connection *MySQLService::GetFreeConnection()
+{
+	me->Dispatcher.Lock();
+	Connection *conn = this->connections[0];
+	for (unsigned i = 0; i < this->connections.size(); ++i)
+		if (!me->Busy.count(this->connections[i]))
+		{
+			conn = this->connections[i];
+			break;
+		}
+	me->Dispatcher.Unlock();
+
+	return conn;
 }
 
 void MySQLService::Run(Interface *i, const Query &query)
 {
-	me->DThread->Lock();
-	me->QueryRequests.push_back(QueryRequest(this, i, query));
-	me->DThread->Unlock();
-	me->DThread->Wakeup();
+	this->Queue(i, query, std::vector<Query>());
 }
 
 Result MySQLService::RunQuery(const Query &query)
 {
-	this->Lock.Lock();
+	Connection *conn = this->GetFreeConnection();
+
+	conn->Lock.Lock();
+	Result res = this->Execute(conn, query);
+	conn->Lock.Unlock();
+
+	return res;
+}
+
+void MySQLService::RunTransaction(Interface *i, const std::vector<Query> &queries)
+{
+	this->Queue(i, Query(), queries);
+}
+
+std::vector<Result> MySQLService::RunTransactionQuery(const std::vector<Query> &queries)
+{
+	Connection *conn = this->GetFreeConnection();
+	std::vector<Result> results;
+
+	conn->Lock.Lock();
+	this->ExecuteTransaction(conn, queries, results);
+	conn->Lock.Unlock();
+
+	return results;
+}
+
+void MySQLService::ExecuteTransaction(Connection *conn, const std::vector<Query> &queries, std::vector<Result> &results)
+{
+	Anope::string error;
+
+	Result begin = this->Execute(conn, Query("BEGIN"));
+	if (!begin)
+		error = begin.GetError();
+
+	for (unsigned i = 0; i < queries.size(); ++i)
+	{
+		if (!error.empty())
+		{
+			results.push_back(MySQLResult(queries[i], "", error));
+			continue;
+		}
+
+		results.push_back(this->Execute(conn, queries[i]));
+		if (!results.back())
+			error = results.back().GetError();
+	}
+
+	if (error.empty())
+	{
+		Result commit = this->Execute(conn, Query("COMMIT"));
+		if (!commit)
+			error = commit.GetError();
+	}
+
+	if (!error.empty())
+	{
+		if (begin)
+			this->Execute(conn, Query("ROLLBACK"));
+
+		/* Nothing was written, so none of them succeeded */
+		for (unsigned i = 0; i < results.size(); ++i)
+			if (results[i])
+				results[i] = MySQLResult(queries[i], results[i].finished_query, "Transaction rolled back: " + error);
+	}
+}
+
+Result MySQLService::Execute(Connection *conn, const Query &query)
+{
+	bool connected = this->CheckConnection(conn);
+
+	if (query.prepare && connected)
+	{
+		std::vector<const Anope::string *> values;
+		Anope::string statement = this->BuildStatement(query, values);
+
+		MYSQL_STMT *stmt = !statement.empty() ? this->Prepare(conn, statement) : NULL;
+		if (stmt)
+			return this->ExecuteStatement(conn, stmt, query, statement, values);
+	}
 
-	Anope::string real_query = this->BuildQuery(query);
+	Anope::string real_query = this->BuildQuery(conn, query);
 
-	if (this->CheckConnection() && !mysql_real_query(this->sql, real_query.c_str(), real_query.length()))
+	if (connected && !mysql_real_query(conn->sql, real_query.c_str(), real_query.length()))
 	{
-		MYSQL_RES *res = mysql_store_result(this->sql);
-		unsigned int id = mysql_insert_id(this->sql);
+		MYSQL_RES *res = mysql_store_result(conn->sql);
+		unsigned int id = mysql_insert_id(conn->sql);
 
 		/* because we enabled CLIENT_MULTI_RESULTS in our options
 		 * a multiple statement or a procedure call can return
@@ -339,18 +634,135 @@ Result MySQLService::RunQuery(const Query &query)
 		 * we must process them all before the next query.
 		 */
 
-		while (!mysql_next_result(this->sql))
-			mysql_free_result(mysql_store_result(this->sql));
+		while (!mysql_next_result(conn->sql))
+			mysql_free_result(mysql_store_result(conn->sql));
 
-		this->Lock.Unlock();
 		return MySQLResult(id, query, real_query, res);
 	}
 	else
+		return MySQLResult(query, real_query, mysql_error(conn->sql));
+}
+
+MYSQL_STMT *MySQLService::Prepare(Connection *conn, const Anope::string &statement)
+{
+	std::map<Anope::string, MYSQL_STMT *>::iterator it = conn->statements.find(statement);
+	if (it != conn->statements.end())
+		return it->second;
+
+	MYSQL_STMT *stmt = mysql_stmt_init(conn->sql);
+	if (!stmt)
+		return NULL;
+
+	if (mysql_stmt_prepare(stmt, statement.c_str(), statement.length()))
+	{
+		/* Not everything can be prepared, such as statements creating procedures, so failures
+		 * are remembered to not try again each time they are run. They are run as text queries instead.
+		 */
+		mysql_stmt_close(stmt);
+		stmt = NULL;
+	}
+
+	if (conn->statements.size() >= 128)
+		conn->ClearStatements();
+	conn->statements[statement] = stmt;
+
+	return stmt;
+}
+
+Result MySQLService::ExecuteStatement(Connection *conn, MYSQL_STMT *stmt, const Query &query, const Anope::string &statement, const std::vector<const Anope::string *> &values)
+{
+	std::vector<MYSQL_BIND> params(values.size());
+	for (unsigned i = 0; i < values.size(); ++i)
+	{
+		memset(&params[i], 0, sizeof(MYSQL_BIND));
+		params[i].buffer_type = MYSQL_TYPE_STRING;
+		params[i].buffer = const_cast<char *>(values[i]->c_str());
+		params[i].buffer_length = values[i]->length();
+	}
+
+	if ((!params.empty() && mysql_stmt_bind_param(stmt, &params[0])) || mysql_stmt_execute(stmt))
 	{
-		Anope::string error = mysql_error(this->sql);
-		this->Lock.Unlock();
-		return MySQLResult(query, real_query, error);
+		Anope::string error = mysql_stmt_error(stmt);
+		/* The statement may not be valid anymore, so it is prepared again next time */
+		conn->statements.erase(statement);
+		mysql_stmt_close(stmt);
+		return MySQLResult(query, this->BuildQuery(conn, query), error);
+	}
+
+	MySQLResult result(mysql_stmt_insert_id(stmt), query, statement, NULL);
+
+	MYSQL_RES *meta = mysql_stmt_result_metadata(stmt);
+	if (meta)
+	{
+		unsigned num_fields = mysql_num_fields(meta);
+		MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+
+		/* Nothing is fetched with the row, only the lengths, so the columns can be fetched in to buffers of the right size */
+		std::vector<MYSQL_BIND> columns(num_fields);
+		for (unsigned i = 0; i < num_fields; ++i)
+		{
+			memset(&columns[i], 0, sizeof(MYSQL_BIND));
+			columns[i].buffer_type = MYSQL_TYPE_STRING;
+			columns[i].is_null = &columns[i].is_null_value;
+			columns[i].length = &columns[i].length_value;
+		}
+
+		if (num_fields && !mysql_stmt_bind_result(stmt, &columns[0]) && !mysql_stmt_store_result(stmt))
+		{
+			for (int err; (err = mysql_stmt_fetch(stmt)) == 0 || err == MYSQL_DATA_TRUNCATED;)
+			{
+				std::map<Anope::string, Anope::string> items;
+
+				for (unsigned i = 0; i < num_fields; ++i)
+				{
+					Anope::string column = (fields[i].name ? fields[i].name : "");
+					Anope::string data;
+
+					if (!columns[i].is_null_value && columns[i].length_value)
+					{
+						std::vector<char> buffer(columns[i].length_value);
+
+						MYSQL_BIND bind;
+						memset(&bind, 0, sizeof(bind));
+						bind.buffer_type = MYSQL_TYPE_STRING;
+						bind.buffer = &buffer[0];
+						bind.buffer_length = buffer.size();
+
+						if (!mysql_stmt_fetch_column(stmt, &bind, i, 0))
+							data = Anope::string(&buffer[0], buffer.size());
+					}
+
+					items[column] = data;
+				}
+
+				result.AddRow(items);
+			}
+		}
+
+		mysql_stmt_free_result(stmt);
+		mysql_free_result(meta);
 	}
+
+	/* Procedures return their status as a result too, which must be processed before the next execution */
+	while (!mysql_stmt_next_result(stmt))
+		mysql_stmt_free_result(stmt);
+
+	return result;
+}
+
+bool MySQLService::GetStats(Stats &stats)
+{
+	me->Dispatcher.Lock();
+	stats.connections = this->connections.size();
+	stats.queued = this->queued;
+	stats.running = this->running;
+	stats.queries = this->completed;
+	stats.errors = this->errors;
+	stats.wait_time = this->wait_time;
+	stats.exec_time = this->exec_time;
+	stats.max_latency = this->max_latency;
+	me->Dispatcher.Unlock();
+	return true;
 }
 
 std::vector<Query> MySQLService::CreateTable(const Anope::string &table, const Data &data)
@@ -420,7 +832,7 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 	Anope::string query_text = "INSERT INTO `" + table + "` (`id`";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += ",`" + it->first + "`";
-	query_text += ") VALUES (" + stringify(id);
+	query_text += ") VALUES (@id@";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += ",@" + it->first + "@";
 	query_text += ") ON DUPLICATE KEY UPDATE ";
@@ -428,7 +840,9 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 		query_text += "`" + it->first + "`=VALUES(`" + it->first + "`),";
 	query_text.erase(query_text.end() - 1);
 
+	/* The id is a parameter too so every insert into the table with the same columns is the same statement */
 	Query query(query_text);
+	query.SetValue("id", id);
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 	{
 		Anope::string buf;
@@ -439,34 +853,87 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 	return query;
 }
 
+Query MySQLService::BuildBatchInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows)
+{
+	/* Every row has to supply the same columns, so use every known column, NULL if a row does not have it */
+	std::set<Anope::string> columns;
+	const std::set<Anope::string> &known_cols = this->active_schema[table];
+	for (std::set<Anope::string>::const_iterator it = known_cols.begin(), it_end = known_cols.end(); it != it_end; ++it)
+		if (*it != "id" && *it != "timestamp")
+			columns.insert(*it);
+	for (unsigned i = 0; i < rows.size(); ++i)
+		for (Data::Map::const_iterator it = rows[i].second->data.begin(), it_end = rows[i].second->data.end(); it != it_end; ++it)
+			columns.insert(it->first);
+
+	Query query;
+	Anope::string query_text = "INSERT INTO `" + table + "` (`id`";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += ",`" + *it + "`";
+	query_text += ") VALUES ";
+	for (unsigned i = 0; i < rows.size(); ++i)
+	{
+		query_text += (i ? ",(@" : "(@") + stringify(i) + "_id@";
+		query.SetValue(stringify(i) + "_id", rows[i].first);
+
+		unsigned j = 0;
+		for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it, ++j)
+		{
+			const Anope::string key = stringify(i) + "_" + stringify(j);
+			query_text += ",@" + key + "@";
+
+			Data::Map::const_iterator dit = rows[i].second->data.find(*it);
+			if (dit != rows[i].second->data.end())
+			{
+				Anope::string buf;
+				*dit->second >> buf;
+				query.SetValue(key, buf);
+			}
+			else
+				query.SetValue(key, "NULL", false);
+		}
+
+		query_text += ")";
+	}
+	query_text += " ON DUPLICATE KEY UPDATE ";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += "`" + *it + "`=VALUES(`" + *it + "`),";
+	query_text.erase(query_text.end() - 1);
+
+	query.query = query_text;
+	return query;
+}
+
 Query MySQLService::GetTables(const Anope::string &prefix)
 {
 	return Query("SHOW TABLES LIKE '" + prefix + "%';");
 }
 
-void MySQLService::Connect()
+void MySQLService::Connect(Connection *conn)
 {
-	this->sql = mysql_init(this->sql);
+	/* Statements do not survive reconnecting */
+	conn->ClearStatements();
+
+	conn->sql = mysql_init(conn->sql);
 
 	const unsigned int timeout = 1;
-	mysql_options(this->sql, MYSQL_OPT_CONNECT_TIMEOUT, reinterpret_cast<const char *>(&timeout));
+	mysql_options(conn->sql, MYSQL_OPT_CONNECT_TIMEOUT, reinterpret_cast<const char *>(&timeout));
 
-	bool connect = mysql_real_connect(this->sql, this->server.c_str(), this->user.c_str(), this->password.c_str(), this->database.c_str(), this->port, NULL, CLIENT_MULTI_RESULTS);
+	bool connect = mysql_real_connect(conn->sql, this->server.c_str(), this->user.c_str(), this->password.c_str(), this->database.c_str(), this->port, NULL, CLIENT_MULTI_RESULTS);
 
 	if (!connect)
-		throw SQL::Exception("Unable to connect to MySQL service " + this->name + ": " + mysql_error(this->sql));
+		throw SQL::Exception("Unable to connect to MySQL service " + this->name + ": " + mysql_error(conn->sql));
 	
 	Log(LOG_DEBUG) << "Successfully connected to MySQL service " << this->name << " at " << this->server << ":" << this->port;
 }
 
 
-bool MySQLService::CheckConnection()
+bool MySQLService::CheckConnection(Connection *conn)
 {
-	if (!this->sql || mysql_ping(this->sql))
+	if (!conn->sql || mysql_ping(conn->sql))
 	{
 		try
 		{
-			this->Connect();
+			this->Connect(conn);
 		}
 		catch (const SQL::Exception &)
 		{
@@ -477,23 +944,88 @@ bool MySQLService::CheckConnection()
 	return true;
 }
 
-Anope::string MySQLService::Escape(const Anope::string &query)
+Anope::string MySQLService::Escape(Connection *conn, const Anope::string &query)
 {
 	std::vector<char> buffer(query.length() * 2 + 1);
-	mysql_real_escape_string(this->sql, &buffer[0], query.c_str(), query.length());
+	mysql_real_escape_string(conn->sql, &buffer[0], query.c_str(), query.length());
 	return &buffer[0];
 }
 
-Anope::string MySQLService::BuildQuery(const Query &q)
+Anope::string MySQLService::BuildQuery(Connection *conn, const Query &q)
 {
-	Anope::string real_query = q.query;
+	/* Substitute the parameters in one pass, batched queries can have thousands of them */
+	const std::string &text = q.query.str();
+	Anope::string real_query;
+
+	for (size_t pos = 0; pos < text.length();)
+	{
+		size_t start = text.find('@', pos), end = start != std::string::npos ? text.find('@', start + 1) : std::string::npos;
+		if (end == std::string::npos)
+		{
+			real_query.str().append(text, pos, std::string::npos);
+			break;
+		}
 
-	for (std::map<Anope::string, QueryData>::const_iterator it = q.parameters.begin(), it_end = q.parameters.end(); it != it_end; ++it)
-		real_query = real_query.replace_all_cs("@" + it->first + "@", (it->second.escape ? ("'" + this->Escape(it->second.data) + "'") : it->second.data));
+		std::map<Anope::string, QueryData>::const_iterator it = q.parameters.find(text.substr(start + 1, end - start - 1));
+		if (it == q.parameters.end())
+		{
+			/* Not a parameter, the closing @ may open the next one */
+			real_query.str().append(text, pos, end - pos);
+			pos = end;
+			continue;
+		}
+
+		real_query.str().append(text, pos, start - pos);
+		real_query += it->second.escape ? ("'" + this->Escape(conn, it->second.data) + "'") : it->second.data;
+		pos = end + 1;
+	}
 
 	return real_query;
 }
 
+Anope::string MySQLService::BuildStatement(const Query &q, std::vector<const Anope::string *> &values)
+{
+	const std::string &text = q.query.str();
+	Anope::string statement;
+
+	for (size_t pos = 0; pos < text.length();)
+	{
+		size_t start = text.find('@', pos), end = start != std::string::npos ? text.find('@', start + 1) : std::string::npos;
+		if (end == std::string::npos)
+		{
+			statement.str().append(text, pos, std::string::npos);
+			break;
+		}
+
+		std::map<Anope::string, QueryData>::const_iterator it = q.parameters.find(text.substr(start + 1, end - start - 1));
+		if (it == q.parameters.end())
+		{
+			statement.str().append(text, pos, end - pos);
+			pos = end;
+			continue;
+		}
+
+		statement.str().append(text, pos, start - pos);
+		if (it->second.escape)
+		{
+			values.push_back(&it->second.data);
+			statement += "?";
+		}
+		else
+			statement += it->second.data;
+		pos = end + 1;
+	}
+
+	/* The protocol numbers placeholders with 16 bits */
+	if (values.size() > 65535)
+	{
+		values.clear();
+		return "";
+	}
+
+	return statement;
+}
+
 Anope::string MySQLService::FromUnixtime(time_t t)
 {
 	return "FROM_UNIXTIME(" + stringify(t) + ")";
@@ -501,34 +1033,69 @@ Anope::string MySQLService::FromUnixtime(time_t t)
 
 void DispatcherThread::Run()
 {
-	this->Lock();
+	me->Dispatcher.Lock();
 
 	while (!this->GetExitState())
 	{
-		if (!me->QueryRequests.empty())
-		{
-			QueryRequest &r = me->QueryRequests.front();
-			this->Unlock();
+		/* Find the oldest query whose connection is free. Queries on the same connection are
+		 * always started in the order they were requested.
+		 */
+		std::list<QueryRequest>::iterator it = me->QueryRequests.begin(), it_end = me->QueryRequests.end();
+		for (; it != it_end; ++it)
+			if (!it->running && !me->Busy.count(it->conn))
+				break;
 
-			Result sresult = r.service->RunQuery(r.query);
+		if (it != it_end)
+		{
+			QueryRequest &r = *it;
+			Connection *conn = r.conn;
+			MySQLService *service = r.service;
+
+			r.running = true;
+			me->Busy.insert(conn);
+			--service->queued;
+			++service->running;
+			unsigned long started = Now();
+			/* Locked before the dispatcher is released, so the service can not close the connection before we start */
+			conn->Lock.Lock();
+			me->Dispatcher.Unlock();
+
+			std::vector<Result> results;
+			if (r.transaction.empty())
+				results.push_back(service->Execute(conn, r.query));
+			else
+				service->ExecuteTransaction(conn, r.transaction, results);
+			conn->Lock.Unlock();
+			unsigned long finished = Now();
 
-			this->Lock();
-			if (!me->QueryRequests.empty() && me->QueryRequests.front().query == r.query)
+			me->Dispatcher.Lock();
+			/* The service may have gone away while the query was executing */
+			if (r.service)
 			{
-				if (r.sqlinterface)
-					me->FinishedRequests.push_back(QueryResult(r.sqlinterface, sresult));
-				me->QueryRequests.pop_front();
+				me->Busy.erase(r.conn);
+
+				--r.service->running;
+				++r.service->completed;
+				if (!results.back())
+					++r.service->errors;
+				r.service->wait_time += started - r.queued_at;
+				r.service->exec_time += finished - started;
+				r.service->max_latency = std::max(r.service->max_latency, finished - r.queued_at);
 			}
+			if (r.sqlinterface)
+				for (unsigned i = 0; i < results.size(); ++i)
+					me->FinishedRequests.push_back(QueryResult(r.sqlinterface, results[i]));
+			me->QueryRequests.erase(it);
 		}
 		else
 		{
 			if (!me->FinishedRequests.empty())
 				me->Notify();
-			this->Wait();
+			me->Dispatcher.Wait();
 		}
 	}
 
-	this->Unlock();
+	me->Dispatcher.Unlock();
 }
 
 MODULE_INIT(ModuleSQL)
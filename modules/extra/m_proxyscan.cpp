@@ -36,7 +36,7 @@ class ProxyCallbackListener : public ListenSocket
 
 		bool ProcessWrite() anope_override
 		{
-			return !BufferedSocket::ProcessWrite() || this->write_buffer.empty() ? false : true;
+			return !BufferedSocket::ProcessWrite() || !this->WriteBufferLen() ? false : true;
 		}
 	};
 
@@ -234,10 +234,9 @@ class ModuleProxyScan : public Module
 			delete p;
 		}
 
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
 
 			ClientSocket *cs = dynamic_cast<ClientSocket *>(s);
 			if (cs != NULL && cs->ls == this->listener)
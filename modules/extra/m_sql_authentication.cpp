@@ -50,6 +50,7 @@ class SQLAuthenticationResult : public SQL::Interface
 		if (!email.empty() && email != na->nc->email)
 		{
 			na->nc->email = email;
+			na->nc->QueueUpdate();
 			if (user && NickServ)
 				user->SendMessage(NickServ, _("Your email has been updated to \002%s\002."), email.c_str());
 		}
@@ -109,7 +110,7 @@ class ModuleSQLAuthentication : public Module
 			return;
 		}
 
-		SQL::Query q(this->query);
+		SQL::Query q(this->query, true);
 		q.SetValue("a", req->GetAccount());
 		q.SetValue("p", req->GetPassword());
 		if (u)
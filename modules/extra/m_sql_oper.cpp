@@ -133,7 +133,7 @@ class ModuleSQLOper : public Module
 			return;
 		}
 
-		SQL::Query q(this->query);
+		SQL::Query q(this->query, true);
 		q.SetValue("a", u->Account()->display);
 		q.SetValue("i", u->ip);
 
@@ -6,7 +6,45 @@
 
 using namespace SQL;
 
-/* SQLite3 API, based from InspiRCd */
+/* SQLite3 API, based from InspiRCd
+ *
+ * Queries requested with Run are executed on a separate thread, so writing to the disk
+ * does not block the main thread. The thread executes the queries waiting for a database
+ * in one transaction, and gives the results back to the main thread through a Pipe,
+ * as m_mysql does. Transactions requested with RunTransaction are executed on their own,
+ * so no other query ever ends up in them.
+ */
+
+class SQLiteService;
+
+/** A query request
+ */
+struct QueryRequest
+{
+	/* The database the query is for */
+	SQLiteService *service;
+	/* The interface to use once we have the result to send the data back */
+	Interface *sqlinterface;
+	/* The actual query */
+	Query query;
+	/* The queries of a transaction, which are run instead of query */
+	std::vector<Query> transaction;
+
+	QueryRequest(SQLiteService *s, Interface *i, const Query &q) : service(s), sqlinterface(i), query(q) { }
+
+	QueryRequest(SQLiteService *s, Interface *i, const std::vector<Query> &t) : service(s), sqlinterface(i), transaction(t) { }
+};
+
+/** A query result */
+struct QueryResult
+{
+	/* The interface to send the data back on */
+	Interface *sqlinterface;
+	/* The result */
+	Result result;
+
+	QueryResult(Interface *i, const Result &r) : sqlinterface(i), result(r) { }
+};
 
 /** A SQLite result
  */
@@ -37,10 +75,38 @@ class SQLiteService : public Provider
 
 	sqlite3 *sql;
 
+	/* Prepared statements, by the query text they were prepared from */
+	std::map<Anope::string, sqlite3_stmt *> statements;
+
 	Anope::string Escape(const Anope::string &query);
 
+	/** Build the text of a query to prepare, with placeholders for the escaped parameters.
+	 * @param q The query
+	 * @param values Filled in with the value to bind to each placeholder
+	 * @return The text, or an empty string if the query has too many parameters to bind
+	 */
+	Anope::string BuildStatement(const Query &q, std::vector<const Anope::string *> &values);
+
+	void ClearStatements();
+
+	/** Take the queries waiting for the thread, so they can be executed before a query run now.
+	 * The dispatcher lock must be held.
+	 * @param requests Filled in with the queries
+	 */
+	void TakeRequests(std::deque<QueryRequest> &requests);
+
+	/** Execute a request now, after the queries waiting for the thread.
+	 * @param request The request, which has no interface
+	 * @param requests Filled in with the requests executed, the last being ours
+	 * @param results Filled in with the result of each of their queries
+	 */
+	void RunNow(const QueryRequest &request, std::deque<QueryRequest> &requests, std::vector<Result> &results);
+
  public:
-	SQLiteService(Module *o, const Anope::string &n, const Anope::string &d);
+	/* Held while a query is executing on this database */
+	Mutex Lock;
+
+	SQLiteService(Module *o, const Anope::string &n, const Anope::string &d, bool wal);
 
 	~SQLiteService();
 
@@ -48,10 +114,34 @@ class SQLiteService : public Provider
 
 	Result RunQuery(const Query &query);
 
+	void RunTransaction(Interface *i, const std::vector<Query> &queries) anope_override;
+
+	std::vector<Result> RunTransactionQuery(const std::vector<Query> &queries) anope_override;
+
+	/** Execute a query. Lock must be held.
+	 * @param query The query
+	 * @return The result
+	 */
+	Result Execute(const Query &query);
+
+	/** Execute many queries, in as few transactions as possible. Lock must be held.
+	 * @param requests The queries
+	 * @param results Filled in with the result of each query
+	 */
+	void Execute(const std::deque<QueryRequest> &requests, std::vector<Result> &results);
+
+	/** Execute queries in one transaction, which is rolled back if any of them fails. Lock must be held.
+	 * @param queries The queries
+	 * @param results Filled in with the result of each query
+	 */
+	void ExecuteTransaction(const std::vector<Query> &queries, std::vector<Result> &results);
+
 	std::vector<Query> CreateTable(const Anope::string &table, const Data &data) anope_override;
 
 	Query BuildInsert(const Anope::string &table, unsigned int id, Data &data);
 
+	Query BuildBatchInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows) anope_override;
+
 	Query GetTables(const Anope::string &prefix);
 
 	Anope::string BuildQuery(const Query &q);
@@ -59,13 +149,40 @@ class SQLiteService : public Provider
 	Anope::string FromUnixtime(time_t);
 };
 
-class ModuleSQLite : public Module
+/** The thread used to execute queries
+ */
+class DispatcherThread : public Thread
+{
+ public:
+	DispatcherThread() : Thread() { }
+
+	void Run() anope_override;
+};
+
+class ModuleSQLite;
+static ModuleSQLite *me;
+class ModuleSQLite : public Module, public Pipe
 {
 	/* SQL connections */
 	std::map<Anope::string, SQLiteService *> SQLiteServices;
  public:
+	/* Protects the request queues, and is signalled when there are new requests */
+	Condition Dispatcher;
+	/* Pending query requests */
+	std::deque<QueryRequest> QueryRequests;
+	/* Query requests the thread is executing */
+	std::deque<QueryRequest> RunningRequests;
+	/* Pending finished requests with results */
+	std::deque<QueryResult> FinishedRequests;
+	/* The thread used to execute queries */
+	DispatcherThread *DThread;
+
 	ModuleSQLite(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, EXTRA | VENDOR)
 	{
+		me = this;
+
+		DThread = new DispatcherThread();
+		DThread->Start();
 	}
 
 	~ModuleSQLite()
@@ -73,6 +190,13 @@ class ModuleSQLite : public Module
 		for (std::map<Anope::string, SQLiteService *>::iterator it = this->SQLiteServices.begin(); it != this->SQLiteServices.end(); ++it)
 			delete it->second;
 		SQLiteServices.clear();
+
+		this->Dispatcher.Lock();
+		DThread->SetExitState();
+		this->Dispatcher.Wakeup();
+		this->Dispatcher.Unlock();
+		DThread->Join();
+		delete DThread;
 	}
 
 	void OnReload(Configuration::Conf *conf) anope_override
@@ -107,10 +231,11 @@ class ModuleSQLite : public Module
 			if (this->SQLiteServices.find(connname) == this->SQLiteServices.end())
 			{
 				Anope::string database = Anope::DataDir + "/" + block->Get<const Anope::string>("database", "anope");
+				bool wal = block->Get<bool>("wal", "yes");
 
 				try
 				{
-					SQLiteService *ss = new SQLiteService(this, connname, database);
+					SQLiteService *ss = new SQLiteService(this, connname, database, wal);
 					this->SQLiteServices[connname] = ss;
 
 					Log(LOG_NORMAL, "sqlite") << "SQLite: Successfully added database " << database;
@@ -122,38 +247,322 @@ class ModuleSQLite : public Module
 			}
 		}
 	}
+
+	void OnModuleUnload(User *, Module *m) anope_override
+	{
+		this->Dispatcher.Lock();
+
+		for (unsigned i = this->QueryRequests.size(); i > 0; --i)
+		{
+			QueryRequest &r = this->QueryRequests[i - 1];
+
+			if (r.sqlinterface && r.sqlinterface->owner == m)
+				this->QueryRequests.erase(this->QueryRequests.begin() + i - 1);
+		}
+
+		/* Queries being executed are left to finish, but their results are dropped */
+		for (unsigned i = 0; i < this->RunningRequests.size(); ++i)
+		{
+			QueryRequest &r = this->RunningRequests[i];
+
+			if (r.sqlinterface && r.sqlinterface->owner == m)
+				r.sqlinterface = NULL;
+		}
+
+		this->Dispatcher.Unlock();
+
+		this->OnNotify();
+	}
+
+	/** Queue the results of executed requests to be given back to their interfaces.
+	 * The dispatcher lock must be held.
+	 * @param requests The requests
+	 * @param results The result of each query of the requests, in order
+	 */
+	void FinishRequests(const std::deque<QueryRequest> &requests, const std::vector<Result> &results)
+	{
+		for (unsigned i = 0, j = 0; i < requests.size(); ++i)
+		{
+			unsigned count = requests[i].transaction.empty() ? 1 : requests[i].transaction.size();
+			if (requests[i].sqlinterface)
+				for (unsigned k = 0; k < count; ++k)
+					this->FinishedRequests.push_back(QueryResult(requests[i].sqlinterface, results[j + k]));
+			j += count;
+		}
+	}
+
+	void OnNotify() anope_override
+	{
+		this->Dispatcher.Lock();
+		std::deque<QueryResult> finishedRequests = this->FinishedRequests;
+		this->FinishedRequests.clear();
+		this->Dispatcher.Unlock();
+
+		for (std::deque<QueryResult>::const_iterator it = finishedRequests.begin(), it_end = finishedRequests.end(); it != it_end; ++it)
+		{
+			const QueryResult &qr = *it;
+
+			if (qr.result.GetError().empty())
+				qr.sqlinterface->OnResult(qr.result);
+			else
+				qr.sqlinterface->OnError(qr.result);
+		}
+	}
 };
 
-SQLiteService::SQLiteService(Module *o, const Anope::string &n, const Anope::string &d)
+SQLiteService::SQLiteService(Module *o, const Anope::string &n, const Anope::string &d, bool wal)
 : Provider(o, n), database(d), sql(NULL)
 {
 	int db = sqlite3_open_v2(database.c_str(), &this->sql, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0);
 	if (db != SQLITE_OK)
-		throw SQL::Exception("Unable to open SQLite database " + database + ": " + sqlite3_errmsg(this->sql));
+	{
+		Anope::string error = sqlite3_errmsg(this->sql);
+		sqlite3_close(this->sql);
+		throw SQL::Exception("Unable to open SQLite database " + database + ": " + error);
+	}
+
+	/* With write-ahead logging only checkpoints have to wait for the disk, and a
+	 * crash can lose at most the last transactions, never corrupt the database
+	 */
+	if (wal)
+	{
+		Result res = this->Execute(Query("PRAGMA journal_mode = WAL"));
+		if (!res)
+			Log(LOG_NORMAL, "sqlite") << "SQLite: Unable to enable write-ahead logging for " << database << ": " << res.GetError();
+		else
+			this->Execute(Query("PRAGMA synchronous = NORMAL"));
+	}
 }
 
 SQLiteService::~SQLiteService()
 {
-	sqlite3_interrupt(this->sql);
+	/* Queries still waiting for the thread are executed now, as RunQuery does, so they are not lost */
+	std::deque<QueryRequest> requests;
+
+	me->Dispatcher.Lock();
+	this->TakeRequests(requests);
+	/* Wait for the thread to finish executing anything on this database */
+	this->Lock.Lock();
+	me->Dispatcher.Unlock();
+
+	std::vector<Result> results;
+	if (!requests.empty())
+		this->Execute(requests, results);
+
+	this->ClearStatements();
 	sqlite3_close(this->sql);
+	this->Lock.Unlock();
+
+	if (!requests.empty())
+	{
+		me->Dispatcher.Lock();
+		me->FinishRequests(requests, results);
+		me->Dispatcher.Unlock();
+		me->Notify();
+	}
+}
+
+void SQLiteService::TakeRequests(std::deque<QueryRequest> &requests)
+{
+	for (unsigned i = 0; i < me->QueryRequests.size();)
+	{
+		if (me->QueryRequests[i].service == this)
+		{
+			requests.push_back(me->QueryRequests[i]);
+			me->QueryRequests.erase(me->QueryRequests.begin() + i);
+		}
+		else
+			++i;
+	}
 }
 
 void SQLiteService::Run(Interface *i, const Query &query)
 {
-	Result res = this->RunQuery(query);
-	if (!res.GetError().empty())
-		i->OnError(res);
-	else
-		i->OnResult(res);
+	me->Dispatcher.Lock();
+	me->QueryRequests.push_back(QueryRequest(this, i, query));
+	me->Dispatcher.Unlock();
+	me->Dispatcher.Wakeup();
 }
 
 Result SQLiteService::RunQuery(const Query &query)
 {
-	Anope::string real_query = this->BuildQuery(query);
-	sqlite3_stmt *stmt;
-	int err = sqlite3_prepare_v2(this->sql, real_query.c_str(), real_query.length(), &stmt, NULL);
-	if (err != SQLITE_OK)
-		return SQLiteResult(query, real_query, sqlite3_errmsg(this->sql));
+	std::deque<QueryRequest> requests;
+	std::vector<Result> results;
+
+	this->RunNow(QueryRequest(this, NULL, query), requests, results);
+
+	return results.back();
+}
+
+void SQLiteService::RunTransaction(Interface *i, const std::vector<Query> &queries)
+{
+	me->Dispatcher.Lock();
+	me->QueryRequests.push_back(QueryRequest(this, i, queries));
+	me->Dispatcher.Unlock();
+	me->Dispatcher.Wakeup();
+}
+
+std::vector<Result> SQLiteService::RunTransactionQuery(const std::vector<Query> &queries)
+{
+	std::deque<QueryRequest> requests;
+	std::vector<Result> results;
+
+	this->RunNow(QueryRequest(this, NULL, queries), requests, results);
+
+	return std::vector<Result>(results.end() - queries.size(), results.end());
+}
+
+void SQLiteService::RunNow(const QueryRequest &request, std::deque<QueryRequest> &requests, std::vector<Result> &results)
+{
+	/* Queries still waiting for the thread must be executed first, so this request sees their changes */
+	me->Dispatcher.Lock();
+	this->TakeRequests(requests);
+	this->Lock.Lock();
+	me->Dispatcher.Unlock();
+
+	requests.push_back(request);
+	this->Execute(requests, results);
+	this->Lock.Unlock();
+
+	if (requests.size() > 1)
+	{
+		me->Dispatcher.Lock();
+		me->FinishRequests(requests, results);
+		me->Dispatcher.Unlock();
+		me->Notify();
+	}
+}
+
+void SQLiteService::Execute(const std::deque<QueryRequest> &requests, std::vector<Result> &results)
+{
+	/* Group the queries in transactions, unless they are managing transactions themselves */
+	bool in_transaction = false;
+
+	for (unsigned i = 0; i < requests.size(); ++i)
+	{
+		if (!requests[i].transaction.empty())
+		{
+			/* These are executed in a transaction of their own */
+			if (in_transaction)
+			{
+				this->Execute(Query("COMMIT"));
+				in_transaction = false;
+			}
+
+			this->ExecuteTransaction(requests[i].transaction, results);
+			continue;
+		}
+
+		const Query &query = requests[i].query;
+
+		spacesepstream sep(query.query);
+		Anope::string command;
+		sep.GetToken(command);
+		bool control = command.equals_ci("BEGIN") || command.equals_ci("COMMIT") || command.equals_ci("END") || command.equals_ci("ROLLBACK") || command.equals_ci("SAVEPOINT") || command.equals_ci("RELEASE");
+
+		if (in_transaction && control)
+		{
+			this->Execute(Query("COMMIT"));
+			in_transaction = false;
+		}
+		else if (!in_transaction && !control && i + 1 < requests.size() && sqlite3_get_autocommit(this->sql))
+			in_transaction = this->Execute(Query("BEGIN"));
+
+		results.push_back(this->Execute(query));
+	}
+
+	if (in_transaction)
+		this->Execute(Query("COMMIT"));
+}
+
+void SQLiteService::ExecuteTransaction(const std::vector<Query> &queries, std::vector<Result> &results)
+{
+	unsigned first = results.size();
+	Anope::string error;
+
+	Result begin = this->Execute(Query("BEGIN"));
+	if (!begin)
+		error = begin.GetError();
+
+	for (unsigned i = 0; i < queries.size(); ++i)
+	{
+		if (!error.empty())
+		{
+			results.push_back(SQLiteResult(queries[i], "", error));
+			continue;
+		}
+
+		results.push_back(this->Execute(queries[i]));
+		if (!results.back())
+			error = results.back().GetError();
+	}
+
+	if (error.empty())
+	{
+		Result commit = this->Execute(Query("COMMIT"));
+		if (!commit)
+			error = commit.GetError();
+	}
+
+	if (!error.empty())
+	{
+		if (begin)
+			this->Execute(Query("ROLLBACK"));
+
+		/* Nothing was written, so none of them succeeded */
+		for (unsigned i = first; i < results.size(); ++i)
+			if (results[i])
+				results[i] = SQLiteResult(queries[i - first], results[i].finished_query, "Transaction rolled back: " + error);
+	}
+}
+
+Result SQLiteService::Execute(const Query &query)
+{
+	std::vector<const Anope::string *> values;
+	Anope::string statement = this->BuildStatement(query, values);
+
+	/* Escaping every parameter into the text is only worth it for queries which are not run over and over,
+	 * prepared queries only get it if they fail
+	 */
+	Anope::string real_query = query.prepare && !statement.empty() ? statement : this->BuildQuery(query);
+
+	/* Statements of queries to prepare are kept and reused */
+	sqlite3_stmt *stmt = NULL;
+	bool cached = false;
+	if (query.prepare && !statement.empty())
+	{
+		std::map<Anope::string, sqlite3_stmt *>::iterator it = this->statements.find(statement);
+		if (it != this->statements.end())
+		{
+			stmt = it->second;
+			cached = true;
+		}
+	}
+
+	if (!cached)
+	{
+		const Anope::string &text = !statement.empty() ? statement : real_query;
+		int err = sqlite3_prepare_v2(this->sql, text.c_str(), text.length(), &stmt, NULL);
+		if (err != SQLITE_OK)
+			return SQLiteResult(query, this->BuildQuery(query), sqlite3_errmsg(this->sql));
+
+		if (query.prepare && !statement.empty() && stmt != NULL)
+		{
+			if (this->statements.size() >= 128)
+				this->ClearStatements();
+			this->statements[statement] = stmt;
+			cached = true;
+		}
+	}
+
+	/* Only whitespace or comments */
+	if (stmt == NULL)
+		return SQLiteResult(0, query, real_query);
+
+	for (unsigned i = 0; i < values.size(); ++i)
+		sqlite3_bind_text(stmt, i + 1, values[i]->c_str(), values[i]->length(), SQLITE_STATIC);
+
+	int err;
 
 	std::vector<Anope::string> columns;
 	int cols = sqlite3_column_count(stmt);
@@ -177,10 +586,16 @@ Result SQLiteService::RunQuery(const Query &query)
 
 	result.id = sqlite3_last_insert_rowid(this->sql);
 
-	sqlite3_finalize(stmt);
-
 	if (err != SQLITE_DONE)
-		return SQLiteResult(query, real_query, sqlite3_errmsg(this->sql));
+		result = SQLiteResult(query, this->BuildQuery(query), sqlite3_errmsg(this->sql));
+
+	if (cached)
+	{
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+	}
+	else
+		sqlite3_finalize(stmt);
 
 	return result;
 }
@@ -268,13 +683,16 @@ Query SQLiteService::BuildInsert(const Anope::string &table, unsigned int id, Da
 	query_text.erase(query_text.length() - 1);
 	query_text += ") VALUES (";
 	if (id > 0)
-		query_text += stringify(id) + ",";
+		query_text += "@id@,";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += "@" + it->first + "@,";
 	query_text.erase(query_text.length() - 1);
 	query_text += ")";
 
+	/* The id is a parameter too so every insert into the table with the same columns is the same statement */
 	Query query(query_text);
+	if (id > 0)
+		query.SetValue("id", id);
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 	{
 		Anope::string buf;
@@ -285,6 +703,52 @@ Query SQLiteService::BuildInsert(const Anope::string &table, unsigned int id, Da
 	return query;
 }
 
+Query SQLiteService::BuildBatchInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows)
+{
+	/* Every row has to supply the same columns, so use every known column, NULL if a row does not have it */
+	std::set<Anope::string> columns;
+	const std::set<Anope::string> &known_cols = this->active_schema[table];
+	for (std::set<Anope::string>::const_iterator it = known_cols.begin(), it_end = known_cols.end(); it != it_end; ++it)
+		if (*it != "id" && *it != "timestamp")
+			columns.insert(*it);
+	for (unsigned i = 0; i < rows.size(); ++i)
+		for (Data::Map::const_iterator it = rows[i].second->data.begin(), it_end = rows[i].second->data.end(); it != it_end; ++it)
+			columns.insert(it->first);
+
+	Query query;
+	Anope::string query_text = "REPLACE INTO `" + table + "` (`id`";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += ",`" + *it + "`";
+	query_text += ") VALUES ";
+	for (unsigned i = 0; i < rows.size(); ++i)
+	{
+		query_text += (i ? ",(@" : "(@") + stringify(i) + "_id@";
+		query.SetValue(stringify(i) + "_id", rows[i].first);
+
+		unsigned j = 0;
+		for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it, ++j)
+		{
+			const Anope::string key = stringify(i) + "_" + stringify(j);
+			query_text += ",@" + key + "@";
+
+			Data::Map::const_iterator dit = rows[i].second->data.find(*it);
+			if (dit != rows[i].second->data.end())
+			{
+				Anope::string buf;
+				*dit->second >> buf;
+				query.SetValue(key, buf);
+			}
+			else
+				query.SetValue(key, "NULL", false);
+		}
+
+		query_text += ")";
+	}
+
+	query.query = query_text;
+	return query;
+}
+
 Query SQLiteService::GetTables(const Anope::string &prefix)
 {
 	return Query("SELECT name FROM sqlite_master WHERE type='table' AND name LIKE '" + prefix + "%';");
@@ -300,18 +764,144 @@ Anope::string SQLiteService::Escape(const Anope::string &query)
 
 Anope::string SQLiteService::BuildQuery(const Query &q)
 {
-	Anope::string real_query = q.query;
+	/* Substitute the parameters in one pass, batched queries can have thousands of them */
+	const std::string &text = q.query.str();
+	Anope::string real_query;
+
+	for (size_t pos = 0; pos < text.length();)
+	{
+		size_t start = text.find('@', pos), end = start != std::string::npos ? text.find('@', start + 1) : std::string::npos;
+		if (end == std::string::npos)
+		{
+			real_query.str().append(text, pos, std::string::npos);
+			break;
+		}
 
-	for (std::map<Anope::string, QueryData>::const_iterator it = q.parameters.begin(), it_end = q.parameters.end(); it != it_end; ++it)
-		real_query = real_query.replace_all_cs("@" + it->first + "@", (it->second.escape ? ("'" + this->Escape(it->second.data) + "'") : it->second.data));
+		std::map<Anope::string, QueryData>::const_iterator it = q.parameters.find(text.substr(start + 1, end - start - 1));
+		if (it == q.parameters.end())
+		{
+			/* Not a parameter, the closing @ may open the next one */
+			real_query.str().append(text, pos, end - pos);
+			pos = end;
+			continue;
+		}
+
+		real_query.str().append(text, pos, start - pos);
+		real_query += it->second.escape ? ("'" + this->Escape(it->second.data) + "'") : it->second.data;
+		pos = end + 1;
+	}
 
 	return real_query;
 }
 
+Anope::string SQLiteService::BuildStatement(const Query &q, std::vector<const Anope::string *> &values)
+{
+	const std::string &text = q.query.str();
+	std::map<Anope::string, int> placeholders;
+	Anope::string statement;
+
+	for (size_t pos = 0; pos < text.length();)
+	{
+		size_t start = text.find('@', pos), end = start != std::string::npos ? text.find('@', start + 1) : std::string::npos;
+		if (end == std::string::npos)
+		{
+			statement.str().append(text, pos, std::string::npos);
+			break;
+		}
+
+		const Anope::string key = text.substr(start + 1, end - start - 1);
+		std::map<Anope::string, QueryData>::const_iterator it = q.parameters.find(key);
+		if (it == q.parameters.end())
+		{
+			statement.str().append(text, pos, end - pos);
+			pos = end;
+			continue;
+		}
+
+		statement.str().append(text, pos, start - pos);
+		if (!it->second.escape)
+			statement += it->second.data;
+		else
+		{
+			/* Every use of a parameter is bound to the same placeholder */
+			int &index = placeholders[key];
+			if (!index)
+			{
+				values.push_back(&it->second.data);
+				index = values.size();
+			}
+			statement += "?" + stringify(index);
+		}
+		pos = end + 1;
+	}
+
+	if (values.size() > static_cast<unsigned>(sqlite3_limit(this->sql, SQLITE_LIMIT_VARIABLE_NUMBER, -1)))
+	{
+		values.clear();
+		return "";
+	}
+
+	return statement;
+}
+
+void SQLiteService::ClearStatements()
+{
+	for (std::map<Anope::string, sqlite3_stmt *>::iterator it = this->statements.begin(), it_end = this->statements.end(); it != it_end; ++it)
+		sqlite3_finalize(it->second);
+	this->statements.clear();
+}
+
 Anope::string SQLiteService::FromUnixtime(time_t t)
 {
 	return "datetime('" + stringify(t) + "', 'unixepoch')";
 }
 
+void DispatcherThread::Run()
+{
+	me->Dispatcher.Lock();
+
+	while (!this->GetExitState())
+	{
+		if (!me->QueryRequests.empty())
+		{
+			/* Take everything queued for the first database, up to a limit so the main thread
+			 * is not kept waiting too long if it needs the database itself
+			 */
+			SQLiteService *service = me->QueryRequests.front().service;
+			for (unsigned i = 0; i < me->QueryRequests.size() && me->RunningRequests.size() < 256;)
+			{
+				if (me->QueryRequests[i].service == service)
+				{
+					me->RunningRequests.push_back(me->QueryRequests[i]);
+					me->QueryRequests.erase(me->QueryRequests.begin() + i);
+				}
+				else
+					++i;
+			}
+
+			std::deque<QueryRequest> requests = me->RunningRequests;
+			std::vector<Result> results;
+
+			service->Lock.Lock();
+			me->Dispatcher.Unlock();
+
+			service->Execute(requests, results);
+			service->Lock.Unlock();
+
+			me->Dispatcher.Lock();
+			me->FinishRequests(me->RunningRequests, results);
+			me->RunningRequests.clear();
+		}
+		else
+		{
+			if (!me->FinishedRequests.empty())
+				me->Notify();
+			me->Dispatcher.Wait();
+		}
+	}
+
+	me->Dispatcher.Unlock();
+}
+
 MODULE_INIT(ModuleSQLite)
 
@@ -48,6 +48,15 @@ class SSLSocketIO : public SocketIO
 	 */
 	int Send(Socket *s, const char *buf, size_t sz) anope_override;
 
+	/** Write multiple buffers to the socket. SSL can not do scatter/gather
+	 * writes, so this writes each buffer in turn.
+	 * @param s The socket
+	 * @param iov The buffers to write
+	 * @param count The number of buffers
+	 * @return Number of bytes sent
+	 */
+	int Send(Socket *s, const struct iovec *iov, int count) anope_override;
+
 	/** Accept a connection from a socket
 	 * @param s The socket
 	 * @return The new socket
@@ -112,12 +121,11 @@ class SSLModule : public Module
 
 	~SSLModule()
 	{
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
 
-			if (dynamic_cast<SSLSocketIO *>(s->io))
+			if (s != NULL && dynamic_cast<SSLSocketIO *>(s->io))
 				delete s;
 		}
 
@@ -201,6 +209,21 @@ int SSLSocketIO::Send(Socket *s, const char *buf, size_t sz)
 	return i;
 }
 
+int SSLSocketIO::Send(Socket *s, const struct iovec *iov, int count)
+{
+	int total = 0;
+	for (int j = 0; j < count; ++j)
+	{
+		int i = this->Send(s, static_cast<const char *>(iov[j].iov_base), iov[j].iov_len);
+		if (i <= 0)
+			return total ? total : i;
+		total += i;
+		if (static_cast<size_t>(i) < iov[j].iov_len)
+			break;
+	}
+	return total;
+}
+
 ClientSocket *SSLSocketIO::Accept(ListenSocket *s)
 {
 	if (s->io == &NormalSocketIO)
@@ -89,9 +89,15 @@ bool WebCPanel::MemoServ::Memos::OnRequest(HTTPProvider *server, const Anope::st
 			if (!m)
 				replacements["MESSAGES"] = "ERROR - invalid memo number.";
 			else if (message.get_data["read"] == "1")
+			{
 				m->unread = false;
+				m->QueueUpdate();
+			}
 			else if (message.get_data["read"] == "2")
+			{
 				m->unread = true;
+				m->QueueUpdate();
+			}
 		}
 	}
 
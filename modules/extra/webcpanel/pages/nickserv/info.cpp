@@ -24,6 +24,7 @@ bool WebCPanel::NickServ::Info::OnRequest(HTTPProvider *server, const Anope::str
 				else
 				{
 					na->nc->email = message.post_data["email"];
+					na->nc->QueueUpdate();
 					replacements["MESSAGES"] = "Email updated";
 				}
 			}
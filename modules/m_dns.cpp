@@ -135,9 +135,15 @@ class Packet : public Query
 		record.ttl = (input[pos] << 24) | (input[pos + 1] << 16) | (input[pos + 2] << 8) | input[pos + 3];
 		pos += 4;
 
-		//record.rdlength = input[pos] << 8 | input[pos + 1];
+		unsigned short rdlength = input[pos] << 8 | input[pos + 1];
 		pos += 2;
 
+		if (pos + rdlength > input_size)
+			throw SocketException("Unable to unpack resource record");
+
+		/* Skip over record data we do not unpack, so the records after it can be */
+		unsigned short rdata_pos = pos;
+
 		switch (record.type)
 		{
 			case QUERY_A:
@@ -181,10 +187,30 @@ class Packet : public Query
 				record.rdata = this->UnpackName(input, input_size, pos);
 				break;
 			}
+			case QUERY_SOA:
+			{
+				/* Kept in presentation format, mname rname serial refresh retry expire minimum */
+				record.rdata = this->UnpackName(input, input_size, pos);
+				record.rdata += " " + this->UnpackName(input, input_size, pos);
+
+				if (pos + 20 > input_size)
+					throw SocketException("Unable to unpack resource record");
+
+				for (int j = 0; j < 5; ++j)
+				{
+					unsigned int value = (input[pos] << 24) | (input[pos + 1] << 16) | (input[pos + 2] << 8) | input[pos + 3];
+					pos += 4;
+
+					record.rdata += " " + stringify(value);
+				}
+				break;
+			}
 			default:
 				break;
 		}
 
+		pos = rdata_pos + rdlength;
+
 		Log(LOG_DEBUG_2) << "Resolver: " << record.name << " -> " << record.rdata;
 
 		return record;
@@ -644,25 +670,140 @@ class NotifySocket : public Socket
 	}
 };
 
+class MyManager;
+class PendingQuery;
+
+/* Sends queries to nameservers and receives the answers */
+class ResolverSocket : public UDPSocket
+{
+	MyManager *manager;
+
+ public:
+	/* Queries sent from this socket which have not been answered, indexed by id */
+	std::vector<PendingQuery *> queries;
+	/* Number of queries in queries */
+	unsigned count;
+
+	ResolverSocket(MyManager *m, bool v6);
+	~ResolverSocket();
+
+	/** Get an unused id for a query sent from this socket
+	 * @return The id
+	 */
+	unsigned short GetID();
+
+	bool ProcessRead() anope_override;
+};
+
+/* Sends a query again over TCP when the answer to it over UDP was truncated */
+class ResolverTCPSocket : public BinarySocket, public ConnectionSocket
+{
+	MyManager *manager;
+	std::vector<unsigned char> buffer;
+
+ public:
+	PendingQuery *query;
+
+	ResolverTCPSocket(MyManager *m, PendingQuery *q, bool v6) : Socket(-1, v6), manager(m), query(q) { }
+	~ResolverTCPSocket();
+
+	void OnError(const Anope::string &error) anope_override;
+	bool Read(const char *data, size_t len) anope_override;
+};
+
+/** A query sent to a nameserver, and the requests waiting for its answer
+ */
+class PendingQuery : public Timer
+{
+	MyManager *manager;
+
+ public:
+	Question question;
+	std::vector<Request *> requests;
+	/* Socket the query was sent from, and its id on that socket */
+	ResolverSocket *sock;
+	unsigned short id;
+	/* The nameserver the query was sent to */
+	unsigned server;
+	/* Connection the query is being sent again on, if the answer was truncated */
+	ResolverTCPSocket *tcp;
+
+	PendingQuery(MyManager *m, const Question &q, ResolverSocket *s, unsigned ns);
+	~PendingQuery();
+
+	/** Called when the nameserver has not answered in time
+	 */
+	void Tick(time_t) anope_override;
+};
+
 class MyManager : public Manager, public Timer
 {
 	uint32_t serial;
 
-	typedef TR1NS::unordered_map<Question, Query, Question::hash> cache_map;
+	/** A cached answer, or a cached failure to find one
+	 */
+	struct CacheEntry
+	{
+		Query query;
+		/* When this entry expires */
+		time_t expires;
+		/* Position of this entry in cache_lru and cache_expiry */
+		std::list<Question>::iterator lru;
+		std::multimap<time_t, Question>::iterator expiry;
+	};
+
+	typedef TR1NS::unordered_map<Question, CacheEntry, Question::hash> cache_map;
 	cache_map cache;
+	/* Cached questions, most recently used first */
+	std::list<Question> cache_lru;
+	/* Cached questions, ordered by when they expire */
+	std::multimap<time_t, Question> cache_expiry;
+	/* Maximum number of entries in the cache */
+	unsigned cache_size;
+
+	/** A nameserver queries are sent to
+	 */
+	struct Nameserver
+	{
+		/* Queries in a row which may go unanswered before the nameserver is only tried
+		 * again every RETRY_TIME seconds
+		 */
+		static const unsigned MAX_FAILURES = 3;
+		static const time_t RETRY_TIME = 60;
+
+		sockaddrs addr;
+		/* Queries sent to this nameserver in a row which were not answered */
+		unsigned failures;
+		/* When to next try this nameserver, if it has stopped answering */
+		time_t retry;
+
+		Nameserver() : failures(0), retry(0) { }
+	};
+
+	std::vector<Nameserver> servers;
+	unsigned next_server;
+
+	/* Sockets queries are sent from. Each has its own ids, so more queries can be sent at once */
+	std::vector<ResolverSocket *> resolvers;
+	unsigned next_resolver;
+
+	Stats stats;
 
 	TCPSocket *tcpsock;
 	UDPSocket *udpsock;
 
 	bool listen;
-	sockaddrs addrs;
 
 	std::vector<std::pair<Anope::string, short> > notify;
  public:
-	std::map<unsigned short, Request *> requests;
+	/* Queries sent to a nameserver which have not been answered, by question. Requests
+	 * for the same question share one query.
+	 */
+	typedef TR1NS::unordered_map<Question, PendingQuery *, Question::hash> pending_map;
+	pending_map pending;
 
-	MyManager(Module *creator) : Manager(creator), Timer(300, Anope::CurTime, true), serial(Anope::CurTime), tcpsock(NULL), udpsock(NULL),
-		listen(false), cur_id(rand())
+	MyManager(Module *creator) : Manager(creator), Timer(300, Anope::CurTime, true), serial(Anope::CurTime), cache_size(0), next_server(0), next_resolver(0),
+		tcpsock(NULL), udpsock(NULL), listen(false)
 	{
 	}
 
@@ -671,10 +812,22 @@ class MyManager : public Manager, public Timer
 		delete udpsock;
 		delete tcpsock;
 
-		for (std::map<unsigned short, Request *>::iterator it = this->requests.begin(), it_end = this->requests.end(); it != it_end;)
-		{	
-			Request *request = it->second;
-			++it;
+		std::vector<Request *> reqs;
+		for (pending_map::iterator it = this->pending.begin(), it_end = this->pending.end(); it != it_end; ++it)
+		{
+			std::vector<Request *> &qreqs = it->second->requests;
+			reqs.insert(reqs.end(), qreqs.begin(), qreqs.end());
+			qreqs.clear();
+		}
+
+		for (unsigned i = 0; i < this->resolvers.size(); ++i)
+			delete this->resolvers[i];
+		this->resolvers.clear();
+		this->pending.clear();
+
+		for (unsigned i = 0; i < reqs.size(); ++i)
+		{
+			Request *request = reqs[i];
 
 			Query rr(*request);
 			rr.error = ERROR_UNKNOWN;
@@ -682,12 +835,21 @@ class MyManager : public Manager, public Timer
 
 			delete request;
 		}
-		this->requests.clear();
 
 		this->cache.clear();
+		this->cache_lru.clear();
+		this->cache_expiry.clear();
+	}
+
+	void SetCacheSize(unsigned size)
+	{
+		this->cache_size = size;
+
+		while (this->cache.size() > this->cache_size)
+			this->EvictCache();
 	}
 
-	void SetIPPort(const Anope::string &nameserver, const Anope::string &ip, unsigned short port, std::vector<std::pair<Anope::string, short> > n)
+	void SetIPPort(const std::vector<Anope::string> &nameserver_ips, const Anope::string &ip, unsigned short port, std::vector<std::pair<Anope::string, short> > n, unsigned sockets)
 	{
 		delete udpsock;
 		delete tcpsock;
@@ -695,14 +857,52 @@ class MyManager : public Manager, public Timer
 		udpsock = NULL;
 		tcpsock = NULL;
 
-		try
+		/* Queries sent from the old sockets can not be answered, their requests time out */
+		for (unsigned i = 0; i < this->resolvers.size(); ++i)
+			delete this->resolvers[i];
+		this->resolvers.clear();
+
+		bool v4 = false, v6 = false;
+		this->servers.clear();
+		for (unsigned i = 0; i < nameserver_ips.size(); ++i)
 		{
-			this->addrs.pton(nameserver.find(':') != Anope::string::npos ? AF_INET6 : AF_INET, nameserver, 53);
+			const Anope::string &nameserver = nameserver_ips[i];
 
-			udpsock = new UDPSocket(this, ip, port);
+			Nameserver ns;
+			ns.addr.pton(nameserver.find(':') != Anope::string::npos ? AF_INET6 : AF_INET, nameserver, 53);
+			if (!ns.addr.valid())
+			{
+				Log() << "Resolver: Invalid nameserver " << nameserver;
+				continue;
+			}
 
+			if (ns.addr.ipv6())
+				v6 = true;
+			else
+				v4 = true;
+			this->servers.push_back(ns);
+		}
+
+		try
+		{
+			for (unsigned i = 0; i < sockets; ++i)
+			{
+				if (v4)
+					this->resolvers.push_back(new ResolverSocket(this, false));
+				if (v6)
+					this->resolvers.push_back(new ResolverSocket(this, true));
+			}
+		}
+		catch (const SocketException &ex)
+		{
+			Log() << "Unable to create dns socket: " << ex.GetReason();
+		}
+
+		try
+		{
 			if (!ip.empty())
 			{
+				udpsock = new UDPSocket(this, ip, port);
 				udpsock->Bind(ip, port);
 				tcpsock = new TCPSocket(this, ip, port);
 				listen = true;
@@ -717,18 +917,49 @@ class MyManager : public Manager, public Timer
 	}
 
  private:
-	unsigned short cur_id;
+	/** Choose the nameserver to send a query to. Nameservers are used in turn, skipping
+	 * ones which have stopped answering, except to try them again every so often.
+	 * @return The index of the nameserver
+	 */
+	unsigned ChooseServer()
+	{
+		for (unsigned i = 0; i < this->servers.size(); ++i)
+		{
+			unsigned idx = (this->next_server + i) % this->servers.size();
+			Nameserver &ns = this->servers[idx];
 
-	unsigned short GetID()
+			if (ns.failures >= Nameserver::MAX_FAILURES)
+			{
+				if (ns.retry > Anope::CurTime)
+					continue;
+				ns.retry = Anope::CurTime + Nameserver::RETRY_TIME;
+			}
+
+			this->next_server = idx + 1;
+			return idx;
+		}
+
+		/* None are answering, keep trying all of them */
+		return this->next_server++ % this->servers.size();
+	}
+
+	/** Choose the socket to send a query from
+	 * @param v6 Whether the query is being sent to an IPv6 nameserver
+	 * @return The socket
+	 */
+	ResolverSocket *ChooseSocket(bool v6)
 	{
-		if (this->udpsock->GetPackets().size() == 65535)
-			throw SocketException("DNS queue full");
+		for (unsigned i = 0; i < this->resolvers.size(); ++i)
+		{
+			ResolverSocket *sock = this->resolvers[(this->next_resolver + i) % this->resolvers.size()];
+			if (sock->IsIPv6() != v6 || sock->count >= 65535)
+				continue;
 
-		do
-			cur_id = (cur_id + 1) & 0xFFFF;
-		while (!cur_id || this->requests.count(cur_id));
+			this->next_resolver += i + 1;
+			return sock;
+		}
 
-		return cur_id;
+		throw SocketException("DNS queue full");
 	}
 
  public:
@@ -743,25 +974,54 @@ class MyManager : public Manager, public Timer
 			return;
 		}
 
-		if (!this->udpsock)
+		/* If this question has already been asked, wait for that answer instead of asking again */
+		pending_map::iterator it = this->pending.find(*req);
+		if (it != this->pending.end())
+		{
+			PendingQuery *query = it->second;
+			Log(LOG_DEBUG_2) << "Resolver: Waiting for the answer to query " << query->id;
+			req->id = query->id;
+			query->requests.push_back(req);
+			req->SetSecs(timeout);
+			++this->stats.coalesced;
+			return;
+		}
+
+		if (this->servers.empty() || this->resolvers.empty())
 			throw SocketException("No dns socket");
 
-		req->id = GetID();
-		this->requests[req->id] = req;
+		unsigned server = this->ChooseServer();
+		ResolverSocket *sock = this->ChooseSocket(this->servers[server].addr.ipv6());
+
+		PendingQuery *query = new PendingQuery(this, *req, sock, server);
+		query->requests.push_back(req);
+		this->pending[*req] = query;
+		++this->stats.queries;
 
+		req->id = query->id;
 		req->SetSecs(timeout);
 	
-		Packet *p = new Packet(this, &this->addrs);
+		Packet *p = new Packet(this, &this->servers[server].addr);
 		p->flags = QUERYFLAGS_RD;
-		p->id = req->id;
+		p->id = query->id;
 		p->questions.push_back(*req);
 
-		this->udpsock->Reply(p);
+		sock->Reply(p);
 	}
 
 	void RemoveRequest(Request *req) anope_override
 	{
-		this->requests.erase(req->id);
+		/* The query stays pending when nothing is waiting for it, so the id is not reused
+		 * before the answer arrives and its answer can still be cached
+		 */
+		pending_map::iterator it = this->pending.find(*req);
+		if (it == this->pending.end())
+			return;
+
+		std::vector<Request *> &reqs = it->second->requests;
+		std::vector<Request *>::iterator rit = std::find(reqs.begin(), reqs.end(), req);
+		if (rit != reqs.end())
+			reqs.erase(rit);
 	}
 
 	bool HandlePacket(ReplySocket *s, const unsigned char *const packet_buffer, int length, sockaddrs *from) anope_override
@@ -841,30 +1101,178 @@ class MyManager : public Manager, public Timer
 			return true;
 		}
 
-		if (from == NULL)
+		Log(LOG_DEBUG_2) << "Resolver: Received an answer on a listening socket";
+		return true;
+	}
+
+	/** Called when a query is no longer pending
+	 * @param query The query
+	 */
+	void ForgetQuery(PendingQuery *query)
+	{
+		query->sock->queries[query->id] = NULL;
+		--query->sock->count;
+
+		pending_map::iterator it = this->pending.find(query->question);
+		if (it != this->pending.end() && it->second == query)
+			this->pending.erase(it);
+	}
+
+	/** Called when a nameserver does not answer a query in time
+	 * @param query The query
+	 */
+	void OnTimeout(PendingQuery *query)
+	{
+		Nameserver &ns = this->servers[query->server];
+
+		Log(LOG_DEBUG_2) << "Resolver: " << ns.addr.addr() << " did not answer query " << query->id << " for " << query->question.name;
+		++this->stats.timeouts;
+
+		if (++ns.failures == Nameserver::MAX_FAILURES)
+			Log() << "Resolver: Nameserver " << ns.addr.addr() << " is not answering";
+		if (ns.failures >= Nameserver::MAX_FAILURES)
+			ns.retry = Anope::CurTime + Nameserver::RETRY_TIME;
+	}
+
+	/** Called when an answer is received on a resolver socket
+	 */
+	bool HandleAnswer(ResolverSocket *s, const unsigned char *const packet_buffer, int length, sockaddrs *from)
+	{
+		if (length < Packet::HEADER_LENGTH)
+			return true;
+
+		Packet recv_packet(this, from);
+
+		try
 		{
-			Log(LOG_DEBUG_2) << "Resolver: Received an answer over TCP. This is not supported.";
+			recv_packet.Fill(packet_buffer, length);
+		}
+		catch (const SocketException &ex)
+		{
+			Log(LOG_DEBUG_2) << ex.GetReason();
 			return true;
 		}
-		else if (this->addrs != *from)
+
+		if (!(recv_packet.flags & QUERYFLAGS_QR))
 		{
-			Log(LOG_DEBUG_2) << "Resolver: Received an answer from the wrong nameserver, Bad NAT or DNS forging attempt? '" << this->addrs.addr() << "' != '" << from->addr() << "'";
+			Log(LOG_DEBUG_2) << "Resolver: Received a question on a resolver socket";
 			return true;
 		}
 
-		std::map<unsigned short, Request *>::iterator it = this->requests.find(recv_packet.id);
-		if (it == this->requests.end())
+		PendingQuery *query = s->queries[recv_packet.id];
+		if (query == NULL)
 		{
 			Log(LOG_DEBUG_2) << "Resolver: Received an answer for something we didn't request";
 			return true;
 		}
-		Request *request = it->second;
+
+		const sockaddrs &addr = this->servers[query->server].addr;
+		if (addr != *from)
+		{
+			Log(LOG_DEBUG_2) << "Resolver: Received an answer from the wrong nameserver, Bad NAT or DNS forging attempt? '" << addr.addr() << "' != '" << from->addr() << "'";
+			return true;
+		}
+
+		if (recv_packet.flags & QUERYFLAGS_TC)
+		{
+			if (!query->tcp)
+				this->RetryTCP(query);
+			return true;
+		}
+
+		this->ProcessAnswer(query, recv_packet);
+		return true;
+	}
+
+	/** Called when an answer is received for a query sent again over TCP
+	 */
+	void HandleTCPAnswer(ResolverTCPSocket *s, const unsigned char *const packet_buffer, unsigned short length)
+	{
+		PendingQuery *query = s->query;
+		s->query = NULL;
+		query->tcp = NULL;
+
+		Packet recv_packet(this, &this->servers[query->server].addr);
+
+		try
+		{
+			recv_packet.Fill(packet_buffer, length);
+		}
+		catch (const SocketException &ex)
+		{
+			Log(LOG_DEBUG_2) << ex.GetReason();
+			return;
+		}
+
+		if (!(recv_packet.flags & QUERYFLAGS_QR) || recv_packet.id != query->id)
+		{
+			Log(LOG_DEBUG_2) << "Resolver: Received an answer for something we didn't request over TCP";
+			return;
+		}
+
+		this->ProcessAnswer(query, recv_packet);
+	}
+
+ private:
+	/** Send a query again over TCP, because the answer over UDP was truncated
+	 * @param query The query
+	 */
+	void RetryTCP(PendingQuery *query)
+	{
+		const sockaddrs &addr = this->servers[query->server].addr;
+
+		Log(LOG_DEBUG_2) << "Resolver: Answer for " << query->question.name << " was truncated, asking again over TCP";
+		++this->stats.truncated;
+
+		Packet p(this, NULL);
+		p.flags = QUERYFLAGS_RD;
+		p.id = query->id;
+		p.questions.push_back(query->question);
+
+		try
+		{
+			unsigned char buffer[524];
+			unsigned short len = p.Pack(buffer + 2, sizeof(buffer) - 2);
+
+			short s = htons(len);
+			memcpy(buffer, &s, 2);
+			len += 2;
+
+			query->tcp = new ResolverTCPSocket(this, query, addr.ipv6());
+			query->tcp->Connect(addr.addr(), addr.port());
+			query->tcp->Write(reinterpret_cast<char *>(buffer), len);
+		}
+		catch (const SocketException &ex)
+		{
+			Log(LOG_DEBUG_2) << "Resolver: Unable to ask over TCP: " << ex.GetReason();
+			delete query->tcp;
+		}
+	}
+
+	/** Answer the requests waiting on a query
+	 * @param query The query, which is deleted
+	 * @param recv_packet The answer
+	 */
+	void ProcessAnswer(PendingQuery *query, Packet &recv_packet)
+	{
+		Nameserver &ns = this->servers[query->server];
+		if (ns.failures >= Nameserver::MAX_FAILURES)
+			Log() << "Resolver: Nameserver " << ns.addr.addr() << " is answering again";
+		ns.failures = 0;
+
+		/* Take the requests off of the query, anything now asking the same question has to ask again */
+		std::vector<Request *> reqs;
+		reqs.swap(query->requests);
+		Question question = query->question;
+		delete query;
+
+		for (unsigned i = 0; i < reqs.size(); ++i)
+			reqs[i]->id = 0;
 
 		if (recv_packet.flags & QUERYFLAGS_OPCODE)
 		{
 			Log(LOG_DEBUG_2) << "Resolver: Received a nonstandard query";
 			recv_packet.error = ERROR_NONSTANDARD_QUERY;
-			request->OnError(&recv_packet);
 		}
 		else if (recv_packet.flags & QUERYFLAGS_RCODE)
 		{
@@ -897,25 +1305,31 @@ class MyManager : public Manager, public Timer
 			}
 
 			recv_packet.error = error;
-			request->OnError(&recv_packet);
 		}
 		else if (recv_packet.questions.empty() || recv_packet.answers.empty())
 		{
 			Log(LOG_DEBUG_2) << "Resolver: No resource records returned";
 			recv_packet.error = ERROR_NO_RECORDS;
-			request->OnError(&recv_packet);
 		}
 		else
+			Log(LOG_DEBUG_2) << "Resolver: Lookup complete for " << question.name;
+
+		this->AddCache(question, recv_packet);
+
+		for (unsigned i = 0; i < reqs.size(); ++i)
 		{
-			Log(LOG_DEBUG_2) << "Resolver: Lookup complete for " << request->name;
-			request->OnLookupComplete(&recv_packet);
-			this->AddCache(recv_packet);
+			Request *request = reqs[i];
+
+			if (recv_packet.error != ERROR_NONE)
+				request->OnError(&recv_packet);
+			else
+				request->OnLookupComplete(&recv_packet);
+
+			delete request;
 		}
-	
-		delete request;
-		return true;
 	}
 
+ public:
 	void UpdateSerial() anope_override
 	{
 		serial = Anope::CurTime;
@@ -936,15 +1350,7 @@ class MyManager : public Manager, public Timer
 
 			Packet *packet = new Packet(this, &addr);
 			packet->flags = QUERYFLAGS_AA | QUERYFLAGS_OPCODE_NOTIFY;
-			try
-			{
-				packet->id = GetID();
-			}
-			catch (const SocketException &)
-			{
-				delete packet;
-				continue;
-			}
+			packet->id = rand();
 
 			packet->questions.push_back(Question(zone, QUERY_SOA));
 
@@ -957,31 +1363,117 @@ class MyManager : public Manager, public Timer
 		return serial;
 	}
 
+	bool GetStats(Stats &st) anope_override
+	{
+		st = this->stats;
+		st.entries = this->cache.size();
+		st.pending = 0;
+		for (unsigned i = 0; i < this->resolvers.size(); ++i)
+			st.pending += this->resolvers[i]->count;
+		return true;
+	}
+
 	void Tick(time_t now) anope_override
 	{
 		Log(LOG_DEBUG_2) << "Resolver: Purging DNS cache";
+		this->PurgeCache(now);
+	}
+	
+ private:
+	/** Get how long a query can be cached for. Answers are cached for the lowest TTL of their
+	 * records, and as in RFC 2308 nonexistent names and names without records of the type asked for
+	 * are cached for the lower of the TTL and minimum field of the SOA record sent with the answer.
+	 * @param r The query
+	 * @return The TTL, or 0 if the query can not be cached
+	 */
+	time_t GetCacheTTL(const Query &r) const
+	{
+		time_t ttl = 0;
 
-		for (cache_map::iterator it = this->cache.begin(), it_next; it != this->cache.end(); it = it_next)
+		if (r.error == ERROR_NONE)
+		{
+			for (unsigned i = 0; i < r.answers.size(); ++i)
+				if (!i || r.answers[i].ttl < ttl)
+					ttl = r.answers[i].ttl;
+		}
+		else if (r.error == ERROR_DOMAIN_NOT_FOUND || r.error == ERROR_NO_RECORDS)
 		{
-			const Query &q = it->second;
-			const ResourceRecord &req = q.answers[0];
-			it_next = it;
-			++it_next;
+			for (unsigned i = 0; i < r.authorities.size(); ++i)
+			{
+				const ResourceRecord &rr = r.authorities[i];
+				if (rr.type != QUERY_SOA)
+					continue;
 
-			if (req.created + static_cast<time_t>(req.ttl) < now)
-				this->cache.erase(it);
+				try
+				{
+					time_t minimum = convertTo<unsigned int>(rr.rdata.substr(rr.rdata.rfind(' ') + 1));
+					ttl = std::min(static_cast<time_t>(rr.ttl), minimum);
+				}
+				catch (const ConvertException &) { }
+				break;
+			}
 		}
+
+		return ttl;
 	}
-	
- private:
+
+	/** Remove an entry from the dns cache
+	 * @param it The entry
+	 */
+	void EraseCache(cache_map::iterator it)
+	{
+		this->cache_lru.erase(it->second.lru);
+		this->cache_expiry.erase(it->second.expiry);
+		this->cache.erase(it);
+	}
+
+	/** Remove expired entries from the dns cache
+	 * @param now The current time
+	 */
+	void PurgeCache(time_t now)
+	{
+		while (!this->cache_expiry.empty() && this->cache_expiry.begin()->first <= now)
+			this->EraseCache(this->cache.find(this->cache_expiry.begin()->second));
+	}
+
+	/** Make room in the dns cache for an entry, removing expired entries first, soonest to
+	 * expire first, and then the least recently used entry
+	 */
+	void EvictCache()
+	{
+		this->PurgeCache(Anope::CurTime);
+		if (this->cache.size() < this->cache_size || this->cache_lru.empty())
+			return;
+
+		Log(LOG_DEBUG_3) << "Resolver cache: evicting " << this->cache_lru.back().name;
+		this->EraseCache(this->cache.find(this->cache_lru.back()));
+		++this->stats.evictions;
+	}
+
 	/** Add a record to the dns cache
+	 * @param q The question the record answers
 	 * @param r The record
 	 */
-	void AddCache(Query &r)
+	void AddCache(const Question &q, const Query &r)
 	{
-		const ResourceRecord &rr = r.answers[0];
-		Log(LOG_DEBUG_3) << "Resolver cache: added cache for " << rr.name << " -> " << rr.rdata << ", ttl: " << rr.ttl;
-		this->cache[r.questions[0]] = r;
+		time_t ttl = this->GetCacheTTL(r);
+		if (ttl <= 0 || !this->cache_size)
+			return;
+
+		cache_map::iterator it = this->cache.find(q);
+		if (it != this->cache.end())
+			this->EraseCache(it);
+
+		while (this->cache.size() >= this->cache_size)
+			this->EvictCache();
+
+		Log(LOG_DEBUG_3) << "Resolver cache: added cache for " << q.name << (r.error == ERROR_NONE ? " -> " + r.answers[0].rdata : " (negative)") << ", ttl: " << ttl;
+
+		CacheEntry &entry = this->cache[q];
+		entry.query = r;
+		entry.expires = Anope::CurTime + ttl;
+		entry.lru = this->cache_lru.insert(this->cache_lru.begin(), q);
+		entry.expiry = this->cache_expiry.insert(std::make_pair(entry.expires, q));
 	}
 
 	/** Check the DNS cache to see if request can be handled by a cached result
@@ -990,19 +1482,122 @@ class MyManager : public Manager, public Timer
 	bool CheckCache(Request *request)
 	{
 		cache_map::iterator it = this->cache.find(*request);
-		if (it != this->cache.end())
+		if (it == this->cache.end() || it->second.expires <= Anope::CurTime)
 		{
-			Query &record = it->second;
-			Log(LOG_DEBUG_3) << "Resolver: Using cached result for " << request->name;
-			request->OnLookupComplete(&record);
-			return true;
+			++this->stats.misses;
+			return false;
 		}
 
-		return false;
+		CacheEntry &entry = it->second;
+		this->cache_lru.splice(this->cache_lru.begin(), this->cache_lru, entry.lru);
+		++this->stats.hits;
+
+		Query &record = entry.query;
+		Log(LOG_DEBUG_3) << "Resolver: Using cached result for " << request->name;
+		if (record.error != ERROR_NONE)
+		{
+			++this->stats.negative_hits;
+			request->OnError(&record);
+		}
+		else
+			request->OnLookupComplete(&record);
+		return true;
 	}
   
 };
 
+ResolverSocket::ResolverSocket(MyManager *m, bool v6) : Socket(-1, v6, SOCK_DGRAM), UDPSocket(m, v6 ? "::" : "0.0.0.0", 0), manager(m), queries(65536), count(0)
+{
+	/* Send from a random port, which makes forging answers harder */
+	for (int i = 0; i < 10; ++i)
+	{
+		try
+		{
+			this->Bind(v6 ? "::" : "0.0.0.0", 1024 + rand() % (65536 - 1024));
+			return;
+		}
+		catch (const SocketException &) { }
+	}
+}
+
+ResolverSocket::~ResolverSocket()
+{
+	for (unsigned i = 0; i < this->queries.size(); ++i)
+		delete this->queries[i];
+}
+
+unsigned short ResolverSocket::GetID()
+{
+	if (this->count >= 65535)
+		throw SocketException("DNS queue full");
+
+	unsigned short id = rand();
+	while (!id || this->queries[id])
+		++id;
+
+	return id;
+}
+
+bool ResolverSocket::ProcessRead()
+{
+	Log(LOG_DEBUG_2) << "Resolver: Reading from DNS resolver socket";
+
+	unsigned char packet_buffer[524];
+	sockaddrs from_server;
+	socklen_t x = sizeof(from_server);
+	int length = recvfrom(this->GetFD(), reinterpret_cast<char *>(&packet_buffer), sizeof(packet_buffer), 0, &from_server.sa, &x);
+	return this->manager->HandleAnswer(this, packet_buffer, length, &from_server);
+}
+
+ResolverTCPSocket::~ResolverTCPSocket()
+{
+	if (this->query)
+		this->query->tcp = NULL;
+}
+
+void ResolverTCPSocket::OnError(const Anope::string &error)
+{
+	Log(LOG_DEBUG_2) << "Resolver: Error asking over TCP: " << error;
+}
+
+bool ResolverTCPSocket::Read(const char *data, size_t len)
+{
+	this->buffer.insert(this->buffer.end(), data, data + len);
+	if (this->buffer.size() < 2)
+		return true;
+
+	unsigned short want_len = this->buffer[0] << 8 | this->buffer[1];
+	if (this->buffer.size() < want_len + 2u)
+		return true;
+
+	if (this->query)
+		this->manager->HandleTCPAnswer(this, &this->buffer[2], want_len);
+	return false;
+}
+
+PendingQuery::PendingQuery(MyManager *m, const Question &q, ResolverSocket *s, unsigned ns) : Timer(timeout), manager(m), question(q), sock(s), server(ns), tcp(NULL)
+{
+	this->id = s->GetID();
+	s->queries[this->id] = this;
+	++s->count;
+}
+
+PendingQuery::~PendingQuery()
+{
+	this->manager->ForgetQuery(this);
+
+	if (this->tcp)
+	{
+		this->tcp->query = NULL;
+		delete this->tcp;
+	}
+}
+
+void PendingQuery::Tick(time_t)
+{
+	this->manager->OnTimeout(this);
+}
+
 class ModuleDNS : public Module
 {
 	MyManager manager;
@@ -1021,12 +1616,11 @@ class ModuleDNS : public Module
 
 	~ModuleDNS()
 	{
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
 
-			if (dynamic_cast<NotifySocket *>(s) || dynamic_cast<TCPSocket::Client *>(s))
+			if (dynamic_cast<NotifySocket *>(s) || dynamic_cast<TCPSocket::Client *>(s) || dynamic_cast<ResolverTCPSocket *>(s))
 				delete s;
 		}
 	}
@@ -1042,6 +1636,7 @@ class ModuleDNS : public Module
 		admin = block->Get<const Anope::string>("admin", "admin@example.com");
 		nameservers = block->Get<const Anope::string>("nameservers", "ns1.example.com");
 		refresh = block->Get<int>("refresh", "3600");
+		this->manager.SetCacheSize(block->Get<unsigned>("cachesize", "4096"));
 
 		for (int i = 0; i < block->CountBlock("notify"); ++i)
 		{
@@ -1052,10 +1647,10 @@ class ModuleDNS : public Module
 			notify.push_back(std::make_pair(nip, nport));
 		}
 
+		std::vector<Anope::string> nameserver_ips;
 		if (Anope::IsFile(nameserver))
 		{
 			std::ifstream f(nameserver.c_str());
-			bool success = false;
 
 			if (f.is_open())
 			{
@@ -1068,10 +1663,8 @@ class ModuleDNS : public Module
 						{
 							if (server.substr(i).is_pos_number_only())
 							{
-								nameserver = server.substr(i);
-								Log(LOG_DEBUG) << "Nameserver set to " << nameserver;
-								success = true;
-								break;
+								nameserver_ips.push_back(server.substr(i));
+								Log(LOG_DEBUG) << "Using nameserver " << server.substr(i);
 							}
 						}
 					}
@@ -1080,16 +1673,22 @@ class ModuleDNS : public Module
 				f.close();
 			}
 
-			if (!success)
+			if (nameserver_ips.empty())
 			{
 				Log() << "Unable to find nameserver, defaulting to 127.0.0.1";
-				nameserver = "127.0.0.1";
+				nameserver_ips.push_back("127.0.0.1");
 			}
 		}
+		else
+			spacesepstream(nameserver).GetTokens(nameserver_ips);
+
+		unsigned sockets = block->Get<unsigned>("sockets", "2");
+		if (!sockets)
+			sockets = 1;
 
 		try
 		{
-			this->manager.SetIPPort(nameserver, ip, port, notify);
+			this->manager.SetIPPort(nameserver_ips, ip, port, notify, sockets);
 		}
 		catch (const SocketException &ex)
 		{
@@ -1099,21 +1698,24 @@ class ModuleDNS : public Module
 
 	void OnModuleUnload(User *u, Module *m) anope_override
 	{
-		for (std::map<unsigned short, Request *>::iterator it = this->manager.requests.begin(), it_end = this->manager.requests.end(); it != it_end;)
+		std::vector<Request *> reqs;
+		for (MyManager::pending_map::iterator it = this->manager.pending.begin(), it_end = this->manager.pending.end(); it != it_end; ++it)
 		{
-			unsigned short id = it->first;
-			Request *req = it->second;
-			++it;
+			const std::vector<Request *> &qreqs = it->second->requests;
+			for (unsigned i = 0; i < qreqs.size(); ++i)
+				if (qreqs[i]->creator == m)
+					reqs.push_back(qreqs[i]);
+		}
 
-			if (req->creator == m)
-			{
-				Query rr(*req);
-				rr.error = ERROR_UNLOADED;
-				req->OnError(&rr);
+		for (unsigned i = 0; i < reqs.size(); ++i)
+		{
+			Request *req = reqs[i];
 
-				delete req;
-				this->manager.requests.erase(id);
-			}
+			Query rr(*req);
+			rr.error = ERROR_UNLOADED;
+			req->OnError(&rr);
+
+			delete req;
 		}
 	}
 };
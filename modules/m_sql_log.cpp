@@ -64,7 +64,7 @@ class SQLLog : public Module
 		}
 
 		SQL::Query insert("INSERT INTO `" + table + "` (`type`,`user`,`acc`,`command`,`channel`,`msg`)"
-			"VALUES (@type@, @user@, @acc@, @command@, @channel@, @msg@)");
+			"VALUES (@type@, @user@, @acc@, @command@, @channel@, @msg@)", true);
 
 		switch (l->type)
 		{
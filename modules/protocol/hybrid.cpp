@@ -420,42 +420,48 @@ struct IRCDMessageSJoin : IRCDMessage
 	IRCDMessageSJoin(Module *creator) : IRCDMessage(creator, "SJOIN", 2) { SetFlag(IRCDMESSAGE_REQUIRE_SERVER); SetFlag(IRCDMESSAGE_SOFT_LIMIT); }
 
 	void Run(MessageSource &source, const std::vector<Anope::string> &params) anope_override
+	{
+		this->Dispatch(source, ParsedMessage(params));
+	}
+
+	/* A burst has one of these for every channel, so the nick list is read straight out of the line */
+	void Dispatch(MessageSource &source, const ParsedMessage &params) anope_override
 	{
 		Anope::string modes;
-		if (params.size() >= 3)
-			for (unsigned i = 2; i < params.size() - 1; ++i)
-				modes += " " + params[i];
+		for (unsigned i = 2; i + 1 < params.size(); ++i)
+			modes += " " + params[i].str();
 		if (!modes.empty())
 			modes.erase(modes.begin());
 
+		const Anope::string channel = params[1].str();
 		std::list<Message::Join::SJoinUser> users;
 
-		spacesepstream sep(params[params.size() - 1]);
-		Anope::string buf;
+		const MessageToken &nicks = params[params.size() - 1];
+		MessageToken buf;
 
-		while (sep.GetToken(buf))
+		for (size_t pos = 0; nicks.GetWord(pos, buf);)
 		{
 			Message::Join::SJoinUser sju;
 
 			/* Get prefixes from the nick */
-			for (char ch; (ch = ModeManager::GetStatusChar(buf[0]));)
-			{
-				buf.erase(buf.begin());
+			size_t i = 0;
+			for (char ch; i < buf.length() && (ch = ModeManager::GetStatusChar(buf[i])); ++i)
 				sju.first.AddMode(ch);
-			}
 
-			sju.second = User::Find(buf);
+			const Anope::string nick(buf.data() + i, buf.length() - i);
+			sju.second = User::Find(nick);
 			if (!sju.second)
 			{
-				Log(LOG_DEBUG) << "SJOIN for nonexistant user " << buf << " on " << params[1];
+				Log(LOG_DEBUG) << "SJOIN for nonexistant user " << nick << " on " << channel;
 				continue;
 			}
 
 			users.push_back(sju);
 		}
 
-		time_t ts = Anope::string(params[0]).is_pos_number_only() ? convertTo<time_t>(params[0]) : Anope::CurTime;
-		Message::Join::SJoin(source, params[1], ts, modes, users);
+		const Anope::string sts = params[0].str();
+		time_t ts = sts.is_pos_number_only() ? convertTo<time_t>(sts) : Anope::CurTime;
+		Message::Join::SJoin(source, channel, ts, modes, users);
 	}
 };
 
@@ -531,20 +537,27 @@ struct IRCDMessageUID : IRCDMessage
 	/* :0MC UID Steve 1 1350157102 +oi ~steve resolved.host 10.0.0.1 0MCAAAAAB 1350157108 :Mining all the time */
 	void Run(MessageSource &source, const std::vector<Anope::string> &params) anope_override
 	{
-		Anope::string ip = params[6];
+		this->Dispatch(source, ParsedMessage(params));
+	}
+
+	void Dispatch(MessageSource &source, const ParsedMessage &params) anope_override
+	{
+		Anope::string ip;
 
-		if (ip == "0") /* Can be 0 for spoofed clients */
-			ip.clear();
+		if (!params[6].equals_cs("0")) /* Can be 0 for spoofed clients */
+			ip = params[6].str();
 
 		NickAlias *na = NULL;
-		if (params[8] != "0")
-			na = NickAlias::Find(params[8]);
+		if (!params[8].equals_cs("0"))
+			na = NickAlias::Find(params[8].str());
+
+		const Anope::string ts = params[2].str();
 
 		/* Source is always the server */
-		new User(params[0], params[4], params[5], "",
+		new User(params[0].str(), params[4].str(), params[5].str(), "",
 				ip, source.GetServer(),
-				params[9], params[2].is_pos_number_only() ? convertTo<time_t>(params[2]) : 0,
-				params[3], params[7], na ? *na->nc : NULL);
+				params[9].str(), ts.is_pos_number_only() ? convertTo<time_t>(ts) : 0,
+				params[3].str(), params[7].str(), na ? *na->nc : NULL);
 	}
 };
 
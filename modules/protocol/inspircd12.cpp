@@ -955,46 +955,50 @@ struct IRCDMessageFJoin : IRCDMessage
 	IRCDMessageFJoin(Module *creator) : IRCDMessage(creator, "FJOIN", 2) { SetFlag(IRCDMESSAGE_REQUIRE_SERVER); SetFlag(IRCDMESSAGE_SOFT_LIMIT); }
 
 	void Run(MessageSource &source, const std::vector<Anope::string> &params) anope_override
+	{
+		this->Dispatch(source, ParsedMessage(params));
+	}
+
+	/* A burst has one of these for every channel, so the user list is read straight out of the line */
+	void Dispatch(MessageSource &source, const ParsedMessage &params) anope_override
 	{
 		Anope::string modes;
-		if (params.size() >= 3)
-		{
-			for (unsigned i = 2; i < params.size() - 1; ++i)
-				modes += " " + params[i];
-			if (!modes.empty())
-				modes.erase(modes.begin());
-		}
+		for (unsigned i = 2; i + 1 < params.size(); ++i)
+			modes += " " + params[i].str();
+		if (!modes.empty())
+			modes.erase(modes.begin());
 
+		const Anope::string channel = params[0].str();
 		std::list<Message::Join::SJoinUser> users;
 
-		spacesepstream sep(params[params.size() - 1]);
-		Anope::string buf;
-		while (sep.GetToken(buf))
+		const MessageToken &list = params[params.size() - 1];
+		MessageToken buf;
+		for (size_t pos = 0; list.GetWord(pos, buf);)
 		{
 			Message::Join::SJoinUser sju;
 
 			/* Loop through prefixes and find modes for them */
-			for (char c; (c = buf[0]) != ',' && c;)
-			{
-				buf.erase(buf.begin());
-				sju.first.AddMode(c);
-			}
-			/* Erase the , */
-			if (!buf.empty())
-				buf.erase(buf.begin());
-
-			sju.second = User::Find(buf);
+			size_t i = 0;
+			for (; i < buf.length() && buf[i] != ','; ++i)
+				sju.first.AddMode(buf[i]);
+			/* Skip the , */
+			if (i < buf.length())
+				++i;
+
+			const Anope::string uid(buf.data() + i, buf.length() - i);
+			sju.second = User::Find(uid);
 			if (!sju.second)
 			{
-				Log(LOG_DEBUG) << "FJOIN for nonexistant user " << buf << " on " << params[0];
+				Log(LOG_DEBUG) << "FJOIN for nonexistant user " << uid << " on " << channel;
 				continue;
 			}
 
 			users.push_back(sju);
 		}
 
-		time_t ts = Anope::string(params[1]).is_pos_number_only() ? convertTo<time_t>(params[1]) : Anope::CurTime;
-		Message::Join::SJoin(source, params[0], ts, modes, users);
+		const Anope::string sts = params[1].str();
+		time_t ts = sts.is_pos_number_only() ? convertTo<time_t>(sts) : Anope::CurTime;
+		Message::Join::SJoin(source, channel, ts, modes, users);
 	}
 };
 
@@ -1315,11 +1319,18 @@ struct IRCDMessageUID : IRCDMessage
 	 */
 	void Run(MessageSource &source, const std::vector<Anope::string> &params) anope_override
 	{
-		time_t ts = convertTo<time_t>(params[1]);
+		this->Dispatch(source, ParsedMessage(params));
+	}
+
+	void Dispatch(MessageSource &source, const ParsedMessage &params) anope_override
+	{
+		time_t ts = convertTo<time_t>(params[1].str());
+
+		Anope::string modes = params[8].str();
+		for (unsigned i = 9; i + 1 < params.size(); ++i)
+			modes += " " + params[i].str();
 
-		Anope::string modes = params[8];
-		for (unsigned i = 9; i < params.size() - 1; ++i)
-			modes += " " + params[i];
+		const Anope::string uid = params[0].str();
 
 		NickAlias *na = NULL;
 		if (sasl)
@@ -1329,7 +1340,7 @@ struct IRCDMessageUID : IRCDMessage
 
 				if (u.created + 30 < Anope::CurTime)
 					it = saslusers.erase(it);
-				else if (u.uid == params[0])
+				else if (u.uid == uid)
 				{
 					na = NickAlias::Find(u.acc);
 					it = saslusers.erase(it);
@@ -1338,7 +1349,7 @@ struct IRCDMessageUID : IRCDMessage
 					++it;
 			}
 
-		new User(params[2], params[5], params[3], params[4], params[6], source.GetServer(), params[params.size() - 1], ts, modes, params[0], na ? *na->nc : NULL);
+		new User(params[2].str(), params[5].str(), params[3].str(), params[4].str(), params[6].str(), source.GetServer(), params[params.size() - 1].str(), ts, modes, uid, na ? *na->nc : NULL);
 	}
 };
 
@@ -12,6 +12,52 @@
 #include "module.h"
 #include "modules/cs_mode.h"
 
+/** Checks channels for expiry when they are due to expire
+ */
+class ChanServExpiry : public ExpiryQueue
+{
+ public:
+	ChanServExpiry(Module *creator) : ExpiryQueue(creator, "chanserv/expire") { }
+
+	bool Check(Serializable *obj) anope_override
+	{
+		ChannelInfo *ci = anope_dynamic_static_cast<ChannelInfo *>(obj);
+		time_t chanserv_expire = Config->GetModule(this->owner)->Get<time_t>("expire", "14d");
+
+		bool expire = false;
+
+		if (Anope::CurTime - ci->last_used >= chanserv_expire)
+		{
+			if (ci->c)
+			{
+				time_t last_used = ci->last_used;
+				for (Channel::ChanUserList::const_iterator cit = ci->c->users.begin(), cit_end = ci->c->users.end(); cit != cit_end && last_used == ci->last_used; ++cit)
+					ci->AccessFor(cit->second->user);
+				expire = last_used == ci->last_used;
+			}
+			else
+				expire = true;
+		}
+
+		FOREACH_MOD(OnPreChanExpire, (ci, expire));
+
+		if (expire)
+		{
+			Log(LOG_NORMAL, "chanserv/expire", Config->GetClient("ChanServ")) << "Expiring channel " << ci->name << " (founder: " << (ci->GetFounder() ? ci->GetFounder()->display : "(none)") << ")";
+			FOREACH_MOD(OnChanExpire, (ci));
+			delete ci;
+			return true;
+		}
+
+		/* Channels kept from expiring by a module are checked again after another expiry period,
+		 * modules which know sooner when the channel may expire schedule it themselves.
+		 */
+		time_t when = ci->last_used + chanserv_expire;
+		this->Schedule(ci, when > Anope::CurTime ? when : Anope::CurTime + chanserv_expire);
+		return false;
+	}
+};
+
 class ChanServCore : public Module, public ChanServService
 {
 	Reference<BotInfo> ChanServ;
@@ -19,10 +65,12 @@ class ChanServCore : public Module, public ChanServService
 	ExtensibleItem<bool> inhabit;
 	ExtensibleRef<bool> persist;
 	bool always_lower;
+	ChanServExpiry expiry;
+	time_t expire_time;
 
  public:
 	ChanServCore(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, PSEUDOCLIENT | VENDOR),
-		ChanServService(this), inhabit(this, "inhabit"), persist("PERSIST"), always_lower(false)
+		ChanServService(this), inhabit(this, "inhabit"), persist("PERSIST"), always_lower(false), expiry(this), expire_time(0)
 	{
 	}
 
@@ -109,6 +157,15 @@ class ChanServCore : public Module, public ChanServService
 			defaults.clear();
 
 		always_lower = conf->GetModule(this)->Get<bool>("always_lower_ts");
+
+		/* Channels may expire sooner than they are scheduled for now, so check all of them */
+		time_t expire = conf->GetModule(this)->Get<time_t>("expire", "14d");
+		if (expire != this->expire_time)
+		{
+			for (registered_channel_map::const_iterator it = RegisteredChannelList->begin(), it_end = RegisteredChannelList->end(); it != it_end; ++it)
+				this->expiry.Schedule(it->second, Anope::CurTime);
+			this->expire_time = expire;
+		}
 	}
 
 	void OnBotDelete(BotInfo *bi) anope_override
@@ -291,6 +348,9 @@ class ChanServCore : public Module, public ChanServService
 		/* Set default chan flags */
 		for (unsigned i = 0; i < defaults.size(); ++i)
 			ci->Extend<bool>(defaults[i].upper());
+
+		/* The channel's last used time may not be known yet, so check it the next time channels are expired */
+		this->expiry.Schedule(ci, Anope::CurTime);
 	}
 
 	EventReturn OnCanSet(User *u, const ChannelMode *cm) anope_override
@@ -341,35 +401,7 @@ class ChanServCore : public Module, public ChanServService
 		if (!chanserv_expire || Anope::NoExpire || Anope::ReadOnly)
 			return;
 
-		for (registered_channel_map::const_iterator it = RegisteredChannelList->begin(), it_end = RegisteredChannelList->end(); it != it_end; )
-		{
-			ChannelInfo *ci = it->second;
-			++it;
-
-			bool expire = false;
-
-			if (Anope::CurTime - ci->last_used >= chanserv_expire)
-			{
-				if (ci->c)
-				{
-					time_t last_used = ci->last_used;
-					for (Channel::ChanUserList::const_iterator cit = ci->c->users.begin(), cit_end = ci->c->users.end(); cit != cit_end && last_used == ci->last_used; ++cit)
-						ci->AccessFor(cit->second->user);
-					expire = last_used == ci->last_used;
-				}
-				else
-					expire = true;
-			}
-
-			FOREACH_MOD(OnPreChanExpire, (ci, expire));
-
-			if (expire)
-			{
-				Log(LOG_NORMAL, "chanserv/expire", ChanServ) << "Expiring channel " << ci->name << " (founder: " << (ci->GetFounder() ? ci->GetFounder()->display : "(none)") << ")";
-				FOREACH_MOD(OnChanExpire, (ci));
-				delete ci;
-			}
-		}
+		this->expiry.Process();
 	}
 
 	EventReturn OnCheckDelete(Channel *c) anope_override
@@ -92,11 +92,59 @@ class NickServRelease : public User, public Timer
 };
 std::map<Anope::string, NickServRelease *> NickServRelease::NickServReleases;
 
+/** Checks nicks for expiry when they are due to expire
+ */
+class NickServExpiry : public ExpiryQueue
+{
+ public:
+	NickServExpiry(Module *creator) : ExpiryQueue(creator, "nickserv/expire") { }
+
+	bool Check(Serializable *obj) anope_override
+	{
+		NickAlias *na = anope_dynamic_static_cast<NickAlias *>(obj);
+		time_t nickserv_expire = Config->GetModule(this->owner)->Get<time_t>("expire", "21d");
+
+		User *u = User::Find(na->nick);
+		if (u && (u->IsIdentified(true) || u->IsRecognized()))
+		{
+			na->last_seen = Anope::CurTime;
+			na->QueueUpdate();
+		}
+
+		bool expire = false;
+
+		if (nickserv_expire && Anope::CurTime - na->last_seen >= nickserv_expire)
+			expire = true;
+
+		FOREACH_MOD(OnPreNickExpire, (na, expire));
+
+		if (expire)
+		{
+			Log(LOG_NORMAL, "nickserv/expire", Config->GetClient("NickServ")) << "Expiring nickname " << na->nick << " (group: " << na->nc->display << ") (e-mail: " << (na->nc->email.empty() ? "none" : na->nc->email) << ")";
+			FOREACH_MOD(OnNickExpire, (na));
+			delete na;
+			return true;
+		}
+
+		/* Nicks kept from expiring by a module are checked again after another expiry period,
+		 * modules which know sooner when the nick may expire schedule it themselves.
+		 */
+		if (nickserv_expire)
+		{
+			time_t when = na->last_seen + nickserv_expire;
+			this->Schedule(na, when > Anope::CurTime ? when : Anope::CurTime + nickserv_expire);
+		}
+		return false;
+	}
+};
+
 class NickServCore : public Module, public NickServService
 {
 	Reference<BotInfo> NickServ;
 	std::vector<Anope::string> defaults;
 	ExtensibleItem<bool> held, collided;
+	NickServExpiry expiry;
+	time_t expire_time;
 
 	void OnCancel(User *u, NickAlias *na)
 	{
@@ -115,7 +163,7 @@ class NickServCore : public Module, public NickServService
 
  public:
 	NickServCore(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, PSEUDOCLIENT | VENDOR),
-		NickServService(this), held(this, "HELD"), collided(this, "COLLIDED")
+		NickServService(this), held(this, "HELD"), collided(this, "COLLIDED"), expiry(this), expire_time(0)
 	{
 	}
 
@@ -159,6 +207,7 @@ class NickServCore : public Module, public NickServService
 			na->last_seen = Anope::CurTime;
 			na->last_usermask = u->GetIdent() + "@" + u->GetDisplayedHost();
 			na->last_realname = u->realname;
+			na->QueueUpdate();
 			return;
 		}
 
@@ -276,6 +325,21 @@ class NickServCore : public Module, public NickServService
 		}
 		else if (defaults[0].equals_ci("none"))
 			defaults.clear();
+
+		/* Nicks may expire sooner than they are scheduled for now, so check all of them */
+		time_t expire = conf->GetModule(this)->Get<time_t>("expire", "21d");
+		if (expire != this->expire_time)
+		{
+			for (nickalias_map::const_iterator it = NickAliasList->begin(), it_end = NickAliasList->end(); it != it_end; ++it)
+				this->expiry.Schedule(it->second, Anope::CurTime);
+			this->expire_time = expire;
+		}
+	}
+
+	void OnCreateNick(NickAlias *na) anope_override
+	{
+		/* The nick's last seen time may not be known yet, so check it the next time nicks are expired */
+		this->expiry.Schedule(na, Anope::CurTime);
 	}
 
 	void OnDelNick(NickAlias *na) anope_override
@@ -485,6 +549,7 @@ class NickServCore : public Module, public NickServService
 		{
 			na->last_seen = Anope::CurTime;
 			na->last_quit = msg;
+			na->QueueUpdate();
 		}
 	}
 
@@ -493,31 +558,7 @@ class NickServCore : public Module, public NickServService
 		if (Anope::NoExpire || Anope::ReadOnly)
 			return;
 
-		time_t nickserv_expire = Config->GetModule(this)->Get<time_t>("expire", "21d");
-
-		for (nickalias_map::const_iterator it = NickAliasList->begin(), it_end = NickAliasList->end(); it != it_end; )
-		{
-			NickAlias *na = it->second;
-			++it;
-
-			User *u = User::Find(na->nick);
-			if (u && (u->IsIdentified(true) || u->IsRecognized()))
-				na->last_seen = Anope::CurTime;
-
-			bool expire = false;
-
-			if (nickserv_expire && Anope::CurTime - na->last_seen >= nickserv_expire)
-				expire = true;
-
-			FOREACH_MOD(OnPreNickExpire, (na, expire));
-		
-			if (expire)
-			{
-				Log(LOG_NORMAL, "nickserv/expire", NickServ) << "Expiring nickname " << na->nick << " (group: " << na->nc->display << ") (e-mail: " << (na->nc->email.empty() ? "none" : na->nc->email) << ")";
-				FOREACH_MOD(OnNickExpire, (na));
-				delete na;
-			}
-		}
+		this->expiry.Process();
 	}
 
 	void OnNickInfo(CommandSource &source, NickAlias *na, InfoFormatter &info, bool show_hidden) anope_override
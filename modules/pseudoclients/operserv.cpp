@@ -64,6 +64,18 @@ class SGLineManager : public XLineManager
 
 		return false;
 	}
+
+	Anope::string GetIndexMask(const XLine *x) anope_override
+	{
+		return x->regex ? "" : x->GetHost();
+	}
+
+	void GetIndexKeys(User *u, std::vector<Anope::string> &keys) anope_override
+	{
+		keys.push_back(u->host);
+		if (u->ip != u->host)
+			keys.push_back(u->ip);
+	}
 };
 
 class SQLineManager : public XLineManager
@@ -115,6 +127,16 @@ class SQLineManager : public XLineManager
 		return Anope::Match(u->nick, x->mask);
 	}
 
+	Anope::string GetIndexMask(const XLine *x) anope_override
+	{
+		return x->regex ? "" : x->mask;
+	}
+
+	void GetIndexKeys(User *u, std::vector<Anope::string> &keys) anope_override
+	{
+		keys.push_back(u->nick);
+	}
+
 	XLine *CheckChannel(Channel *c)
 	{
 		for (std::vector<XLine *>::const_iterator it = this->GetList().begin(), it_end = this->GetList().end(); it != it_end; ++it)
@@ -168,6 +190,17 @@ class SNLineManager : public XLineManager
 			return x->regex->Matches(u->realname);
 		return Anope::Match(u->realname, x->mask, false, true);
 	}
+
+	Anope::string GetIndexMask(const XLine *x) anope_override
+	{
+		/* Regex masks are matched as regexes by Match even if the xline failed to compile it */
+		return x->regex || x->IsRegex() ? "" : x->mask;
+	}
+
+	void GetIndexKeys(User *u, std::vector<Anope::string> &keys) anope_override
+	{
+		keys.push_back(u->realname);
+	}
 };
 
 class OperServCore : public Module
@@ -213,6 +246,16 @@ class OperServCore : public Module
 		OperServ = bi;
 	}
 
+	void OnExpireTick() anope_override
+	{
+		if (Anope::NoExpire)
+			return;
+
+		this->sglines.Expire();
+		this->sqlines.Expire();
+		this->snlines.Expire();
+	}
+
 	EventReturn OnBotPrivmsg(User *u, BotInfo *bi, Anope::string &message) anope_override
 	{
 		if (bi == OperServ && !u->HasMode("OPER") && Config->GetModule(this)->Get<bool>("opersonly"))
@@ -30,7 +30,11 @@ class IRC2SQL : public Module
 	BotInfo *StatServ;
 	PrimitiveExtensibleItem<bool> versionreply;
 
-	void RunQuery(const SQL::Query &q);
+	/** Run a query, prepared unless told otherwise as most are run for every event.
+	 * @param q The query
+	 * @param prepare false for queries which are only run once, such as those creating the tables
+	 */
+	void RunQuery(const SQL::Query &q, bool prepare = true);
 	void GetTables();
 
 	bool HasTable(const Anope::string &table);
@@ -27,7 +27,7 @@ void IRC2SQL::CheckTables()
 			"PRIMARY KEY `end` (`end`),"
 			"KEY `start` (`start`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (UseGeoIP && GeoIPDB.equals_ci("city") && !this->HasTable(prefix + "geoip_city_blocks"))
 	{
@@ -38,7 +38,7 @@ void IRC2SQL::CheckTables()
 			"PRIMARY KEY `end` (`end`),"
 			"KEY `start` (`start`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 
 	}
 	if (UseGeoIP && GeoIPDB.equals_ci("city") && !this->HasTable(prefix + "geoip_city_location"))
@@ -53,7 +53,7 @@ void IRC2SQL::CheckTables()
 			"`areaCode` INT,"
 			"PRIMARY KEY (`locId`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (UseGeoIP && GeoIPDB.equals_ci("city") && !this->HasTable(prefix + "geoip_city_region"))
 	{	query = "CREATE TABLE `" + prefix + "geoip_city_region` ("
@@ -62,7 +62,7 @@ void IRC2SQL::CheckTables()
 			"`regionname` VARCHAR(100) NOT NULL,"
 			"PRIMARY KEY (`country`,`region`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (!this->HasTable(prefix + "server"))
 	{
@@ -80,7 +80,7 @@ void IRC2SQL::CheckTables()
 			"PRIMARY KEY (`id`),"
 			"UNIQUE KEY `name` (`name`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (!this->HasTable(prefix + "chan"))
 	{
@@ -95,7 +95,7 @@ void IRC2SQL::CheckTables()
 			"PRIMARY KEY (`chanid`),"
 			"UNIQUE KEY `channel`(`channel`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (!this->HasTable(prefix + "user"))
 	{
@@ -130,7 +130,7 @@ void IRC2SQL::CheckTables()
 			"UNIQUE KEY `nick` (`nick`),"
 			"KEY `servid` (`servid`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (!this->HasTable(prefix + "ison"))
 	{
@@ -141,7 +141,7 @@ void IRC2SQL::CheckTables()
 			"PRIMARY KEY  (`nickid`,`chanid`),"
 			"KEY `modes` (`modes`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (!this->HasTable(prefix + "maxusers"))
 	{
@@ -152,10 +152,10 @@ void IRC2SQL::CheckTables()
 			"`lastused` DATETIME NOT NULL,"
 			"UNIQUE KEY `name` (`name`)"
 			") ENGINE=MyISAM DEFAULT CHARSET=utf8;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 	if (this->HasProcedure(prefix + "UserConnect"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "UserConnect"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "UserConnect"), false);
 
 	if (UseGeoIP)
 	{
@@ -225,10 +225,10 @@ void IRC2SQL::CheckTables()
 			"END IF;"
 			+ geoquery +
 		"END";
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 
 	if (this->HasProcedure(prefix + "ServerQuit"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "ServerQuit"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "ServerQuit"), false);
 	query = "CREATE PROCEDURE " + prefix + "ServerQuit(sname_ varchar(255)) "
 		"BEGIN "
 			/* 1.
@@ -296,11 +296,11 @@ void IRC2SQL::CheckTables()
 			"UPDATE `" + prefix + "server` SET currentusers = 0, split_time = now(), online = 'N' "
 				"WHERE name = sname_;"
 		"END;"; // end of the procedure
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 
 
 	if (this->HasProcedure(prefix + "UserQuit"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "UserQuit"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "UserQuit"), false);
 	query = "CREATE PROCEDURE `" + prefix + "UserQuit`"
 		"(nick_ varchar(255)) "
 		"BEGIN "
@@ -322,10 +322,10 @@ void IRC2SQL::CheckTables()
 			/* remove the user from the user table */
 			"DELETE FROM `" + prefix + "user` WHERE nick = nick_; "
 		"END";
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 
 	if (this->HasProcedure(prefix + "ShutDown"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "ShutDown"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "ShutDown"), false);
 	query = "CREATE PROCEDURE `" + prefix + "ShutDown`()"
 		"BEGIN "
 			"UPDATE `" +  prefix + "server` "
@@ -334,10 +334,10 @@ void IRC2SQL::CheckTables()
 			"TRUNCATE TABLE `" + prefix + "chan`;"
 			"TRUNCATE TABLE `" + prefix + "ison`;"
 		"END";
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 
 	if (this->HasProcedure(prefix + "JoinUser"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "JoinUser"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "JoinUser"), false);
 	query = "CREATE PROCEDURE `"+ prefix + "JoinUser`"
 		"(nick_ varchar(255), channel_ varchar(255), modes_ varchar(255)) "
 		"BEGIN "
@@ -361,10 +361,10 @@ void IRC2SQL::CheckTables()
 						"maxtime=VALUES(maxtime), lastused=VALUES(lastused);"
 			"END IF;"
 		"END";
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 
 	if (this->HasProcedure(prefix + "PartUser"))
-		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "PartUser"));
+		this->RunQuery(SQL::Query("DROP PROCEDURE " + prefix + "PartUser"), false);
 	query = "CREATE PROCEDURE `" + prefix + "PartUser`"
 		"(nick_ varchar(255), channel_ varchar(255)) "
 		"BEGIN "
@@ -378,5 +378,5 @@ void IRC2SQL::CheckTables()
 			"UPDATE `" + prefix + "chan` SET currentusers=currentusers-1 "
 				"WHERE channel=channel_;"
 		"END";
-	this->RunQuery(query);
+	this->RunQuery(query, false);
 }
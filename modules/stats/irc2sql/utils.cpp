@@ -1,9 +1,13 @@
 #include "irc2sql.h"
 
-void IRC2SQL::RunQuery(const SQL::Query &q)
+void IRC2SQL::RunQuery(const SQL::Query &q, bool prepare)
 {
-	if (sql)
-		sql->Run(&sqlinterface, q);
+	if (!sql)
+		return;
+
+	SQL::Query pq = q;
+	pq.prepare = prepare;
+	sql->Run(&sqlinterface, pq);
 }
 
 void IRC2SQL::GetTables()
@@ -163,10 +163,18 @@ class MChanstats : public Module
 	Anope::string SmileysHappy, SmileysSad, SmileysOther, prefix;
 	std::vector<Anope::string> TableList, ProcedureList, EventList;
 
-	void RunQuery(const SQL::Query &q)
+	/** Run a query, prepared unless told otherwise as most are run for every event.
+	 * @param q The query
+	 * @param prepare false for queries which are only run once, such as those creating the tables
+	 */
+	void RunQuery(const SQL::Query &q, bool prepare = true)
 	{
-		if (sql)
-			sql->Run(&sqlinterface, q);
+		if (!sql)
+			return;
+
+		SQL::Query pq = q;
+		pq.prepare = prepare;
+		sql->Run(&sqlinterface, pq);
 	}
 
 	size_t CountWords(const Anope::string &msg)
@@ -303,13 +311,13 @@ class MChanstats : public Module
 				"KEY `chan_` (`chan`),"
 				"KEY `type` (`type`)"
 				") ENGINE=InnoDB DEFAULT CHARSET=utf8;";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		/* There is no CREATE OR REPLACE PROCEDURE in MySQL */
 		if (this->HasProcedure(prefix + "chanstats_proc_update"))
 		{
 			query = "DROP PROCEDURE " + prefix + "chanstats_proc_update";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		query = "CREATE PROCEDURE `" + prefix + "chanstats_proc_update`"
 			"(chan_ VARCHAR(255), nick_ VARCHAR(255), line_ INT(10), letters_ INT(10),"
@@ -338,12 +346,12 @@ class MChanstats : public Module
 				"EXECUTE update_query;"
 				"DEALLOCATE PREPARE update_query;"
 			"END";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 
 		if (this->HasProcedure(prefix + "chanstats_proc_chgdisplay"))
 		{
 			query = "DROP PROCEDURE " + prefix + "chanstats_proc_chgdisplay;";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		query = "CREATE PROCEDURE `" + prefix + "chanstats_proc_chgdisplay`"
 			"(old_nick varchar(255), new_nick varchar(255))"
@@ -415,13 +423,13 @@ class MChanstats : public Module
 			"END my_cursor;"
 			"END IF;"
 			"END;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 
 		/* dont prepend any database prefix to events so we can always delete/change old events */
 		if (this->HasEvent("chanstats_event_cleanup_daily"))
 		{
 			query = "DROP EVENT chanstats_event_cleanup_daily";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		query = "CREATE EVENT `chanstats_event_cleanup_daily` "
 			"ON SCHEDULE EVERY 1 DAY STARTS CURRENT_DATE "
@@ -431,12 +439,12 @@ class MChanstats : public Module
 				"time12=0, time13=0, time14=0, time15=0, time16=0, time17=0, time18=0, time19=0,"
 				"time20=0, time21=0, time22=0, time23=0 "
 			"WHERE type='daily';";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 
 		if (this->HasEvent("chanstats_event_cleanup_weekly"))
 		{
 			query = "DROP EVENT `chanstats_event_cleanup_weekly`";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		query = "CREATE EVENT `chanstats_event_cleanup_weekly` "
 			"ON SCHEDULE EVERY 1 WEEK STARTS ADDDATE(CURDATE(), INTERVAL 1-DAYOFWEEK(CURDATE()) DAY) "
@@ -446,12 +454,12 @@ class MChanstats : public Module
 				"time12=0, time13=0, time14=0, time15=0, time16=0, time17=0, time18=0, time19=0,"
 				"time20=0, time21=0, time22=0, time23=0 "
 			"WHERE type='weekly';";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 
 		if (this->HasEvent("chanstats_event_cleanup_monthly"))
 		{
 			query = "DROP EVENT `chanstats_event_cleanup_monthly`;";
-			this->RunQuery(query);
+			this->RunQuery(query, false);
 		}
 		query = "CREATE EVENT `chanstats_event_cleanup_monthly` "
 			"ON SCHEDULE EVERY 1 MONTH STARTS LAST_DAY(CURRENT_TIMESTAMP) + INTERVAL 1 DAY "
@@ -464,7 +472,7 @@ class MChanstats : public Module
 			"WHERE type='monthly';"
 			"OPTIMIZE TABLE `" + prefix + "chanstats`;"
 			"END;";
-		this->RunQuery(query);
+		this->RunQuery(query, false);
 	}
 
 
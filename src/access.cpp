@@ -96,10 +96,7 @@ void PrivilegeManager::RemovePrivilege(Privilege &p)
 		Privileges.erase(it);
 
 	for (registered_channel_map::const_iterator cit = RegisteredChannelList->begin(), cit_end = RegisteredChannelList->end(); cit != cit_end; ++cit)
-	{
-		cit->second->QueueUpdate();
 		cit->second->RemoveLevel(p.name);
-	}
 }
 
 Privilege *PrivilegeManager::FindPrivilege(const Anope::string &name)
@@ -139,6 +136,8 @@ const std::list<AccessProvider *>& AccessProvider::GetProviders()
 	return Providers;
 }
 
+unsigned ChanAccess::Generation = 1;
+
 ChanAccess::ChanAccess(AccessProvider *p) : Serializable("ChanAccess"), provider(p)
 {
 }
@@ -160,6 +159,8 @@ ChanAccess::~ChanAccess()
 			if (c)
 				c->RemoveChannelReference(this->ci->name);
 		}
+
+		++Generation;
 	}
 }
 
@@ -203,6 +204,8 @@ Serializable* ChanAccess::Unserialize(Serializable *obj, Serialize::Data &data)
 
 	if (!obj)
 		ci->AddAccess(access);
+	else
+		++Generation;
 	return access;
 }
 
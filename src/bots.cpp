@@ -125,6 +125,11 @@ void BotInfo::SetNewNick(const Anope::string &newnick)
 
 	UserListByNick[this->nick] = this;
 	(*BotListByNick)[this->nick] = this;
+
+	/* The nick is saved with the bot and the channels it is assigned to */
+	this->QueueUpdate();
+	for (std::set<ChannelInfo *>::iterator it = this->channels->begin(), it_end = this->channels->end(); it != it_end; ++it)
+		(*it)->QueueUpdate();
 }
 
 const std::set<ChannelInfo *> &BotInfo::GetChannels() const
@@ -143,6 +148,7 @@ void BotInfo::Assign(User *u, ChannelInfo *ci)
 		ci->bi->UnAssign(u, ci);
 	
 	ci->bi = this;
+	ci->QueueUpdate();
 	this->channels->insert(ci);
 
 	FOREACH_MOD(OnBotAssign, (u, ci, this));
@@ -164,6 +170,7 @@ void BotInfo::UnAssign(User *u, ChannelInfo *ci)
 	}
 
 	ci->bi = NULL;
+	ci->QueueUpdate();
 	this->channels->erase(ci);
 }
 
@@ -244,8 +251,6 @@ BotInfo* BotInfo::Find(const Anope::string &nick, bool nick_only)
 			bi = it->second;
 	}
 
-	if (bi)
-		bi->QueueUpdate();
 	return bi;
 }
 
@@ -0,0 +1,118 @@
+/* Expiry scheduling.
+ *
+ * (C) 2003-2013 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ *
+ */
+
+#include "services.h"
+#include "expiry.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+namespace
+{
+	typedef std::pair<time_t, Serializable *> QueueEntry;
+
+	struct QueueCompare
+	{
+		bool operator()(const QueueEntry &a, const QueueEntry &b) const
+		{
+			return a.first > b.first;
+		}
+	};
+}
+
+ExpiryQueue::ExpiryQueue(Module *creator, const Anope::string &qname) : Service(creator, "ExpiryQueue", qname), processing(0)
+{
+}
+
+ExpiryQueue::~ExpiryQueue()
+{
+}
+
+void ExpiryQueue::Schedule(Serializable *obj, time_t when)
+{
+	if (when < this->processing)
+		when = this->processing;
+
+	TR1NS::unordered_map<Serializable *, Scheduled>::iterator it = this->scheduled.find(obj);
+	if (it != this->scheduled.end())
+	{
+		Scheduled &s = it->second;
+		/* An object which was deleted and whose memory was reused for this one is not scheduled */
+		if (s.obj && s.when <= when)
+			return;
+
+		s.when = when;
+		s.obj = obj;
+	}
+	else
+	{
+		Scheduled &s = this->scheduled[obj];
+		s.when = when;
+		s.obj = obj;
+	}
+
+	this->queue.push_back(QueueEntry(when, obj));
+	std::push_heap(this->queue.begin(), this->queue.end(), QueueCompare());
+}
+
+void ExpiryQueue::Clear()
+{
+	this->scheduled.clear();
+	this->queue.clear();
+}
+
+size_t ExpiryQueue::GetCount() const
+{
+	return this->scheduled.size();
+}
+
+void ExpiryQueue::Process(time_t now)
+{
+	timeval start;
+	gettimeofday(&start, NULL);
+
+	this->processing = now;
+	this->stats.checked = this->stats.expired = 0;
+
+	while (!this->queue.empty() && this->queue.front().first < now)
+	{
+		QueueEntry e = this->queue.front();
+		std::pop_heap(this->queue.begin(), this->queue.end(), QueueCompare());
+		this->queue.pop_back();
+
+		TR1NS::unordered_map<Serializable *, Scheduled>::iterator it = this->scheduled.find(e.second);
+		if (it == this->scheduled.end() || it->second.when != e.first)
+			continue;
+
+		bool valid = it->second.obj;
+		this->scheduled.erase(it);
+		if (!valid)
+			continue;
+
+		++this->stats.checked;
+		if (this->Check(e.second))
+			++this->stats.expired;
+	}
+
+	this->processing = 0;
+
+	timeval end;
+	gettimeofday(&end, NULL);
+
+	this->stats.time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+	this->stats.total_checked += this->stats.checked;
+	this->stats.total_expired += this->stats.expired;
+	++this->stats.runs;
+}
+
+const ExpiryQueue::Stats &ExpiryQueue::GetStats() const
+{
+	return this->stats;
+}
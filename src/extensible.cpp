@@ -10,29 +10,80 @@
 
 #include "extensible.h"
 
-static std::set<ExtensibleBase *> extensible_items;
+/* registered items, indexed by their slot */
+static std::vector<ExtensibleBase *> extensible_items;
+
+typedef TR1NS::unordered_map<Anope::string, ExtensibleBase *, Anope::hash_cs> extensible_cache;
+static extensible_cache item_cache;
+static unsigned item_cache_generation;
+
+char ExtensibleBase::present;
 
 ExtensibleBase::ExtensibleBase(Module *m, const Anope::string &n) : Service(m, "Extensible", n)
 {
-	extensible_items.insert(this);
+	for (slot = 0; slot < extensible_items.size() && extensible_items[slot] != NULL; ++slot);
+	if (slot == extensible_items.size())
+		extensible_items.push_back(this);
+	else
+		extensible_items[slot] = this;
 }
 
 ExtensibleBase::~ExtensibleBase()
 {
-	extensible_items.erase(this);
+	extensible_items[slot] = NULL;
+}
+
+void ExtensibleBase::SetValue(Extensible *obj, void *value)
+{
+	if (slot >= obj->extension_slots.size())
+		obj->extension_slots.resize(slot + 1);
+	obj->extension_slots[slot] = value;
+	items.insert(obj);
+}
+
+void *ExtensibleBase::ClearValue(Extensible *obj)
+{
+	if (slot >= obj->extension_slots.size())
+		return NULL;
+
+	void *value = obj->extension_slots[slot];
+	if (value != NULL)
+	{
+		obj->extension_slots[slot] = NULL;
+		items.erase(obj);
+	}
+	return value;
+}
+
+ExtensibleBase *ExtensibleBase::Find(const Anope::string &name)
+{
+	if (item_cache_generation != Service::GetGeneration())
+	{
+		item_cache.clear();
+		item_cache_generation = Service::GetGeneration();
+	}
+
+	extensible_cache::iterator it = item_cache.find(name);
+	if (it != item_cache.end())
+		return it->second;
+
+	ExtensibleBase *eb = static_cast<ExtensibleBase *>(Service::FindService("Extensible", name));
+	item_cache[name] = eb;
+	return eb;
 }
 
 Extensible::~Extensible()
 {
-	while (!extension_items.empty())
-		(*extension_items.begin())->Unset(this);
+	for (unsigned i = 0; i < extension_slots.size(); ++i)
+		if (extension_slots[i] != NULL)
+			extensible_items[i]->Unset(this);
 }
 
 bool Extensible::HasExt(const Anope::string &name) const
 {
-	ExtensibleRef<void *> ref(name);
-	if (ref)
-		return ref->HasExt(this);
+	ExtensibleBase *eb = ExtensibleBase::Find(name);
+	if (eb)
+		return eb->HasExt(this);
 
 	Log(LOG_DEBUG) << "HasExt for nonexistent type " << name << " on " << static_cast<const void *>(this);
 	return false;
@@ -40,31 +91,28 @@ bool Extensible::HasExt(const Anope::string &name) const
 
 void Extensible::ExtensibleSerialize(const Extensible *e, const Serializable *s, Serialize::Data &data)
 {
-	for (std::set<ExtensibleBase *>::iterator it = e->extension_items.begin(); it != e->extension_items.end(); ++it)
-	{
-		ExtensibleBase *eb = *it;
-		eb->ExtensibleSerialize(e, s, data);
-	}
+	for (unsigned i = 0; i < e->extension_slots.size(); ++i)
+		if (e->extension_slots[i] != NULL)
+			extensible_items[i]->ExtensibleSerialize(e, s, data);
 }
 
 void Extensible::ExtensibleUnserialize(Extensible *e, Serializable *s, Serialize::Data &data)
 {
-	while (!e->extension_items.empty())
-		(*e->extension_items.begin())->Unset(e);
+	for (unsigned i = 0; i < e->extension_slots.size(); ++i)
+		if (e->extension_slots[i] != NULL)
+			extensible_items[i]->Unset(e);
 
-	for (std::set<ExtensibleBase *>::iterator it = extensible_items.begin(); it != extensible_items.end(); ++it)
-	{
-		ExtensibleBase *eb = *it;
-		eb->ExtensibleUnserialize(e, s, data);
-	}
+	for (unsigned i = 0; i < extensible_items.size(); ++i)
+		if (extensible_items[i] != NULL)
+			extensible_items[i]->ExtensibleUnserialize(e, s, data);
 }
 
 template<>
 bool* Extensible::Extend(const Anope::string &name, const bool &what)
 {
-	ExtensibleRef<bool> ref(name);
-	if (ref)
-		return ref->Set(this);
+	BaseExtensibleItem<bool> *item = static_cast<BaseExtensibleItem<bool> *>(ExtensibleBase::Find(name));
+	if (item)
+		return item->Set(this);
 
 	Log(LOG_DEBUG) << "Extend for nonexistant type " << name << " on " << static_cast<void *>(this);
 	return NULL;
@@ -15,6 +15,12 @@
 std::locale Anope::casemap = std::locale(std::locale(), new Anope::ascii_ctype<char>());
 /* Cache of the above case map, forced upper */
 static unsigned char case_map_upper[256], case_map_lower[256];
+/* If the case map only folds a single range of ASCII characters onto the
+ * range 32 above it, as the ascii and rfc1459 case maps do, the last
+ * character of that range. Eight characters at a time can then be folded
+ * with a few arithmetic operations instead of table lookups.
+ */
+static unsigned char case_map_fold_end;
 
 /* called whenever Anope::casemap is modified to rebuild the casemap cache */
 void Anope::CaseMapRebuild()
@@ -26,6 +32,16 @@ void Anope::CaseMapRebuild()
 		case_map_upper[i] = ct.toupper(i);
 		case_map_lower[i] = ct.tolower(i);
 	}
+
+	case_map_fold_end = 0;
+	for (unsigned end = 'Z'; end <= ']' && !case_map_fold_end; end += ']' - 'Z')
+	{
+		bool matches = true;
+		for (unsigned i = 0; i < sizeof(case_map_lower) && matches; ++i)
+			matches = case_map_lower[i] == (i >= 'A' && i <= end ? i + 32 : i);
+		if (matches)
+			case_map_fold_end = end;
+	}
 }
 
 unsigned char Anope::tolower(unsigned char c)
@@ -89,7 +105,126 @@ const char *ci::ci_char_traits::find(const char *s1, int n, char c)
 
 bool ci::less::operator()(const Anope::string &s1, const Anope::string &s2) const
 {
-	return s1.ci_str().compare(s2.ci_str()) < 0;
+	const unsigned char *p1 = reinterpret_cast<const unsigned char *>(s1.c_str()), *p2 = reinterpret_cast<const unsigned char *>(s2.c_str());
+	size_t len1 = s1.length(), len2 = s2.length();
+
+	for (size_t i = 0, n = std::min(len1, len2); i < n; ++i)
+	{
+		unsigned char c1 = case_map_upper[p1[i]], c2 = case_map_upper[p2[i]];
+		if (c1 != c2)
+			return c1 < c2;
+	}
+
+	return len1 < len2;
+}
+
+static const uint64_t SWAR_ONES = 0x0101010101010101ULL, SWAR_HIGH = 0x8080808080808080ULL;
+
+static inline uint64_t LoadWord(const char *s)
+{
+	uint64_t w;
+	memcpy(&w, s, sizeof(w));
+	return w;
+}
+
+/* Fold eight characters to lower case */
+static inline uint64_t FoldWord(uint64_t w)
+{
+	if (case_map_fold_end && !(w & SWAR_HIGH))
+	{
+		/* With no byte above 127 nothing carries between bytes, so the high
+		 * bit of each byte says whether it is at least 'A', or past the end
+		 * of the folded range. Those in the range get 32 added.
+		 */
+		uint64_t from = w + SWAR_ONES * (0x80 - 'A'), past = w + SWAR_ONES * (0x80 - case_map_fold_end - 1);
+		return w | ((from & ~past & SWAR_HIGH) >> 2);
+	}
+
+	unsigned char b[sizeof(w)];
+	memcpy(b, &w, sizeof(w));
+	for (unsigned i = 0; i < sizeof(b); ++i)
+		b[i] = case_map_lower[b[i]];
+	memcpy(&w, b, sizeof(w));
+	return w;
+}
+
+static inline uint64_t HashMix(uint64_t h, uint64_t w)
+{
+	h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+size_t ci::hash(const char *s, size_t n)
+{
+	uint64_t h = n;
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t))
+		h = HashMix(h, FoldWord(LoadWord(s + i)));
+
+	if (i < n)
+	{
+		uint64_t w = 0;
+		for (unsigned shift = 0; i < n; ++i, shift += 8)
+			w |= static_cast<uint64_t>(case_map_lower[static_cast<unsigned char>(s[i])]) << shift;
+		h = HashMix(h, w);
+	}
+
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+bool ci::equals(const char *s1, const char *s2, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t))
+	{
+		uint64_t w1 = LoadWord(s1 + i), w2 = LoadWord(s2 + i);
+		if (w1 != w2 && FoldWord(w1) != FoldWord(w2))
+			return false;
+	}
+
+	for (; i < n; ++i)
+		if (case_map_lower[static_cast<unsigned char>(s1[i])] != case_map_lower[static_cast<unsigned char>(s2[i])])
+			return false;
+
+	return true;
+}
+
+size_t ci::find(const char *s, size_t n, const char *what, size_t len, size_t pos)
+{
+	if (pos > n || len > n - pos)
+		return std::string::npos;
+	if (!len)
+		return pos;
+
+	unsigned char first = case_map_lower[static_cast<unsigned char>(*what)];
+	for (size_t last = n - len; pos <= last; ++pos)
+		if (case_map_lower[static_cast<unsigned char>(s[pos])] == first && equals(s + pos + 1, what + 1, len - 1))
+			return pos;
+
+	return std::string::npos;
+}
+
+size_t ci::rfind(const char *s, size_t n, const char *what, size_t len, size_t pos)
+{
+	if (len > n)
+		return std::string::npos;
+
+	pos = std::min(pos, n - len);
+	if (!len)
+		return pos;
+
+	unsigned char first = case_map_lower[static_cast<unsigned char>(*what)];
+	for (;; --pos)
+	{
+		if (case_map_lower[static_cast<unsigned char>(s[pos])] == first && equals(s + pos + 1, what + 1, len - 1))
+			return pos;
+		if (!pos)
+			break;
+	}
+
+	return std::string::npos;
 }
 
 sepstream::sepstream(const Anope::string &source, char seperator, bool ae) : tokens(source), sep(seperator), pos(0), allow_empty(ae)
@@ -123,6 +123,7 @@ void Anope::HandleSignal()
 				Configuration::Conf *new_config = new Configuration::Conf();
 				delete Config;
 				Config = new_config;
+				Anope::SetRegexEngine(Config->GetBlock("options")->Get<const Anope::string>("regexengine"));
 			}
 			catch (const ConfigException &ex)
 			{
@@ -414,6 +415,7 @@ void Anope::Init(int ac, char **av)
 	try
 	{
 		Config = new Configuration::Conf();
+		Anope::SetRegexEngine(Config->GetBlock("options")->Get<const Anope::string>("regexengine"));
 	}
 	catch (const ConfigException &ex)
 	{
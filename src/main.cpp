@@ -69,6 +69,8 @@ void Anope::SaveDatabases()
 	if (Anope::ReadOnly)
 		return;
 
+	Serializable::ProcessUpdates();
+
 	Log(LOG_DEBUG) << "Saving databases";
 	FOREACH_MOD(OnSaveDatabase, ());
 }
@@ -156,7 +158,6 @@ int main(int ac, char **av, char **envp)
 	}
 
 	/* Set up timers */
-	time_t last_check = Anope::CurTime;
 	UpdateTimer updateTimer(Config->GetBlock("options")->Get<time_t>("updatetimeout", "5m"));
 	ExpireTimer expireTimer(Config->GetBlock("options")->Get<time_t>("expiretimeout", "30m"));
 
@@ -166,19 +167,20 @@ int main(int ac, char **av, char **envp)
 		Log(LOG_DEBUG_2) << "Top of main loop";
 
 		/* Process timers */
-		if (Anope::CurTime - last_check >= Config->TimeoutCheck)
-		{
-			TimerManager::TickTimers(Anope::CurTime);
-			last_check = Anope::CurTime;
-		}
+		TimerManager::TickTimers(Anope::CurTime);
+
+		/* Tell modules about objects updated since the last iteration */
+		Serializable::ProcessUpdates();
 
-		/* Process the socket engine */
+		/* Process the socket engine, this waits until the next timer is due at most */
 		SocketEngine::Process();
 
 		if (Anope::Signal)
 			Anope::HandleSignal();
 	}
 
+	Serializable::ProcessUpdates();
+
 	if (Anope::Restarting)
 	{
 		FOREACH_MOD(OnRestart, ());
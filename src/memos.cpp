@@ -83,9 +83,7 @@ Memo *MemoInfo::GetMemo(unsigned index) const
 {
 	if (index >= this->memos->size())
 		return NULL;
-	Memo *m = (*memos)[index];
-	m->QueueUpdate();
-	return m;
+	return (*memos)[index];
 }
 
 unsigned MemoInfo::GetIndex(Memo *m) const
@@ -261,6 +261,15 @@ void Notice::Run(MessageSource &source, const std::vector<Anope::string> &params
 	}
 }
 
+void Notice::Dispatch(MessageSource &source, const ParsedMessage &msg)
+{
+	/* channel notices are ignored, so don't bother copying the message */
+	if (IRCD->IsChannelValid(msg[0].str()))
+		return;
+
+	IRCDMessage::Dispatch(source, msg);
+}
+
 void Part::Run(MessageSource &source, const std::vector<Anope::string> &params)
 {
 	User *u = source.GetUser();
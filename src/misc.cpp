@@ -404,39 +404,82 @@ Anope::string Anope::Expires(time_t expires, const NickCore *nc)
 	}
 }
 
+/* The regex engine used by Match */
+static ServiceReference<RegexProvider> regex_provider("Regex", "");
+
+/* Regular expressions compiled by Match, most recently used first. Patterns which
+ * failed to compile are kept too, with a NULL regex, so they are not compiled again.
+ */
+typedef std::list<std::pair<Anope::string, Regex *> > RegexCache;
+static RegexCache regex_cache;
+static TR1NS::unordered_map<Anope::string, RegexCache::iterator, Anope::hash_cs> regex_cache_index;
+static const unsigned regex_cache_size = 128;
+
+static void ClearRegexCache()
+{
+	for (RegexCache::iterator it = regex_cache.begin(), it_end = regex_cache.end(); it != it_end; ++it)
+		delete it->second;
+	regex_cache.clear();
+	regex_cache_index.clear();
+}
+
+/** Find or compile a regular expression with the regex engine.
+ * @param pattern The pattern
+ * @return The regular expression, or NULL if there is no regex engine or the pattern is invalid
+ */
+static Regex *GetRegex(const Anope::string &pattern)
+{
+	TR1NS::unordered_map<Anope::string, RegexCache::iterator, Anope::hash_cs>::iterator it = regex_cache_index.find(pattern);
+	if (it != regex_cache_index.end())
+	{
+		regex_cache.splice(regex_cache.begin(), regex_cache, it->second);
+		return it->second->second;
+	}
+
+	if (!regex_provider)
+		return NULL;
+
+	Regex *r = NULL;
+	try
+	{
+		r = regex_provider->Compile(pattern);
+	}
+	catch (const RegexException &ex)
+	{
+		Log(LOG_DEBUG) << ex.GetReason();
+	}
+
+	if (regex_cache.size() >= regex_cache_size)
+	{
+		delete regex_cache.back().second;
+		regex_cache_index.erase(regex_cache.back().first);
+		regex_cache.pop_back();
+	}
+
+	regex_cache.push_front(std::make_pair(pattern, r));
+	regex_cache_index[pattern] = regex_cache.begin();
+
+	return r;
+}
+
+RegexProvider::~RegexProvider()
+{
+	ClearRegexCache();
+}
+
+void Anope::SetRegexEngine(const Anope::string &engine)
+{
+	ClearRegexCache();
+	regex_provider = engine;
+}
+
 bool Anope::Match(const Anope::string &str, const Anope::string &mask, bool case_sensitive, bool use_regex)
 {
 	size_t s = 0, m = 0, str_len = str.length(), mask_len = mask.length();
 
 	if (use_regex && mask_len >= 2 && mask[0] == '/' && mask[mask.length() - 1] == '/')
 	{
-		Anope::string stripped_mask = mask.substr(1, mask_len - 2);
-		// This is often called with the same mask multiple times in a row, so cache it
-		static Regex *r = NULL;
-
-		if (r == NULL || r->GetExpression() != stripped_mask)
-		{
-			ServiceReference<RegexProvider> provider("Regex", Config->GetBlock("options")->Get<const Anope::string>("regexengine"));
-			if (provider)
-			{
-				try
-				{
-					delete r;
-					r = NULL;
-					// This may throw
-					r = provider->Compile(stripped_mask);
-				}
-				catch (const RegexException &ex)
-				{
-					Log(LOG_DEBUG) << ex.GetReason();
-				}
-			}
-			else
-			{
-				delete r;
-				r = NULL;
-			}
-		}
+		Regex *r = GetRegex(mask.substr(1, mask_len - 2));
 
 		if (r != NULL && r->Matches(str))
 			return true;
@@ -18,6 +18,7 @@
 #include "users.h"
 #include "servers.h"
 #include "config.h"
+#include "access.h"
 
 Serialize::Checker<nickalias_map> NickAliasList("NickAlias");
 
@@ -32,6 +33,8 @@ NickAlias::NickAlias(const Anope::string &nickname, NickCore* nickcore) : Serial
 	this->nick = nickname;
 	this->nc = nickcore;
 	nickcore->aliases->push_back(this);
+	/* Access entries are matched against the nicks of an account */
+	++ChanAccess::Generation;
 
 	size_t old = NickAliasList->size();
 	(*NickAliasList)[this->nick] = this;
@@ -47,12 +50,16 @@ NickAlias::NickAlias(const Anope::string &nickname, NickCore* nickcore) : Serial
 		if (this->nc->o != NULL)
 			Log() << "Tied oper " << this->nc->display << " to type " << this->nc->o->ot->GetName();
 	}
+
+	FOREACH_MOD(OnCreateNick, (this));
 }
 
 NickAlias::~NickAlias()
 {
 	FOREACH_MOD(OnDelNick, (this));
 
+	++ChanAccess::Generation;
+
 	/* Accept nicks that have no core, because of database load functions */
 	if (this->nc)
 	{
@@ -83,6 +90,7 @@ void NickAlias::SetVhost(const Anope::string &ident, const Anope::string &host,
 	this->vhost_host = host;
 	this->vhost_creator = creator;
 	this->vhost_created = created;
+	this->QueueUpdate();
 }
 
 void NickAlias::RemoveVhost()
@@ -91,6 +99,7 @@ void NickAlias::RemoveVhost()
 	this->vhost_host.clear();
 	this->vhost_creator.clear();
 	this->vhost_created = 0;
+	this->QueueUpdate();
 }
 
 bool NickAlias::HasVhost() const
@@ -122,10 +131,7 @@ NickAlias *NickAlias::Find(const Anope::string &nick)
 {
 	nickalias_map::const_iterator it = NickAliasList->find(nick);
 	if (it != NickAliasList->end())
-	{
-		it->second->QueueUpdate();
 		return it->second;
-	}
 
 	return NULL;
 }
@@ -182,6 +188,7 @@ Serializable* NickAlias::Unserialize(Serializable *obj, Serialize::Data &data)
 
 		na->nc = core;
 		core->aliases->push_back(na);
+		++ChanAccess::Generation;
 	}
 
 	data["last_quit"] >> na->last_quit;
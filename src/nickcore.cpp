@@ -14,6 +14,7 @@
 #include "modules.h"
 #include "account.h"
 #include "config.h"
+#include "access.h"
 
 Serialize::Checker<nickcore_map> NickCoreList("NickCore");
 
@@ -40,6 +41,8 @@ NickCore::~NickCore()
 {
 	FOREACH_MOD(OnDelCore, (this));
 
+	++ChanAccess::Generation;
+
 	if (!this->chanaccess->empty())
 		Log(LOG_DEBUG) << "Non-empty chanaccess list in destructor!";
 
@@ -164,6 +167,19 @@ void NickCore::SetDisplay(const NickAlias *na)
 	this->display = na->nick;
 
 	(*NickCoreList)[this->display] = this;
+
+	/* The display is saved with the aliases, and channels and akicks referring to this account */
+	this->QueueUpdate();
+	for (unsigned i = 0; i < this->aliases->size(); ++i)
+		this->aliases->at(i)->QueueUpdate();
+	for (std::map<ChannelInfo *, int>::iterator it = this->chanaccess->begin(), it_end = this->chanaccess->end(); it != it_end; ++it)
+	{
+		ChannelInfo *ci = it->first;
+		ci->QueueUpdate();
+		for (unsigned i = 0; i < ci->GetAkickCount(); ++i)
+			if (ci->GetAkick(i)->nc == this)
+				ci->GetAkick(i)->QueueUpdate();
+	}
 }
 
 bool NickCore::IsServicesOper() const
@@ -174,6 +190,7 @@ bool NickCore::IsServicesOper() const
 void NickCore::AddAccess(const Anope::string &entry)
 {
 	this->access.push_back(entry);
+	this->QueueUpdate();
 	FOREACH_MOD(OnNickAddAccess, (this, entry));
 }
 
@@ -205,6 +222,7 @@ void NickCore::EraseAccess(const Anope::string &entry)
 		{
 			FOREACH_MOD(OnNickEraseAccess, (this, entry));
 			this->access.erase(this->access.begin() + i);
+			this->QueueUpdate();
 			break;
 		}
 }
@@ -213,6 +231,7 @@ void NickCore::ClearAccess()
 {
 	FOREACH_MOD(OnNickClearAccess, (this));
 	this->access.clear();
+	this->QueueUpdate();
 }
 
 bool NickCore::IsOnAccess(const User *u) const
@@ -255,10 +274,7 @@ NickCore* NickCore::Find(const Anope::string &nick)
 {
 	nickcore_map::const_iterator it = NickCoreList->find(nick);
 	if (it != NickCoreList->end())
-	{
-		it->second->QueueUpdate();
 		return it->second;
-	}
 
 	return NULL;
 }
@@ -16,78 +16,236 @@
 #include "users.h"
 #include "regchannel.h"
 
-void Anope::Process(const Anope::string &buffer)
+bool ParsedMessage::Parse(const Anope::string &buffer)
 {
-	/* If debugging, log the buffer */
-	Log(LOG_RAWIO) << "Received: " << buffer;
-
-	if (buffer.empty())
-		return;
+	const char *p = buffer.c_str(), *end = p + buffer.length();
 
-	spacesepstream buf_sep(buffer);
+	this->source = this->command = MessageToken();
+	this->extra_params.clear();
+	this->count = 0;
 
-	Anope::string source;
-	if (buffer[0] == ':')
+	if (*p == ':')
 	{
-		buf_sep.GetToken(source);
-		source.erase(0, 1);
+		const char *s = ++p;
+		while (p < end && *p != ' ')
+			++p;
+		this->source = MessageToken(s, p - s);
 	}
 
-	Anope::string command;
-	if (!buf_sep.GetToken(command))
-		return;
-	
-	Anope::string buf_token;
-	std::vector<Anope::string> params;
-	while (buf_sep.GetToken(buf_token))
+	while (p < end && *p == ' ')
+		++p;
+	if (p == end)
+		return false;
+
+	const char *c = p;
+	while (p < end && *p != ' ')
+		++p;
+	this->command = MessageToken(c, p - c);
+
+	for (;;)
 	{
-		if (buf_token[0] == ':')
+		while (p < end && *p == ' ')
+			++p;
+		if (p == end)
+			break;
+
+		if (*p == ':')
 		{
-			if (!buf_sep.StreamEnd())
-				params.push_back(buf_token.substr(1) + " " + buf_sep.GetRemaining());
-			else
-				params.push_back(buf_token.substr(1));
+			++p;
+			this->AddParam(MessageToken(p, end - p));
 			break;
 		}
-		else
-			params.push_back(buf_token);
+
+		const char *t = p;
+		while (p < end && *p != ' ')
+			++p;
+		this->AddParam(MessageToken(t, p - t));
+	}
+
+	return true;
+}
+
+void ParsedMessage::GetParams(std::vector<Anope::string> &out) const
+{
+	out.clear();
+	out.reserve(this->count);
+	for (unsigned i = 0; i < this->count; ++i)
+		out.push_back((*this)[i].str());
+}
+
+/* Maps raw command tokens from the uplink to their handlers, so routing a
+ * line does not have to build a service name for every message. This is
+ * filled in lazily, and is thrown away whenever a service is (un)registered.
+ */
+class MessageTable
+{
+	struct Entry
+	{
+		Anope::string command;
+		size_t hash;
+		/* NULL for commands we have no handler for */
+		IRCDMessage *message;
+		bool used;
+
+		Entry() : hash(0), message(NULL), used(false) { }
+	};
+
+	/* How many unknown commands to remember */
+	static const unsigned MAX_UNKNOWN = 1024;
+
+	std::vector<Entry> entries;
+	unsigned count, unknown;
+	unsigned generation;
+	Anope::string proto_name;
+
+	static size_t Hash(const MessageToken &command)
+	{
+		/* FNV-1a */
+		size_t h = 2166136261U;
+		for (size_t i = 0; i < command.length(); ++i)
+		{
+			h ^= static_cast<unsigned char>(command[i]);
+			h *= 16777619U;
+		}
+		return h;
+	}
+
+	void Clear()
+	{
+		this->entries.clear();
+		this->entries.resize(64);
+		this->count = this->unknown = 0;
+		this->generation = Service::GetGeneration();
+
+		Module *protocol = ModuleManager::FindFirstOf(PROTOCOL);
+		this->proto_name = protocol ? protocol->name : "";
+	}
+
+	void Grow()
+	{
+		std::vector<Entry> old;
+		old.swap(this->entries);
+		this->entries.resize(old.size() * 2);
+
+		for (unsigned i = 0; i < old.size(); ++i)
+			if (old[i].used)
+				this->entries[this->Slot(old[i].hash, MessageToken(old[i].command.c_str(), old[i].command.length()))] = old[i];
+	}
+
+	/* Find the slot command lives in, or the empty slot it would go into */
+	size_t Slot(size_t h, const MessageToken &command) const
+	{
+		size_t mask = this->entries.size() - 1;
+		for (size_t i = h & mask;; i = (i + 1) & mask)
+		{
+			const Entry &e = this->entries[i];
+			if (!e.used || (e.hash == h && e.command.length() == command.length() && !memcmp(e.command.c_str(), command.data(), command.length())))
+				return i;
+		}
+	}
+
+ public:
+	MessageTable() : count(0), unknown(0), generation(0) { }
+
+	IRCDMessage *Find(const MessageToken &command)
+	{
+		if (this->entries.empty() || this->generation != Service::GetGeneration())
+			this->Clear();
+
+		size_t h = Hash(command), i = this->Slot(h, command);
+		if (this->entries[i].used)
+			return this->entries[i].message;
+
+		Anope::string name = command.str();
+		IRCDMessage *m = static_cast<IRCDMessage *>(Service::FindService("IRCDMessage", this->proto_name + "/" + name.lower()));
+
+		if (!m)
+		{
+			if (this->unknown >= MAX_UNKNOWN)
+				return NULL;
+			++this->unknown;
+		}
+
+		if ((this->count + 1) * 2 > this->entries.size())
+		{
+			this->Grow();
+			i = this->Slot(h, command);
+		}
+
+		Entry &e = this->entries[i];
+		e.command = name;
+		e.hash = h;
+		e.message = m;
+		e.used = true;
+		++this->count;
+
+		return m;
+	}
+};
+
+static MessageTable message_table;
+
+void Anope::Process(const Anope::string &buffer)
+{
+	/* If debugging, log the buffer */
+	Log(LOG_RAWIO) << "Received: " << buffer;
+
+	if (buffer.empty())
+		return;
+
+	ParsedMessage msg;
+	if (!msg.Parse(buffer))
+	{
+		Log(LOG_DEBUG) << "unable to parse message from server (" << buffer << ")";
+		return;
 	}
 
 	if (Anope::ProtocolDebug)
 	{
-		Log() << "Source : " << (source.empty() ? "No source" : source);
-		Log() << "Command: " << command;
+		Log() << "Source : " << (msg.GetSource().empty() ? "No source" : msg.GetSource().str());
+		Log() << "Command: " << msg.GetCommand().str();
 
-		if (params.empty())
+		if (msg.empty())
 			Log() << "No params";
 		else
-			for (unsigned i = 0; i < params.size(); ++i)
-				Log() << "params " << i << ": " << params[i];
+			for (unsigned i = 0; i < msg.size(); ++i)
+				Log() << "params " << i << ": " << msg[i].str();
 	}
 
-	static const Anope::string proto_name = ModuleManager::FindFirstOf(PROTOCOL) ? ModuleManager::FindFirstOf(PROTOCOL)->name : "";
-
+	const Anope::string source = msg.GetSource().str();
+	Anope::string command = msg.GetCommand().str();
 	MessageSource src(source);
-	
-	EventReturn MOD_RESULT;
-	FOREACH_RESULT(OnMessage, MOD_RESULT, (src, command, params));
-	if (MOD_RESULT == EVENT_STOP)
-		return;
 
-	ServiceReference<IRCDMessage> m("IRCDMessage", proto_name + "/" + command.lower());
+	/* Only copy the parameters if someone wants to see (or change) them */
+	std::vector<Anope::string> params;
+	bool copied = !ModuleManager::EventHandlers[I_OnMessage].empty();
+	if (copied)
+	{
+		msg.GetParams(params);
+
+		EventReturn MOD_RESULT;
+		FOREACH_RESULT(OnMessage, MOD_RESULT, (src, command, params));
+		if (MOD_RESULT == EVENT_STOP)
+			return;
+	}
+
+	IRCDMessage *m = message_table.Find(copied ? MessageToken(command.c_str(), command.length()) : msg.GetCommand());
 	if (!m)
 	{
 		Log(LOG_DEBUG) << "unknown message from server (" << buffer << ")";
 		return;
 	}
 
-	if (m->HasFlag(IRCDMESSAGE_SOFT_LIMIT) ? (params.size() < m->GetParamCount()) : (params.size() != m->GetParamCount()))
-		Log(LOG_DEBUG) << "invalid parameters for " << command << ": " << params.size() << " != " << m->GetParamCount();
+	size_t param_count = copied ? params.size() : msg.size();
+	if (m->HasFlag(IRCDMESSAGE_SOFT_LIMIT) ? (param_count < m->GetParamCount()) : (param_count != m->GetParamCount()))
+		Log(LOG_DEBUG) << "invalid parameters for " << command << ": " << param_count << " != " << m->GetParamCount();
 	else if (m->HasFlag(IRCDMESSAGE_REQUIRE_USER) && !src.GetUser())
 		Log(LOG_DEBUG) << "unexpected non-user source " << source << " for " << command;
 	else if (m->HasFlag(IRCDMESSAGE_REQUIRE_SERVER) && !source.empty() && !src.GetServer())
 		Log(LOG_DEBUG) << "unexpected non-server source " << source << " for " << command;
-	else
+	else if (copied)
 		m->Run(src, params);
+	else
+		m->Dispatch(src, msg);
 }
 
@@ -437,3 +437,10 @@ unsigned IRCDMessage::GetParamCount() const
 	return this->param_count;
 }
 
+void IRCDMessage::Dispatch(MessageSource &source, const ParsedMessage &msg)
+{
+	std::vector<Anope::string> params;
+	msg.GetParams(params);
+	this->Run(source, params);
+}
+
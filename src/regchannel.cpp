@@ -19,6 +19,7 @@
 #include "config.h"
 #include "bots.h"
 #include "servers.h"
+#include "protocol.h"
 
 Serialize::Checker<registered_channel_map> RegisteredChannelList("ChannelInfo");
 
@@ -117,12 +118,16 @@ ChannelInfo::ChannelInfo(const Anope::string &chname) : Serializable("ChannelInf
 	this->bantype = 2;
 	this->memos.memomax = 0;
 	this->last_used = this->time_registered = Anope::CurTime;
+	this->access_generation = 0;
 
 	size_t old = RegisteredChannelList->size();
 	(*RegisteredChannelList)[this->name] = this;
 	if (old == RegisteredChannelList->size())
 		Log(LOG_DEBUG) << "Duplicate channel " << this->name << " in registered channel table?";
 
+	/* Access entries naming this channel may match now */
+	++ChanAccess::Generation;
+
 	FOREACH_MOD(OnCreateChan, (this));
 }
 
@@ -130,6 +135,8 @@ ChannelInfo::ChannelInfo(const ChannelInfo &ci) : Serializable("ChannelInfo"),
 	access("ChanAccess"), akick("AutoKick")
 {
 	*this = ci;
+	this->access_generation = 0;
+	this->access_cache.clear();
 
 	if (this->founder)
 		--this->founder->channelcount;
@@ -171,6 +178,8 @@ ChannelInfo::~ChannelInfo()
 
 	Log(LOG_DEBUG) << "Deleting channel " << this->name;
 
+	++ChanAccess::Generation;
+
 	if (this->c)
 	{
 		if (this->bi && this->c->FindUser(this->bi))
@@ -360,6 +369,8 @@ void ChannelInfo::SetFounder(NickCore *nc)
 		++this->founder->channelcount;
 		this->founder->AddChannelReference(this);
 	}
+
+	this->QueueUpdate();
 }
 
 NickCore *ChannelInfo::GetFounder() const
@@ -374,6 +385,8 @@ void ChannelInfo::SetSuccessor(NickCore *nc)
 	this->successor = nc;
 	if (this->successor)
 		this->successor->AddChannelReference(this);
+
+	this->QueueUpdate();
 }
 
 NickCore *ChannelInfo::GetSuccessor() const
@@ -412,6 +425,8 @@ void ChannelInfo::AddAccess(ChanAccess *taccess)
 		if (ci != NULL)
 			ci->AddChannelReference(this->name);
 	}
+
+	++ChanAccess::Generation;
 }
 
 ChanAccess *ChannelInfo::GetAccess(unsigned index) const
@@ -419,9 +434,72 @@ ChanAccess *ChannelInfo::GetAccess(unsigned index) const
 	if (this->access->empty() || index >= this->access->size())
 		return NULL;
 
-	ChanAccess *acc = (*this->access)[index];
-	acc->QueueUpdate();
-	return acc;
+	return (*this->access)[index];
+}
+
+void ChannelInfo::UpdateAccessIndex()
+{
+	unsigned count = this->access->size();
+	if (this->access_generation == ChanAccess::Generation)
+		return;
+
+	this->access_generation = ChanAccess::Generation;
+	this->access_by_account.clear();
+	this->access_by_nick.clear();
+	this->access_by_mask.clear();
+	this->access_cache.clear();
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const ChanAccess *a = (*this->access)[i];
+
+		/* See ChanAccess::Matches, a mask with none of these can only match the nick of an alias */
+		if (a->nc)
+			this->access_by_account[a->nc].push_back(i);
+		else if (a->mask.find_first_of("!@?*") == Anope::string::npos && !IRCD->IsChannelValid(a->mask))
+			this->access_by_nick[a->mask].push_back(i);
+		else
+			this->access_by_mask.push_back(i);
+	}
+}
+
+void ChannelInfo::MatchAccess(const User *u, const NickCore *nc, std::vector<ChanAccess *> &entries, ChanAccess::Path &path)
+{
+	this->UpdateAccessIndex();
+
+	std::vector<unsigned> candidates = this->access_by_mask;
+	if (nc != NULL)
+	{
+		TR1NS::unordered_map<const NickCore *, std::vector<unsigned> >::const_iterator it = this->access_by_account.find(nc);
+		if (it != this->access_by_account.end())
+			candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+
+		for (unsigned i = 0; i < nc->aliases->size(); ++i)
+		{
+			Anope::hash_map<std::vector<unsigned> >::const_iterator it2 = this->access_by_nick.find(nc->aliases->at(i)->nick);
+			if (it2 != this->access_by_nick.end())
+				candidates.insert(candidates.end(), it2->second.begin(), it2->second.end());
+		}
+
+		/* Keep access list order */
+		std::sort(candidates.begin(), candidates.end());
+	}
+
+	for (unsigned i = 0; i < candidates.size(); ++i)
+	{
+		ChanAccess *a = (*this->access)[candidates[i]];
+		if (a->Matches(u, nc, path))
+			entries.push_back(a);
+	}
+}
+
+void ChannelInfo::UpdateLastUsed()
+{
+	if (this->last_used == Anope::CurTime)
+		return;
+
+	this->last_used = Anope::CurTime;
+	this->QueueUpdate();
 }
 
 AccessGroup ChannelInfo::AccessFor(const User *u)
@@ -444,19 +522,42 @@ AccessGroup ChannelInfo::AccessFor(const User *u)
 	group.ci = this;
 	group.nc = nc;
 
-	for (unsigned i = 0, end = this->GetAccessCount(); i < end; ++i)
+	/* Which entries match depends only on the user's mask and account, so
+	 * remember them until either, or any access list, changes
+	 */
+	this->UpdateAccessIndex();
+
+	Anope::string mask = u->GetDisplayedMask();
+	Anope::hash_map<CachedAccess>::iterator it = this->access_cache.find(mask);
+	if (it == this->access_cache.end() || it->second.nc != u->Account())
 	{
-		ChanAccess *a = this->GetAccess(i);
-		if (a->Matches(u, u->Account(), group.path))
-			group.push_back(a);
+		if (it == this->access_cache.end())
+		{
+			if (this->access_cache.size() >= 1024)
+				this->access_cache.clear();
+			it = this->access_cache.insert(std::make_pair(mask, CachedAccess())).first;
+		}
+
+		CachedAccess &cached = it->second;
+		cached.nc = u->Account();
+		cached.entries.clear();
+		cached.path = ChanAccess::Path();
+		this->MatchAccess(u, u->Account(), cached.entries, cached.path);
 	}
 
+	group.insert(group.end(), it->second.entries.begin(), it->second.entries.end());
+	group.path = it->second.path;
+
 	if (group.founder || !group.empty())
 	{
-		this->last_used = Anope::CurTime;
+		this->UpdateLastUsed();
 
 		for (unsigned i = 0; i < group.size(); ++i)
-			group[i]->last_seen = Anope::CurTime;
+			if (group[i]->last_seen != Anope::CurTime)
+			{
+				group[i]->last_seen = Anope::CurTime;
+				group[i]->QueueUpdate();
+			}
 	}
 
 	return group;
@@ -470,15 +571,10 @@ AccessGroup ChannelInfo::AccessFor(const NickCore *nc)
 	group.ci = this;
 	group.nc = nc;
 
-	for (unsigned i = 0, end = this->GetAccessCount(); i < end; ++i)
-	{
-		ChanAccess *a = this->GetAccess(i);
-		if (a->Matches(NULL, nc, group.path))
-			group.push_back(a);
-	}
+	this->MatchAccess(NULL, nc, group, group.path);
 
 	if (group.founder || !group.empty())
-		this->last_used = Anope::CurTime;
+		this->UpdateLastUsed();
 
 		/* don't update access last seen here, this isn't the user requesting access */
 
@@ -521,6 +617,7 @@ ChanAccess *ChannelInfo::EraseAccess(unsigned index)
 
 	ChanAccess *ca = this->access->at(index);
 	this->access->erase(this->access->begin() + index);
+	++ChanAccess::Generation;
 	return ca;
 }
 
@@ -568,9 +665,7 @@ AutoKick *ChannelInfo::GetAkick(unsigned index) const
 	if (this->akick->empty() || index >= this->akick->size())
 		return NULL;
 
-	AutoKick *ak = (*this->akick)[index];
-	ak->QueueUpdate();
-	return ak;
+	return (*this->akick)[index];
 }
 
 unsigned ChannelInfo::GetAkickCount() const
@@ -609,16 +704,19 @@ int16_t ChannelInfo::GetLevel(const Anope::string &priv) const
 void ChannelInfo::SetLevel(const Anope::string &priv, int16_t level)
 {
 	this->levels[priv] = level;
+	this->QueueUpdate();
 }
 
 void ChannelInfo::RemoveLevel(const Anope::string &priv)
 {
-	this->levels.erase(priv);
+	if (this->levels.erase(priv))
+		this->QueueUpdate();
 }
 
 void ChannelInfo::ClearLevels()
 {
 	this->levels.clear();
+	this->QueueUpdate();
 }
 
 Anope::string ChannelInfo::GetIdealBan(User *u) const
@@ -645,10 +743,7 @@ ChannelInfo* ChannelInfo::Find(const Anope::string &name)
 {
 	registered_channel_map::const_iterator it = RegisteredChannelList->find(name);
 	if (it != RegisteredChannelList->end())
-	{
-		it->second->QueueUpdate();
 		return it->second;
-	}
 
 	return NULL;
 }
@@ -26,6 +26,7 @@ using namespace Serialize;
 std::vector<Anope::string> Type::TypeOrder;
 std::map<Anope::string, Type *> Serialize::Type::Types;
 std::list<Serializable *> *Serializable::SerializableItems;
+std::list<Serializable *> *Serializable::UpdatedItems;
 
 void Serialize::RegisterTypes()
 {
@@ -43,7 +44,7 @@ void Serialize::CheckTypes()
 	}
 }
 
-Serializable::Serializable(const Anope::string &serialize_type) : last_commit(0), last_commit_time(0), id(0), redis_ignore(0)
+Serializable::Serializable(const Anope::string &serialize_type) : updated(false), last_commit(0), id(0), redis_ignore(0)
 {
 	if (SerializableItems == NULL)
 		SerializableItems = new std::list<Serializable *>();
@@ -57,7 +58,7 @@ Serializable::Serializable(const Anope::string &serialize_type) : last_commit(0)
 	FOREACH_MOD(OnSerializableConstruct, (this));
 }
 
-Serializable::Serializable(const Serializable &other) : last_commit(0), last_commit_time(0), id(0), redis_ignore(0)
+Serializable::Serializable(const Serializable &other) : updated(false), last_commit(0), id(0), redis_ignore(0)
 {
 	SerializableItems->push_back(this);
 	this->s_iter = SerializableItems->end();
@@ -73,6 +74,8 @@ Serializable::~Serializable()
 	FOREACH_MOD(OnSerializableDestruct, (this));
 
 	SerializableItems->erase(this->s_iter);
+	if (this->updated)
+		UpdatedItems->erase(this->u_iter);
 }
 
 Serializable &Serializable::operator=(const Serializable &)
@@ -83,10 +86,13 @@ Serializable &Serializable::operator=(const Serializable &)
 void Serializable::QueueUpdate()
 {
 	/* Schedule updater */
-	FOREACH_MOD(OnSerializableUpdate, (this));
-
-	/* Check for modifications now - this can delete this object! */
-	FOREACH_MOD(OnSerializeCheck, (this->GetSerializableType()));
+	if (!this->updated)
+	{
+		if (UpdatedItems == NULL)
+			UpdatedItems = new std::list<Serializable *>();
+		this->u_iter = UpdatedItems->insert(UpdatedItems->end(), this);
+		this->updated = true;
+	}
 }
 
 bool Serializable::IsCached(Serialize::Data &data)
@@ -99,19 +105,35 @@ void Serializable::UpdateCache(Serialize::Data &data)
 	this->last_commit = data.Hash();
 }
 
-bool Serializable::IsTSCached()
+const std::list<Serializable *> &Serializable::GetItems()
 {
-	return this->last_commit_time == Anope::CurTime;
+	return *SerializableItems;
 }
 
-void Serializable::UpdateTS()
+void Serializable::ProcessUpdates()
 {
-	this->last_commit_time = Anope::CurTime;
-}
+	if (UpdatedItems == NULL || UpdatedItems->empty())
+		return;
 
-const std::list<Serializable *> &Serializable::GetItems()
-{
-	return *SerializableItems;
+	/* Check each updated type for modifications once, this can delete objects in the list */
+	std::set<Type *> types;
+	for (std::list<Serializable *>::const_iterator it = UpdatedItems->begin(), it_end = UpdatedItems->end(); it != it_end; ++it)
+		if ((*it)->s_type)
+			types.insert((*it)->s_type);
+	for (std::set<Type *>::const_iterator it = types.begin(), it_end = types.end(); it != it_end; ++it)
+		FOREACH_MOD(OnSerializeCheck, (*it));
+
+	/* Objects updated from within OnSerializableUpdate are appended and left for the next call,
+	 * and objects destroyed from within it remove themselves from the list.
+	 */
+	for (size_t count = UpdatedItems->size(); count > 0 && !UpdatedItems->empty(); --count)
+	{
+		Serializable *obj = UpdatedItems->front();
+		UpdatedItems->pop_front();
+		obj->updated = false;
+
+		FOREACH_MOD(OnSerializableUpdate, (obj));
+	}
 }
 
 Type::Type(const Anope::string &n, unserialize_func f, Module *o)  : name(n), unserialize(f), owner(o), timestamp(0)
@@ -14,7 +14,13 @@
 #include "sockets.h"
 #include "socketengine.h"
 
-BufferedSocket::BufferedSocket()
+/* The least amount of free space to recv() into, the read buffer grows past this if a socket keeps filling it */
+static const size_t READ_MIN_FREE = 4096;
+/* The most lines and bytes to write each time a socket is writable, so one socket can not hog the loop */
+static const int WRITE_MAX_IOV = 64;
+static const size_t WRITE_MAX_FLUSH = NET_BUFSIZE * 4;
+
+BufferedSocket::BufferedSocket() : read_start(0), read_end(0), write_start(0), write_len(0), last_flushed(0), recv_len(0)
 {
 }
 
@@ -24,27 +30,69 @@ BufferedSocket::~BufferedSocket()
 
 bool BufferedSocket::ProcessRead()
 {
-	char tbuffer[NET_BUFSIZE];
-
 	this->recv_len = 0;
 
-	int len = this->io->Recv(this, tbuffer, sizeof(tbuffer) - 1);
+	if (this->read_start == this->read_end)
+		this->read_start = this->read_end = 0;
+	else if (this->read_start && this->read_buffer.size() - this->read_end < READ_MIN_FREE)
+	{
+		/* Move the unconsumed data (usually part of a line) to the front to make room */
+		memmove(&this->read_buffer[0], &this->read_buffer[this->read_start], this->read_end - this->read_start);
+		this->read_end -= this->read_start;
+		this->read_start = 0;
+	}
+
+	if (this->read_buffer.size() - this->read_end < READ_MIN_FREE)
+		this->read_buffer.resize(std::max(this->read_buffer.size() * 2, this->read_end + READ_MIN_FREE));
+
+	size_t avail = this->read_buffer.size() - this->read_end;
+	int len = this->io->Recv(this, &this->read_buffer[this->read_end], avail);
 	if (len <= 0)
 		return false;
-	
-	tbuffer[len] = 0;
-	this->read_buffer.append(tbuffer);
+
+	this->read_end += len;
 	this->recv_len = len;
 
+	/* The socket had more to give than we had room for, so read more at once next time */
+	if (static_cast<size_t>(len) == avail && this->read_buffer.size() < NET_BUFSIZE)
+		this->read_buffer.resize(this->read_buffer.size() * 2);
+
 	return true;
 }
 
 bool BufferedSocket::ProcessWrite()
 {
-	int count = this->io->Send(this, this->write_buffer);
-	if (count <= -1)
-		return false;
-	this->write_buffer = this->write_buffer.substr(count);
+	struct iovec iov[WRITE_MAX_IOV];
+	int count = 0;
+	size_t total = 0;
+
+	for (std::deque<Anope::string>::const_iterator it = this->write_buffer.begin(), it_end = this->write_buffer.end(); it != it_end && count < WRITE_MAX_IOV && total < WRITE_MAX_FLUSH; ++it, ++count)
+	{
+		size_t offset = count ? 0 : this->write_start;
+		iov[count].iov_base = const_cast<char *>(it->c_str() + offset);
+		iov[count].iov_len = it->length() - offset;
+		total += iov[count].iov_len;
+	}
+
+	this->last_flushed = 0;
+	if (count)
+	{
+		int sent = this->io->Send(this, iov, count);
+		if (sent <= -1)
+			return false;
+		this->last_flushed = sent;
+
+		/* Drop the lines which were fully written, and remember how far we got into the next one */
+		size_t left = sent + this->write_start;
+		while (!this->write_buffer.empty() && left >= this->write_buffer.front().length())
+		{
+			left -= this->write_buffer.front().length();
+			this->write_len -= this->write_buffer.front().length();
+			this->write_buffer.pop_front();
+		}
+		this->write_start = left;
+	}
+
 	if (this->write_buffer.empty())
 		SocketEngine::Change(this, false, SF_WRITABLE);
 
@@ -53,18 +101,41 @@ bool BufferedSocket::ProcessWrite()
 
 const Anope::string BufferedSocket::GetLine()
 {
-	size_t s = this->read_buffer.find('\n');
-	if (s == Anope::string::npos)
-		return "";
-	Anope::string str = this->read_buffer.substr(0, s + 1);
-	this->read_buffer.erase(0, s + 1);
-	this->read_buffer.ltrim();
-	return str.trim();
+	Anope::string line;
+	this->GetLine(line);
+	return line;
+}
+
+bool BufferedSocket::GetLine(Anope::string &line)
+{
+	/* Skip the whitespace (usually \r\n) left over from the previous line */
+	while (this->read_start < this->read_end && isspace(static_cast<unsigned char>(this->read_buffer[this->read_start])))
+		++this->read_start;
+
+	if (this->read_start == this->read_end)
+		return false;
+
+	const char *begin = &this->read_buffer[this->read_start];
+	const char *nl = static_cast<const char *>(memchr(begin, '\n', this->read_end - this->read_start));
+	if (nl == NULL)
+		return false;
+
+	const char *end = nl;
+	while (end > begin && isspace(static_cast<unsigned char>(end[-1])))
+		--end;
+
+	line = Anope::string(begin, end - begin);
+	this->read_start += nl - begin + 1;
+	return true;
 }
 
 void BufferedSocket::Write(const char *buffer, size_t l)
 {
-	this->write_buffer += buffer + Anope::string("\r\n");
+	this->write_buffer.push_back(Anope::string());
+	std::string &line = this->write_buffer.back().str();
+	line.reserve(l + 2);
+	line.append(buffer, l).append("\r\n", 2);
+	this->write_len += l + 2;
 	SocketEngine::Change(this, true, SF_WRITABLE);
 }
 
@@ -80,7 +151,10 @@ void BufferedSocket::Write(const char *message, ...)
 	int len = vsnprintf(tbuffer, sizeof(tbuffer), message, vi);
 	va_end(vi);
 
-	this->Write(tbuffer, std::min(len, static_cast<int>(sizeof(tbuffer))));
+	if (len < 0)
+		return;
+
+	this->Write(tbuffer, std::min(static_cast<size_t>(len), sizeof(tbuffer) - 1));
 }
 
 void BufferedSocket::Write(const Anope::string &message)
@@ -95,7 +169,17 @@ int BufferedSocket::ReadBufferLen() const
 
 int BufferedSocket::WriteBufferLen() const
 {
-	return this->write_buffer.length();
+	return this->write_len - this->write_start;
+}
+
+unsigned BufferedSocket::WriteQueueDepth() const
+{
+	return this->write_buffer.size();
+}
+
+size_t BufferedSocket::LastFlushed() const
+{
+	return this->last_flushed;
 }
 
 
@@ -178,7 +262,10 @@ void BinarySocket::Write(const char *message, ...)
 	int len = vsnprintf(tbuffer, sizeof(tbuffer), message, vi);
 	va_end(vi);
 
-	this->Write(tbuffer, std::min(len, static_cast<int>(sizeof(tbuffer))));
+	if (len < 0)
+		return;
+
+	this->Write(tbuffer, std::min(static_cast<size_t>(len), sizeof(tbuffer) - 1));
 }
 
 void BinarySocket::Write(const Anope::string &message)
@@ -14,6 +14,7 @@
 #include "sockets.h"
 #include "socketengine.h"
 #include "config.h"
+#include "timers.h"
 
 #include <sys/epoll.h>
 #include <ulimit.h>
@@ -34,8 +35,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -72,10 +73,10 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 
 void SocketEngine::Process()
 {
-	if (Sockets.size() > events.size())
+	if (SocketCount > events.size())
 		events.resize(events.size() * 2);
 
-	int total = epoll_wait(EngineHandle, &events.front(), events.size(), Config->ReadTimeout * 1000);
+	int total = epoll_wait(EngineHandle, &events.front(), events.size(), TimerManager::GetTimeout(Config->ReadTimeout));
 	Anope::CurTime = time(NULL);
 
 	/* EINTR can be given if the read timeout expires */
@@ -86,14 +87,14 @@ void SocketEngine::Process()
 		return;
 	}
 
+	unsigned gen = Generation;
 	for (int i = 0; i < total; ++i)
 	{
 		epoll_event &ev = events[i];
 
-		std::map<int, Socket *>::iterator it = Sockets.find(ev.data.fd);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(ev.data.fd, gen);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (ev.events & (EPOLLHUP | EPOLLERR))
 		{
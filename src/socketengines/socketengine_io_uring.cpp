@@ -0,0 +1,440 @@
+/*
+ *
+ * (C) 2003-2013 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ *
+ * Based on the original code of Epona by Lara.
+ * Based on the original code of Services by Andy Church.
+ */
+
+#include "services.h"
+#include "anope.h"
+#include "sockets.h"
+#include "socketengine.h"
+#include "logger.h"
+#include "config.h"
+#include "timers.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <errno.h>
+
+#ifndef __NR_io_uring_setup
+# define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+# define __NR_io_uring_enter 426
+#endif
+
+/* This engine keeps one poll request queued in an io_uring for each socket.
+ * Changes to which events a socket wants are queued up and submitted all at
+ * once by the same io_uring_enter() call that waits for events, so a loop
+ * iteration costs one system call no matter how many sockets changed.
+ * If the kernel does not support io_uring this falls back to epoll.
+ */
+
+/* user_data for requests whose completions we do not care about */
+static const uint64_t TOKEN_TIMEOUT = ~0ULL, TOKEN_REMOVE = ~0ULL - 1;
+
+static bool use_epoll = false;
+
+static int ring_fd = -1;
+static void *ring_ptr = MAP_FAILED, *sqes_ptr = MAP_FAILED;
+static size_t ring_size, sqes_size;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+static unsigned sq_entries, sq_local_tail, sq_pending;
+static io_uring_sqe *sqes;
+static io_uring_cqe *cqes;
+
+/* Whether the timeout used to bound waiting is still queued */
+static bool timeout_queued = false;
+static struct __kernel_timespec timeout_ts;
+static long long timeout_deadline = 0;
+
+/* The poll request queued for each fd, indexed by fd */
+struct PollState
+{
+	/* user_data of the queued request, 0 if none is queued */
+	uint64_t token;
+	short mask;
+
+	PollState() : token(0), mask(0) { }
+};
+static std::vector<PollState> poll_states;
+static unsigned poll_serial;
+
+/* Events reaped from the completion queue, handled once all have been reaped */
+struct ReadyEvent
+{
+	int fd;
+	short revents;
+};
+static std::vector<ReadyEvent> ready;
+
+/* epoll fallback */
+static int epoll_handle = -1;
+static std::vector<epoll_event> epoll_events;
+
+static inline int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline void FlushSQ()
+{
+	/* Make the sqes visible to the kernel before the tail that publishes them */
+	__sync_synchronize();
+	*sq_tail = sq_local_tail;
+	__sync_synchronize();
+}
+
+static void Submit()
+{
+	FlushSQ();
+	while (sq_pending)
+	{
+		int i = uring_enter(sq_pending, 0, 0);
+		if (i < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw SocketException("Unable to submit to io_uring: " + Anope::LastError());
+		}
+		sq_pending -= i;
+	}
+}
+
+static io_uring_sqe *GetSQE()
+{
+	__sync_synchronize();
+	if (sq_local_tail - *sq_head >= sq_entries)
+		Submit();
+
+	unsigned index = sq_local_tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array[index] = index;
+
+	++sq_local_tail;
+	++sq_pending;
+	return sqe;
+}
+
+/* Make sure the poll queued for fd is for mask, replacing it if not */
+static void Arm(int fd, short mask)
+{
+	if (static_cast<unsigned>(fd) >= poll_states.size())
+		poll_states.resize(std::max<size_t>(fd + 1, poll_states.size() * 2));
+
+	PollState &st = poll_states[fd];
+	if (st.token && st.mask == mask)
+		return;
+
+	if (st.token)
+	{
+		io_uring_sqe *sqe = GetSQE();
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = st.token;
+		sqe->user_data = TOKEN_REMOVE;
+		st.token = 0;
+	}
+
+	st.mask = mask;
+	if (!mask)
+		return;
+
+	if (++poll_serial == 0)
+		++poll_serial;
+	st.token = (static_cast<uint64_t>(poll_serial) << 32) | static_cast<unsigned>(fd);
+
+	io_uring_sqe *sqe = GetSQE();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll_events = mask;
+	sqe->user_data = st.token;
+}
+
+static inline short GetMask(Socket *s)
+{
+	return (s->flags[SF_READABLE] ? POLLIN : 0) | (s->flags[SF_WRITABLE] ? POLLOUT : 0);
+}
+
+/* Handle an event for a socket, which may delete it */
+static void ProcessEvent(Socket *s, bool error, bool readable, bool writable)
+{
+	if (error)
+	{
+		s->ProcessError();
+		delete s;
+		return;
+	}
+
+	if (!s->Process())
+	{
+		if (s->flags[SF_DEAD])
+			delete s;
+		return;
+	}
+
+	if (readable && !s->ProcessRead())
+		s->flags[SF_DEAD] = true;
+
+	if (writable && !s->ProcessWrite())
+		s->flags[SF_DEAD] = true;
+
+	if (s->flags[SF_DEAD])
+		delete s;
+}
+
+static void ShutdownRing()
+{
+	if (sqes_ptr != MAP_FAILED)
+		munmap(sqes_ptr, sqes_size);
+	if (ring_ptr != MAP_FAILED)
+		munmap(ring_ptr, ring_size);
+	if (ring_fd >= 0)
+		close(ring_fd);
+
+	sqes_ptr = ring_ptr = MAP_FAILED;
+	ring_fd = -1;
+}
+
+static bool InitRing()
+{
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 65536;
+
+	ring_fd = syscall(__NR_io_uring_setup, 1024, &p);
+	if (ring_fd < 0)
+		return false;
+
+	/* We need a single mmap for both rings and no dropped completions, which is Linux 5.5 */
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP))
+	{
+		ShutdownRing();
+		errno = ENOSYS;
+		return false;
+	}
+
+	ring_size = std::max<size_t>(p.sq_off.array + p.sq_entries * sizeof(unsigned), p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+	ring_ptr = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+	sqes_ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (ring_ptr == MAP_FAILED || sqes_ptr == MAP_FAILED)
+	{
+		ShutdownRing();
+		return false;
+	}
+
+	char *ring = static_cast<char *>(ring_ptr);
+	sq_head = reinterpret_cast<unsigned *>(ring + p.sq_off.head);
+	sq_tail = reinterpret_cast<unsigned *>(ring + p.sq_off.tail);
+	sq_mask = reinterpret_cast<unsigned *>(ring + p.sq_off.ring_mask);
+	sq_array = reinterpret_cast<unsigned *>(ring + p.sq_off.array);
+	cq_head = reinterpret_cast<unsigned *>(ring + p.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned *>(ring + p.cq_off.tail);
+	cq_mask = reinterpret_cast<unsigned *>(ring + p.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe *>(ring + p.cq_off.cqes);
+	sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+	sq_entries = p.sq_entries;
+	sq_local_tail = *sq_tail;
+	sq_pending = 0;
+
+	return true;
+}
+
+void SocketEngine::Init()
+{
+	if (InitRing())
+		return;
+
+	Log(LOG_DEBUG) << "io_uring is not available (" << Anope::LastError() << "), using epoll";
+
+	use_epoll = true;
+	epoll_handle = epoll_create(4);
+
+	if (epoll_handle == -1)
+		throw SocketException("Could not initialize epoll socket engine: " + Anope::LastError());
+
+	epoll_events.resize(DefaultSize);
+}
+
+void SocketEngine::Shutdown()
+{
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
+
+	if (!use_epoll)
+		ShutdownRing();
+}
+
+void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
+{
+	if (set == s->flags[flag])
+		return;
+
+	bool before_registered = s->flags[SF_READABLE] || s->flags[SF_WRITABLE];
+
+	s->flags[flag] = set;
+
+	bool now_registered = s->flags[SF_READABLE] || s->flags[SF_WRITABLE];
+
+	if (!use_epoll)
+	{
+		if (before_registered || now_registered)
+			Arm(s->GetFD(), GetMask(s));
+		return;
+	}
+
+	epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+
+	ev.events = (s->flags[SF_READABLE] ? EPOLLIN : 0) | (s->flags[SF_WRITABLE] ? EPOLLOUT : 0);
+	ev.data.fd = s->GetFD();
+
+	int mod;
+	if (!before_registered && now_registered)
+		mod = EPOLL_CTL_ADD;
+	else if (before_registered && !now_registered)
+		mod = EPOLL_CTL_DEL;
+	else if (before_registered && now_registered)
+		mod = EPOLL_CTL_MOD;
+	else
+		return;
+
+	if (epoll_ctl(epoll_handle, mod, ev.data.fd, &ev) == -1)
+		 throw SocketException("Unable to epoll_ctl() fd " + stringify(ev.data.fd) + " to epoll: " + Anope::LastError());
+}
+
+static void ProcessEpoll()
+{
+	if (SocketEngine::SocketCount > epoll_events.size())
+		epoll_events.resize(epoll_events.size() * 2);
+
+	int total = epoll_wait(epoll_handle, &epoll_events.front(), epoll_events.size(), TimerManager::GetTimeout(Config->ReadTimeout));
+	Anope::CurTime = time(NULL);
+
+	/* EINTR can be given if the read timeout expires */
+	if (total == -1)
+	{
+		if (errno != EINTR)
+			Log() << "SockEngine::Process(): error: " << Anope::LastError();
+		return;
+	}
+
+	unsigned gen = SocketEngine::Generation;
+	for (int i = 0; i < total; ++i)
+	{
+		epoll_event &ev = epoll_events[i];
+
+		Socket *s = SocketEngine::FindSocket(ev.data.fd, gen);
+		if (s != NULL)
+			ProcessEvent(s, ev.events & (EPOLLHUP | EPOLLERR), ev.events & EPOLLIN, ev.events & EPOLLOUT);
+	}
+}
+
+void SocketEngine::Process()
+{
+	if (use_epoll)
+	{
+		ProcessEpoll();
+		return;
+	}
+
+	/* Wait until the next timer is due, or until anything else completes. A
+	 * timeout still queued from an earlier call may expire later than that,
+	 * in which case a shorter one is queued alongside it.
+	 */
+	long timeout = TimerManager::GetTimeout(Config->ReadTimeout);
+	timeval now;
+	gettimeofday(&now, NULL);
+	long long deadline = static_cast<long long>(now.tv_sec) * 1000 + now.tv_usec / 1000 + timeout;
+	if (!timeout_queued || deadline < timeout_deadline)
+	{
+		timeout_ts.tv_sec = timeout / 1000;
+		timeout_ts.tv_nsec = (timeout % 1000) * 1000000;
+		timeout_deadline = deadline;
+
+		io_uring_sqe *sqe = GetSQE();
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->fd = -1;
+		sqe->addr = reinterpret_cast<uintptr_t>(&timeout_ts);
+		sqe->len = 1;
+		sqe->off = 1;
+		sqe->user_data = TOKEN_TIMEOUT;
+		timeout_queued = true;
+	}
+
+	FlushSQ();
+	int i = uring_enter(sq_pending, 1, IORING_ENTER_GETEVENTS);
+	Anope::CurTime = time(NULL);
+
+	if (i < 0)
+	{
+		if (errno != EINTR)
+			Log() << "SockEngine::Process(): error: " << Anope::LastError();
+		return;
+	}
+	sq_pending -= i;
+
+	ready.clear();
+
+	unsigned head = *cq_head;
+	__sync_synchronize();
+	unsigned tail = *cq_tail;
+	for (; head != tail; ++head)
+	{
+		const io_uring_cqe &cqe = cqes[head & *cq_mask];
+
+		if (cqe.user_data == TOKEN_TIMEOUT)
+		{
+			timeout_queued = false;
+			continue;
+		}
+		else if (cqe.user_data == TOKEN_REMOVE)
+			continue;
+
+		int fd = cqe.user_data & 0xFFFFFFFF;
+		if (static_cast<unsigned>(fd) >= poll_states.size() || poll_states[fd].token != cqe.user_data)
+			/* A poll we have since removed or replaced */
+			continue;
+
+		/* Polls are one shot, so this one is no longer queued */
+		poll_states[fd].token = 0;
+
+		ReadyEvent ev;
+		ev.fd = fd;
+		ev.revents = cqe.res < 0 ? POLLERR : cqe.res;
+		ready.push_back(ev);
+	}
+	__sync_synchronize();
+	*cq_head = head;
+
+	unsigned gen = Generation;
+	for (unsigned j = 0; j < ready.size(); ++j)
+	{
+		const ReadyEvent &ev = ready[j];
+
+		Socket *s = FindSocket(ev.fd, gen);
+		if (s == NULL)
+			continue;
+
+		ProcessEvent(s, ev.revents & (POLLHUP | POLLERR), ev.revents & POLLIN, ev.revents & POLLOUT);
+
+		/* Queue the next poll for the socket if it still exists */
+		s = FindSocket(ev.fd, gen);
+		if (s != NULL)
+			Arm(ev.fd, GetMask(s));
+	}
+}
@@ -15,6 +15,7 @@
 #include "socketengine.h"
 #include "logger.h"
 #include "config.h"
+#include "timers.h"
 
 #include <sys/types.h>
 #include <sys/event.h>
@@ -46,8 +47,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -71,10 +72,11 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 
 void SocketEngine::Process()
 {
-	if (Sockets.size() > event_events.size())
+	if (SocketCount > event_events.size())
 		event_events.resize(event_events.size() * 2);
 
-	static timespec kq_timespec = { Config->ReadTimeout, 0 };
+	long timeout = TimerManager::GetTimeout(Config->ReadTimeout);
+	timespec kq_timespec = { timeout / 1000, (timeout % 1000) * 1000000 };
 	int total = kevent(kq_fd, &change_events.front(), change_count, &event_events.front(), event_events.size(), &kq_timespec);
 	change_count = 0;
 	Anope::CurTime = time(NULL);
@@ -87,16 +89,16 @@ void SocketEngine::Process()
 		return;
 	}
 
+	unsigned gen = Generation;
 	for (int i = 0; i < total; ++i)
 	{
 		struct kevent &event = event_events[i];
 		if (event.flags & EV_ERROR)
 			continue;
 
-		std::map<int, Socket *>::iterator it = Sockets.find(event.ident);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(event.ident, gen);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (event.flags & EV_EOF)
 		{
@@ -14,6 +14,7 @@
 #include "sockets.h"
 #include "socketengine.h"
 #include "config.h"
+#include "timers.h"
 
 #include <errno.h>
 
@@ -32,7 +33,8 @@
 #endif
 
 static std::vector<pollfd> events;
-static std::map<int, unsigned> socket_positions;
+/* Position of each fd in events, indexed by fd */
+static std::vector<unsigned> socket_positions;
 
 void SocketEngine::Init()
 {
@@ -41,8 +43,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -64,42 +66,43 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 		ev.fd = s->GetFD();
 		ev.events = (s->flags[SF_READABLE] ? POLLIN : 0) | (s->flags[SF_WRITABLE] ? POLLOUT : 0);
 
+		if (static_cast<unsigned>(ev.fd) >= socket_positions.size())
+			socket_positions.resize(std::max<size_t>(ev.fd + 1, socket_positions.size() * 2));
 		socket_positions[ev.fd] = events.size();
 		events.push_back(ev);
 	}
 	else if (before_registered && !now_registered)
 	{
-		std::map<int, unsigned>::iterator pos = socket_positions.find(s->GetFD());
-		if (pos == socket_positions.end())
+		unsigned pos = static_cast<unsigned>(s->GetFD()) < socket_positions.size() ? socket_positions[s->GetFD()] : events.size();
+		if (pos >= events.size() || events[pos].fd != s->GetFD())
 			throw SocketException("Unable to remove fd " + stringify(s->GetFD()) + " from poll, it does not exist?");
 
-		if (pos->second != events.size() - 1)
+		if (pos != events.size() - 1)
 		{
-			pollfd &ev = events[pos->second],
+			pollfd &ev = events[pos],
 				&last_ev = events[events.size() - 1];
 
 			ev = last_ev;
 
-			socket_positions[ev.fd] = pos->second;
+			socket_positions[ev.fd] = pos;
 		}
 
-		socket_positions.erase(pos);
 		events.pop_back();
 	}
 	else if (before_registered && now_registered)
 	{
-		std::map<int, unsigned>::iterator pos = socket_positions.find(s->GetFD());
-		if (pos == socket_positions.end())
+		unsigned pos = static_cast<unsigned>(s->GetFD()) < socket_positions.size() ? socket_positions[s->GetFD()] : events.size();
+		if (pos >= events.size() || events[pos].fd != s->GetFD())
 			throw SocketException("Unable to modify fd " + stringify(s->GetFD()) + " in poll, it does not exist?");
 
-		pollfd &ev = events[pos->second];
+		pollfd &ev = events[pos];
 		ev.events = (s->flags[SF_READABLE] ? POLLIN : 0) | (s->flags[SF_WRITABLE] ? POLLOUT : 0);
 	}
 }
 
 void SocketEngine::Process()
 {
-	int total = poll(&events.front(), events.size(), Config->ReadTimeout * 1000);
+	int total = poll(&events.front(), events.size(), TimerManager::GetTimeout(Config->ReadTimeout));
 	Anope::CurTime = time(NULL);
 
 	/* EINTR can be given if the read timeout expires */
@@ -110,17 +113,18 @@ void SocketEngine::Process()
 		return;
 	}
 
+	unsigned gen = Generation;
 	for (unsigned i = 0, processed = 0; i < events.size() && processed != static_cast<unsigned>(total); ++i)
 	{
 		pollfd *ev = &events[i];
 		
-		if (ev->revents != 0)
-			++processed;
+		if (ev->revents == 0)
+			continue;
+		++processed;
 
-		std::map<int, Socket *>::iterator it = Sockets.find(ev->fd);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(ev->fd, gen);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (ev->revents & (POLLERR | POLLRDHUP))
 		{
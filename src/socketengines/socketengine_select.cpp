@@ -15,6 +15,7 @@
 #include "socketengine.h"
 #include "logger.h"
 #include "config.h"
+#include "timers.h"
 
 #ifdef _AIX
 # undef FD_ZERO
@@ -34,8 +35,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -84,9 +85,10 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 void SocketEngine::Process()
 {
 	fd_set rfdset = ReadFDs, wfdset = WriteFDs, efdset = ReadFDs;
+	long timeout = TimerManager::GetTimeout(Config->ReadTimeout);
 	timeval tval;
-	tval.tv_sec = Config->ReadTimeout;
-	tval.tv_usec = 0;
+	tval.tv_sec = timeout / 1000;
+	tval.tv_usec = (timeout % 1000) * 1000;
 
 #ifdef _WIN32
 	/* We can use the socket engine to "sleep" services for a period of
@@ -112,10 +114,12 @@ void SocketEngine::Process()
 	else if (sresult)
 	{
 		int processed = 0;
-		for (std::map<int, Socket *>::const_iterator it = Sockets.begin(), it_end = Sockets.end(); it != it_end && processed != sresult;)
+		unsigned gen = Generation;
+		for (int i = 0; i <= MaxFD && processed != sresult; ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = FindSocket(i, gen);
+			if (s == NULL)
+				continue;
 
 			bool has_read = FD_ISSET(s->GetFD(), &rfdset), has_write = FD_ISSET(s->GetFD(), &wfdset), has_error = FD_ISSET(s->GetFD(), &efdset);
 			if (has_read || has_write || has_error)
@@ -21,13 +21,44 @@
 #include <fcntl.h>
 #endif
 
-std::map<int, Socket *> SocketEngine::Sockets;
+std::vector<Socket *> SocketEngine::Sockets;
+std::vector<unsigned> SocketEngine::Generations;
+unsigned SocketEngine::Generation = 0;
+unsigned SocketEngine::SocketCount = 0;
 
 uint32_t TotalRead = 0;
 uint32_t TotalWritten = 0;
 
 SocketIO NormalSocketIO;
 
+void SocketEngine::AddSocket(Socket *s)
+{
+	int fd = s->GetFD();
+	if (fd < 0)
+		throw SocketException("Unable to add socket with no fd: " + Anope::LastError());
+
+	if (static_cast<unsigned>(fd) >= Sockets.size())
+	{
+		Sockets.resize(std::max<size_t>(fd + 1, Sockets.size() * 2), NULL);
+		Generations.resize(Sockets.size(), 0);
+	}
+
+	if (Sockets[fd] == NULL)
+		++SocketCount;
+	Sockets[fd] = s;
+	Generations[fd] = ++Generation;
+}
+
+void SocketEngine::DelSocket(Socket *s)
+{
+	int fd = s->GetFD();
+	if (FindSocket(fd) != s)
+		return;
+
+	Sockets[fd] = NULL;
+	--SocketCount;
+}
+
 sockaddrs::sockaddrs(const Anope::string &address)
 {
 	this->clear();
@@ -346,6 +377,55 @@ size_t cidr::hash::operator()(const cidr &s) const
 	}
 }
 
+CIDRTreeBase::NodeBase::NodeBase(const unsigned char *a, unsigned char l) : len(l)
+{
+	memset(this->addr, 0, sizeof(this->addr));
+	memcpy(this->addr, a, (l + 7) / 8);
+	if (l % 8)
+		this->addr[l / 8] &= 0xFF << (8 - l % 8);
+}
+
+unsigned CIDRTreeBase::CommonPrefix(const unsigned char *a, const unsigned char *b, unsigned max)
+{
+	unsigned i = 0;
+	for (; i + 8 <= max && a[i / 8] == b[i / 8]; i += 8);
+	for (; i < max && Bit(a, i) == Bit(b, i); ++i);
+	return i;
+}
+
+int CIDRTreeBase::ParseAddr(const Anope::string &ip, unsigned char *addr)
+{
+	bool ipv6 = ip.find(':') != Anope::string::npos;
+	sockaddrs sa;
+	sa.pton(ipv6 ? AF_INET6 : AF_INET, ip);
+	if (!sa.valid())
+		return -1;
+
+	if (ipv6)
+		memcpy(addr, &sa.sa6.sin6_addr, 16);
+	else
+		memcpy(addr, &sa.sa4.sin_addr, 4);
+	return ipv6;
+}
+
+int CIDRTreeBase::ParseRange(const Anope::string &mask, unsigned char *addr, unsigned char &len)
+{
+	size_t sl = mask.find_last_of('/');
+	int family = ParseAddr(mask.substr(0, sl), addr);
+	if (family < 0)
+		return -1;
+
+	unsigned max = family ? 128 : 32, l = max;
+	try
+	{
+		if (sl != Anope::string::npos && mask.substr(sl + 1).is_pos_number_only())
+			l = std::min(max, convertTo<unsigned>(mask.substr(sl + 1)));
+	}
+	catch (const ConvertException &) { }
+	len = l;
+	return family;
+}
+
 int SocketIO::Recv(Socket *s, char *buf, size_t sz)
 {
 	size_t i = recv(s->GetFD(), buf, sz, 0);
@@ -365,6 +445,14 @@ int SocketIO::Send(Socket *s, const Anope::string &buf)
 	return this->Send(s, buf.c_str(), buf.length());
 }
 
+int SocketIO::Send(Socket *s, const struct iovec *iov, int count)
+{
+	int i = writev(s->GetFD(), iov, count);
+	if (i > 0)
+		TotalWritten += i;
+	return i;
+}
+
 ClientSocket *SocketIO::Accept(ListenSocket *s)
 {
 	sockaddrs conaddr;
@@ -455,7 +543,7 @@ Socket::Socket(int s, bool i, int type)
 	else
 		this->sock = s;
 	this->SetBlocking(false);
-	SocketEngine::Sockets[this->sock] = this;
+	SocketEngine::AddSocket(this);
 	SocketEngine::Change(this, true, SF_READABLE);
 }
 
@@ -465,7 +553,7 @@ Socket::~Socket()
 	SocketEngine::Change(this, false, SF_WRITABLE);
 	anope_close(this->sock);
 	this->io->Destroy();
-	SocketEngine::Sockets.erase(this->sock);
+	SocketEngine::DelSocket(this);
 }
 
 int Socket::GetFD() const
@@ -10,11 +10,37 @@
 #include "services.h"
 #include "timers.h"
 
-std::multimap<time_t, Timer *> TimerManager::Timers;
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+/* The innermost level of the wheel has one slot per second, each outer level
+ * has slots covering a whole turn of the level beneath it.
+ */
+static const unsigned ROOT_BITS = 8, ROOT_SIZE = 1 << ROOT_BITS, ROOT_MASK = ROOT_SIZE - 1;
+static const unsigned LEVEL_BITS = 6, LEVEL_SIZE = 1 << LEVEL_BITS, LEVEL_MASK = LEVEL_SIZE - 1;
+static const unsigned OUTER_LEVELS = 3;
+/* Timers further away than this are parked in the last slot of the outermost level */
+static const time_t WHEEL_RANGE = static_cast<time_t>(1) << (ROOT_BITS + OUTER_LEVELS * LEVEL_BITS);
+
+static Timer *root_wheel[ROOT_SIZE];
+static Timer *outer_wheels[OUTER_LEVELS][LEVEL_SIZE];
+/* Timers taken off the slot currently being ticked */
+static Timer *expiring;
+/* The next second of the wheel that has not been ticked yet */
+static time_t wheel_time;
+static size_t timer_count;
+
+static inline unsigned OuterShift(unsigned level)
+{
+	return ROOT_BITS + level * LEVEL_BITS;
+}
 
 Timer::Timer(long time_from_now, time_t now, bool repeating)
 {
 	owner = NULL;
+	prev = next = NULL;
+	slot = NULL;
 	trigger = now + time_from_now;
 	secs = time_from_now;
 	repeat = repeating;
@@ -26,6 +52,8 @@ Timer::Timer(long time_from_now, time_t now, bool repeating)
 Timer::Timer(Module *creator, long time_from_now, time_t now, bool repeating)
 {
 	owner = creator;
+	prev = next = NULL;
+	slot = NULL;
 	trigger = now + time_from_now;
 	secs = time_from_now;
 	repeat = repeating;
@@ -79,50 +107,174 @@ Module *Timer::GetOwner() const
 	return owner;
 }
 
-void TimerManager::AddTimer(Timer *t)
+void TimerManager::Link(Timer *t)
 {
-	Timers.insert(std::make_pair(t->GetTimer(), t));
+	time_t expires = t->GetTimer();
+	Timer **head;
+
+	if (expires < wheel_time)
+		head = &root_wheel[wheel_time & ROOT_MASK];
+	else if (expires - wheel_time < static_cast<time_t>(ROOT_SIZE))
+		head = &root_wheel[expires & ROOT_MASK];
+	else
+	{
+		if (expires - wheel_time >= WHEEL_RANGE)
+			expires = wheel_time + WHEEL_RANGE - 1;
+
+		unsigned level = 0;
+		while (level + 1 < OUTER_LEVELS && expires - wheel_time >= static_cast<time_t>(1) << OuterShift(level + 1))
+			++level;
+
+		head = &outer_wheels[level][(expires >> OuterShift(level)) & LEVEL_MASK];
+	}
+
+	t->prev = NULL;
+	t->next = *head;
+	if (*head)
+		(*head)->prev = t;
+	*head = t;
+	t->slot = head;
+	++timer_count;
 }
 
-void TimerManager::DelTimer(Timer *t)
+void TimerManager::Unlink(Timer *t)
 {
-	std::pair<std::multimap<time_t, Timer *>::iterator, std::multimap<time_t, Timer *>::iterator> itpair = Timers.equal_range(t->GetTimer());
-	for (std::multimap<time_t, Timer *>::iterator i = itpair.first; i != itpair.second; ++i)
+	if (!t->slot)
+		return;
+
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		*t->slot = t->next;
+	if (t->next)
+		t->next->prev = t->prev;
+
+	t->prev = t->next = NULL;
+	t->slot = NULL;
+	--timer_count;
+}
+
+bool TimerManager::Cascade(unsigned level)
+{
+	unsigned index = (wheel_time >> OuterShift(level)) & LEVEL_MASK;
+
+	Timer *t = outer_wheels[level][index];
+	outer_wheels[level][index] = NULL;
+
+	while (t)
 	{
-		if (i->second == t)
-		{
-			Timers.erase(i);
-			break;
-		}
+		Timer *next = t->next;
+		t->prev = t->next = NULL;
+		t->slot = NULL;
+		--timer_count;
+		Link(t);
+		t = next;
 	}
+
+	return index == 0;
+}
+
+void TimerManager::AddTimer(Timer *t)
+{
+	Unlink(t);
+	/* Nothing to tick, so the wheel can start from now */
+	if (!timer_count && wheel_time < Anope::CurTime)
+		wheel_time = Anope::CurTime;
+	Link(t);
+}
+
+void TimerManager::DelTimer(Timer *t)
+{
+	Unlink(t);
 }
 
 void TimerManager::TickTimers(time_t ctime)
 {
-	while (!Timers.empty())
+	while (wheel_time <= ctime)
 	{
-		std::multimap<time_t, Timer *>::iterator it = Timers.begin();
-		Timer *t = it->second;
-
-		if (t->GetTimer() > ctime)
+		if (!timer_count)
+		{
+			wheel_time = ctime + 1;
 			break;
+		}
 
-		t->Tick(ctime);
+		unsigned index = wheel_time & ROOT_MASK;
+		if (!index)
+			for (unsigned level = 0; level < OUTER_LEVELS && Cascade(level); ++level);
 
-		if (t->GetRepeat())
-			t->SetTimer(ctime + t->GetSecs());
-		else
-			delete t;
+		/* Move this second's timers aside, anything they schedule goes into later slots */
+		expiring = root_wheel[index];
+		root_wheel[index] = NULL;
+		for (Timer *t = expiring; t; t = t->next)
+			t->slot = &expiring;
+		++wheel_time;
+
+		while (expiring)
+		{
+			Timer *t = expiring;
+			Unlink(t);
+
+			t->Tick(ctime);
+
+			if (t->GetRepeat())
+				t->SetTimer(ctime + t->GetSecs());
+			else
+				delete t;
+		}
 	}
 }
 
 void TimerManager::DeleteTimersFor(Module *m)
 {
-	for (std::multimap<time_t, Timer *>::iterator it = Timers.begin(), it_next = it; it != Timers.end(); it = it_next)
-	{
-		++it_next;
-		if (it->second->GetOwner() == m)
-			delete it->second;
-	}
+	std::vector<Timer *> owned;
+
+	for (unsigned i = 0; i < ROOT_SIZE; ++i)
+		for (Timer *t = root_wheel[i]; t; t = t->next)
+			if (t->GetOwner() == m)
+				owned.push_back(t);
+	for (unsigned level = 0; level < OUTER_LEVELS; ++level)
+		for (unsigned i = 0; i < LEVEL_SIZE; ++i)
+			for (Timer *t = outer_wheels[level][i]; t; t = t->next)
+				if (t->GetOwner() == m)
+					owned.push_back(t);
+	for (Timer *t = expiring; t; t = t->next)
+		if (t->GetOwner() == m)
+			owned.push_back(t);
+
+	for (unsigned i = 0; i < owned.size(); ++i)
+		delete owned[i];
 }
 
+long TimerManager::GetTimeout(time_t max)
+{
+	long max_ms = max * 1000;
+	if (!timer_count)
+		return max_ms;
+
+	/* Timers in the outer levels are not due before they cascade down at the next turn of the root wheel */
+	time_t turn = (wheel_time + ROOT_MASK) & ~static_cast<time_t>(ROOT_MASK), due = wheel_time + ROOT_SIZE;
+	for (unsigned i = 0; i < ROOT_SIZE; ++i)
+		if (root_wheel[(wheel_time + i) & ROOT_MASK])
+		{
+			due = wheel_time + i;
+			break;
+		}
+
+	for (unsigned level = 0; due > turn && level < OUTER_LEVELS; ++level)
+		for (unsigned i = 0; i < LEVEL_SIZE; ++i)
+			if (outer_wheels[level][i])
+			{
+				due = turn;
+				break;
+			}
+
+	timeval now;
+	gettimeofday(&now, NULL);
+
+	long long wait = static_cast<long long>(due) * 1000 - (static_cast<long long>(now.tv_sec) * 1000 + now.tv_usec / 1000);
+	if (wait < 0)
+		return 0;
+	if (wait > max_ms)
+		return max_ms;
+	return wait;
+}
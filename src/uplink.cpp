@@ -121,7 +121,7 @@ UplinkSocket::~UplinkSocket()
 bool UplinkSocket::ProcessRead()
 {
 	bool b = BufferedSocket::ProcessRead();
-	for (Anope::string buf; (buf = this->GetLine()).empty() == false;)
+	for (Anope::string buf; this->GetLine(buf);)
 	{
 		Anope::Process(buf);
 		User::QuitUsers();
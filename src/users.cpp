@@ -106,7 +106,10 @@ void User::ChangeNick(const Anope::string &newnick, time_t ts)
 	{
 		NickAlias *old_na = NickAlias::Find(this->nick);
 		if (old_na && (this->IsIdentified(true) || this->IsRecognized()))
+		{
 			old_na->last_seen = Anope::CurTime;
+			old_na->QueueUpdate();
+		}
 		
 		UserListByNick.erase(this->nick);
 		this->nick = newnick;
@@ -120,6 +123,7 @@ void User::ChangeNick(const Anope::string &newnick, time_t ts)
 		if (na && na->nc == this->Account())
 		{
 			na->last_seen = Anope::CurTime;
+			na->QueueUpdate();
 			this->UpdateHost();
 		}
 	}
@@ -226,7 +230,10 @@ void User::SetRealname(const Anope::string &srealname)
 	NickAlias *na = NickAlias::Find(this->nick);
 
 	if (na && (this->IsIdentified(true) || this->IsRecognized()))
+	{
 		na->last_realname = srealname;
+		na->QueueUpdate();
+	}
 
 	Log(this, "realname") << "changed realname to " << srealname;
 }
@@ -301,6 +308,7 @@ void User::Identify(NickAlias *na)
 		na->last_realhost = this->GetIdent() + "@" + this->host;
 		na->last_realname = this->realname;
 		na->last_seen = Anope::CurTime;
+		na->QueueUpdate();
 	}
 
 	this->Login(na->nc);
@@ -446,8 +454,12 @@ void User::UpdateHost()
 	{
 		Anope::string last_usermask = this->GetIdent() + "@" + this->GetDisplayedHost();
 		Anope::string last_realhost = this->GetIdent() + "@" + this->host;
-		na->last_usermask = last_usermask;
-		na->last_realhost = last_realhost;
+		if (na->last_usermask != last_usermask || na->last_realhost != last_realhost)
+		{
+			na->last_usermask = last_usermask;
+			na->last_realhost = last_realhost;
+			na->QueueUpdate();
+		}
 	}
 }
 
@@ -31,6 +31,21 @@ int write(int fd, const char *buf, size_t count)
 		return _write(fd, buf, count);
 }
 
+int writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	std::vector<WSABUF> bufs(iovcnt);
+	for (int i = 0; i < iovcnt; ++i)
+	{
+		bufs[i].buf = static_cast<char *>(iov[i].iov_base);
+		bufs[i].len = iov[i].iov_len;
+	}
+
+	DWORD sent;
+	if (WSASend(fd, &bufs[0], iovcnt, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+		return -1;
+	return sent;
+}
+
 int windows_close(int fd)
 {
 	if (is_socket(fd))
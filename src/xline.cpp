@@ -19,11 +19,294 @@
 #include "config.h"
 #include "commands.h"
 #include "servers.h"
+#include "expiry.h"
 
 /* List of XLine managers we check users against in XLineManager::CheckAll */
 std::list<XLineManager *> XLineManager::XLineManagers;
 Serialize::Checker<std::multimap<Anope::string, XLine *, ci::less> > XLineManager::XLinesByUID("XLine");
 
+/** An index of the XLines of an XLineManager, so checking a user does not have to
+ * check every XLine. XLines are indexed by the mask their manager gives for them:
+ * CIDR ranges are kept in a binary radix tree per address family, literal masks in
+ * a hash map, and masks beginning or ending with literal text in character tries of
+ * their prefix or of their reversed suffix. The remaining XLines are checked against
+ * every user. The index only finds the XLines a user may match, the manager's Check
+ * still decides whether the user matches them.
+ */
+class XLineIndex
+{
+ public:
+	/* An XLine and its position in the XLine list, used to check newer XLines first */
+	typedef std::pair<unsigned, XLine *> Entry;
+
+ private:
+	/* A node of a trie, the XLines whose prefix (or reversed suffix) is exactly the path to it */
+	struct CharNode
+	{
+		std::map<char, CharNode *> children;
+		std::vector<Entry> entries;
+
+		~CharNode()
+		{
+			this->Clear();
+		}
+
+		void Clear()
+		{
+			for (std::map<char, CharNode *>::iterator it = children.begin(), it_end = children.end(); it != it_end; ++it)
+				delete it->second;
+			children.clear();
+			entries.clear();
+		}
+	};
+
+	enum Kind
+	{
+		INDEX_NONE,
+		INDEX_LITERAL,
+		INDEX_PREFIX,
+		INDEX_SUFFIX
+	};
+
+	/* What is known about an indexed XLine */
+	struct Record
+	{
+		unsigned position;
+		Anope::string mask;
+	};
+
+	TR1NS::unordered_map<XLine *, Record> records;
+	unsigned next_position;
+	CIDRTree<Entry> ranges;
+	Anope::hash_map<std::vector<Entry> > literals;
+	CharNode prefixes, suffixes;
+	std::vector<Entry> unindexed;
+
+	/** Work out how a mask is indexed
+	 * @param mask The mask
+	 * @param key Filled in with the literal mask, prefix, or suffix
+	 * @return How the mask is indexed
+	 */
+	static Kind Classify(const Anope::string &mask, Anope::string &key)
+	{
+		if (mask.empty())
+			return INDEX_NONE;
+
+		size_t first = mask.find_first_of("*?");
+		if (first == Anope::string::npos)
+		{
+			key = mask;
+			return INDEX_LITERAL;
+		}
+
+		/* Anything matching must begin with the text before the first wildcard and end with the text after the last */
+		size_t last = mask.find_last_of("*?"), suffix_len = mask.length() - last - 1;
+		if (!first && !suffix_len)
+			return INDEX_NONE;
+		else if (first >= suffix_len)
+		{
+			key = mask.substr(0, first);
+			return INDEX_PREFIX;
+		}
+
+		key = mask.substr(last + 1);
+		return INDEX_SUFFIX;
+	}
+
+	static CharNode *Walk(CharNode *n, const Anope::string &key, bool reverse, bool create)
+	{
+		for (unsigned i = 0; n && i < key.length(); ++i)
+		{
+			char c = Anope::tolower(key[reverse ? key.length() - i - 1 : i]);
+			std::map<char, CharNode *>::iterator it = n->children.find(c);
+			if (it != n->children.end())
+				n = it->second;
+			else if (create)
+				n = n->children[c] = new CharNode();
+			else
+				n = NULL;
+		}
+		return n;
+	}
+
+	static void Erase(std::vector<Entry> &entries, XLine *x)
+	{
+		for (unsigned i = 0; i < entries.size(); ++i)
+			if (entries[i].second == x)
+			{
+				entries.erase(entries.begin() + i);
+				break;
+			}
+	}
+
+	/** Get the lists an XLine with the given mask is kept in
+	 * @param mask The mask
+	 * @param create Whether to create lists which do not exist
+	 * @param lists Filled in with the lists
+	 */
+	void GetLists(const Anope::string &mask, bool create, std::vector<std::vector<Entry> *> &lists)
+	{
+		Anope::string key;
+		Kind kind = Classify(mask, key);
+
+		if (kind == INDEX_NONE)
+			lists.push_back(&this->unindexed);
+		else if (kind == INDEX_LITERAL)
+		{
+			Anope::hash_map<std::vector<Entry> >::iterator it = this->literals.find(key);
+			if (it != this->literals.end())
+				lists.push_back(&it->second);
+			else if (create)
+				lists.push_back(&this->literals[key]);
+
+			/* A literal mask may also be a CIDR range */
+			std::vector<Entry> *range = mask.find('/') != Anope::string::npos ? this->ranges.Get(mask, create) : NULL;
+			if (range)
+				lists.push_back(range);
+		}
+		else
+		{
+			CharNode *n = Walk(kind == INDEX_PREFIX ? &this->prefixes : &this->suffixes, key, kind == INDEX_SUFFIX, create);
+			if (n)
+				lists.push_back(&n->entries);
+		}
+	}
+
+	static void Append(const std::vector<Entry> &entries, std::vector<Entry> &candidates)
+	{
+		candidates.insert(candidates.end(), entries.begin(), entries.end());
+	}
+
+	static void FindTrie(const CharNode *n, const Anope::string &key, bool reverse, std::vector<Entry> &candidates)
+	{
+		for (unsigned i = 0; n; ++i)
+		{
+			Append(n->entries, candidates);
+			if (i == key.length())
+				break;
+
+			char c = Anope::tolower(key[reverse ? key.length() - i - 1 : i]);
+			std::map<char, CharNode *>::const_iterator it = n->children.find(c);
+			n = it != n->children.end() ? it->second : NULL;
+		}
+	}
+
+ public:
+	XLineIndex() : next_position(0) { }
+
+	~XLineIndex()
+	{
+		this->Clear();
+	}
+
+	void Clear()
+	{
+		this->ranges.Clear();
+		this->records.clear();
+		this->literals.clear();
+		this->prefixes.Clear();
+		this->suffixes.Clear();
+		this->unindexed.clear();
+	}
+
+	/** Add an XLine, or update it if it is already in the index
+	 * @param x The XLine
+	 * @param mask The mask to index it by
+	 */
+	void Add(XLine *x, const Anope::string &mask)
+	{
+		TR1NS::unordered_map<XLine *, Record>::iterator it = this->records.find(x);
+		if (it == this->records.end())
+		{
+			it = this->records.insert(std::make_pair(x, Record())).first;
+			it->second.position = this->next_position++;
+		}
+		else
+			this->Remove(x, false);
+
+		Record &r = it->second;
+		r.mask = mask;
+
+		Entry entry(r.position, x);
+		std::vector<std::vector<Entry> *> lists;
+		this->GetLists(mask, true, lists);
+		for (unsigned i = 0; i < lists.size(); ++i)
+			lists[i]->push_back(entry);
+	}
+
+	/** Remove an XLine
+	 * @param x The XLine
+	 * @param forget false to keep its position, when it is about to be added again
+	 */
+	void Remove(XLine *x, bool forget = true)
+	{
+		TR1NS::unordered_map<XLine *, Record>::iterator it = this->records.find(x);
+		if (it == this->records.end())
+			return;
+
+		std::vector<std::vector<Entry> *> lists;
+		this->GetLists(it->second.mask, false, lists);
+		for (unsigned i = 0; i < lists.size(); ++i)
+			Erase(*lists[i], x);
+
+		if (forget)
+			this->records.erase(it);
+	}
+
+	/** Find the XLines a user may match
+	 * @param keys The user's index keys
+	 * @param candidates Filled in with the XLines, newest first
+	 */
+	void Find(const std::vector<Anope::string> &keys, std::vector<XLine *> &candidates) const
+	{
+		std::vector<Entry> entries = this->unindexed;
+
+		for (unsigned i = 0; i < keys.size(); ++i)
+		{
+			const Anope::string &key = keys[i];
+
+			Anope::hash_map<std::vector<Entry> >::const_iterator it = this->literals.find(key);
+			if (it != this->literals.end())
+				Append(it->second, entries);
+
+			FindTrie(&this->prefixes, key, false, entries);
+			FindTrie(&this->suffixes, key, true, entries);
+			this->ranges.Find(key, entries);
+		}
+
+		std::sort(entries.begin(), entries.end(), std::greater<Entry>());
+		for (unsigned i = 0; i < entries.size(); ++i)
+			if (!i || entries[i].second != entries[i - 1].second)
+				candidates.push_back(entries[i].second);
+	}
+};
+
+/** The queue of the XLines of an XLineManager which expire
+ */
+class XLineExpiry : public ExpiryQueue
+{
+	XLineManager *manager;
+
+ public:
+	XLineExpiry(XLineManager *xlm) : ExpiryQueue(xlm->owner, xlm->name), manager(xlm) { }
+
+	bool Check(Serializable *obj) anope_override
+	{
+		XLine *x = anope_dynamic_static_cast<XLine *>(obj);
+		if (!x->expires || x->manager != this->manager)
+			return false;
+		else if (x->expires >= Anope::CurTime)
+		{
+			this->Schedule(x, x->expires);
+			return false;
+		}
+
+		this->manager->OnExpire(x);
+		this->manager->DelXLine(x);
+		return true;
+	}
+};
+
 void XLine::InitRegex()
 {
 	if (this->mask.length() >= 2 && this->mask[0] == '/' && this->mask[this->mask.length() - 1] == '/' && !Config->GetBlock("options")->Get<const Anope::string>("regexengine").empty())
@@ -170,6 +453,8 @@ Serializable* XLine::Unserialize(Serializable *obj, Serialize::Data &data)
 			xl->manager->DelXLine(xl);
 			xlm->AddXLine(xl);
 		}
+		else
+			xlm->UpdateXLine(xl);
 	}
 	else
 	{
@@ -244,13 +529,16 @@ Anope::string XLineManager::GenerateUID()
 	return id;
 }
 
-XLineManager::XLineManager(Module *creator, const Anope::string &xname, char t) : Service(creator, "XLineManager", xname), type(t), xlines("XLine")
+XLineManager::XLineManager(Module *creator, const Anope::string &xname, char t) : Service(creator, "XLineManager", xname), type(t), xlines("XLine"), xline_index(new XLineIndex())
 {
+	this->expiry = new XLineExpiry(this);
 }
 
 XLineManager::~XLineManager()
 {
 	this->Clear();
+	delete this->xline_index;
+	delete this->expiry;
 }
 
 const char &XLineManager::Type()
@@ -274,6 +562,9 @@ void XLineManager::AddXLine(XLine *x)
 		XLinesByUID->insert(std::make_pair(x->id, x));
 	this->xlines->push_back(x);
 	x->manager = this;
+	this->xline_index->Add(x, this->GetIndexMask(x));
+	if (x->expires)
+		this->expiry->Schedule(x, x->expires);
 }
 
 bool XLineManager::DelXLine(XLine *x)
@@ -293,6 +584,7 @@ bool XLineManager::DelXLine(XLine *x)
 
 	if (it != this->xlines->end())
 	{
+		this->xline_index->Remove(x);
 		this->SendDel(x);
 
 		delete x;
@@ -304,14 +596,27 @@ bool XLineManager::DelXLine(XLine *x)
 	return false;
 }
 
+void XLineManager::UpdateXLine(XLine *x)
+{
+	if (x->manager != this)
+		return;
+
+	this->xline_index->Add(x, this->GetIndexMask(x));
+	if (x->expires)
+		this->expiry->Schedule(x, x->expires);
+}
+
+void XLineManager::Expire()
+{
+	this->expiry->Process();
+}
+
 XLine* XLineManager::GetEntry(unsigned index)
 {
 	if (index >= this->xlines->size())
 		return NULL;
 
-	XLine *x = this->xlines->at(index);
-	x->QueueUpdate();
-	return x;
+	return this->xlines->at(index);
 }
 
 void XLineManager::Clear()
@@ -324,6 +629,8 @@ void XLineManager::Clear()
 		delete x;
 	}
 	this->xlines->clear();
+	this->xline_index->Clear();
+	this->expiry->Clear();
 }
 
 bool XLineManager::CanAdd(CommandSource &source, const Anope::string &mask, time_t expires, const Anope::string &reason)
@@ -339,6 +646,7 @@ bool XLineManager::CanAdd(CommandSource &source, const Anope::string &mask, time
 				if (x->reason != reason)
 				{
 					x->reason = reason;
+					x->QueueUpdate();
 					source.Reply(_("Reason for %s updated."), x->mask.c_str());
 				}
 				else
@@ -347,6 +655,8 @@ bool XLineManager::CanAdd(CommandSource &source, const Anope::string &mask, time
 			else
 			{
 				x->expires = expires;
+				x->QueueUpdate();
+				this->UpdateXLine(x);
 				if (x->reason != reason)
 				{
 					x->reason = reason;
@@ -379,19 +689,13 @@ XLine* XLineManager::HasEntry(const Anope::string &mask)
 	if (it != XLinesByUID->end())
 		for (std::multimap<Anope::string, XLine *, ci::less>::iterator it2 = XLinesByUID->upper_bound(mask); it != it2; ++it)
 			if (it->second->manager == NULL || it->second->manager == this)
-			{
-				it->second->QueueUpdate();
 				return it->second;
-			}
 	for (unsigned i = 0, end = this->xlines->size(); i < end; ++i)
 	{
 		XLine *x = this->xlines->at(i);
 
 		if (x->mask.equals_ci(mask))
-		{
-			x->QueueUpdate();
 			return x;
-		}
 	}
 
 	return NULL;
@@ -399,9 +703,19 @@ XLine* XLineManager::HasEntry(const Anope::string &mask)
 
 XLine *XLineManager::CheckAllXLines(User *u)
 {
-	for (unsigned i = this->xlines->size(); i > 0; --i)
+	/* This gives the database a chance to add XLines before the index is used */
+	*this->xlines;
+	this->Expire();
+
+	std::vector<Anope::string> keys;
+	this->GetIndexKeys(u, keys);
+
+	std::vector<XLine *> candidates;
+	this->xline_index->Find(keys, candidates);
+
+	for (unsigned i = 0; i < candidates.size(); ++i)
 	{
-		XLine *x = this->xlines->at(i - 1);
+		XLine *x = candidates[i];
 
 		if (x->expires && x->expires < Anope::CurTime)
 		{
@@ -424,3 +738,12 @@ void XLineManager::OnExpire(const XLine *x)
 {
 }
 
+Anope::string XLineManager::GetIndexMask(const XLine *x)
+{
+	return "";
+}
+
+void XLineManager::GetIndexKeys(User *u, std::vector<Anope::string> &keys)
+{
+}
+